@@ -0,0 +1,87 @@
+#ifndef CXXALIGNEDALLOCATOR_H
+#define CXXALIGNEDALLOCATOR_H
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+
+
+namespace csp
+{
+  // Allocator returning `kAlign`-byte aligned storage.
+  // Elements constructed without arguments are default-initialized, so
+  // `resize` does not zero-fill buffers that are about to be overwritten.
+  template <typename T, std::size_t kAlign = 64>
+  class AlignedAllocator
+  {
+  public:
+    using value_type = T;
+
+    template <typename U>
+    struct rebind
+    {
+      using other = AlignedAllocator<U, kAlign>;
+    };
+
+
+    static constexpr std::size_t kAlignment = kAlign;
+
+
+    constexpr AlignedAllocator() noexcept = default;
+
+    template <typename U>
+    constexpr AlignedAllocator(const AlignedAllocator<U, kAlign>&) noexcept
+    {
+    }
+
+    ~AlignedAllocator() = default;
+
+    AlignedAllocator(const AlignedAllocator& rh) = default;
+
+    AlignedAllocator(AlignedAllocator&& rh) = default;
+
+    AlignedAllocator& operator=(const AlignedAllocator& rh) = default;
+
+    AlignedAllocator& operator=(AlignedAllocator&& rh) = default;
+
+
+    template <typename U>
+    bool operator==(const AlignedAllocator<U, kAlign>&) const noexcept
+    {
+      return true;
+    }
+
+
+    [[nodiscard]]
+    T* allocate(const std::size_t n)
+    {
+      return static_cast<T*>(
+        ::operator new(n * sizeof(T), std::align_val_t(kAlign))
+      );
+    }
+
+    void deallocate(T* const ptr, const std::size_t) noexcept
+    {
+      ::operator delete(ptr, std::align_val_t(kAlign));
+    }
+
+    template <typename U>
+    void construct(U* const ptr)
+      noexcept(std::is_nothrow_default_constructible_v<U>)
+    {
+      ::new (static_cast<void*>(ptr)) U;
+    }
+
+    template <typename U, typename... Args>
+    void construct(U* const ptr, Args&&... args)
+    {
+      ::new (static_cast<void*>(ptr)) U(std::forward<Args>(args)...);
+    }
+  };
+}
+
+
+
+#endif // CXXALIGNEDALLOCATOR_H
@@ -14,6 +14,68 @@
 
 namespace csp::utils
 {
+  namespace detail
+  {
+    // Frame of Color::GenerateColor around one base color: the base's HSV
+    // point on the cone and two unit axes orthogonal to it.  At(number)
+    // rotates the point by number * 5 degrees about them.
+    class ColorOrbit
+    {
+      using Vec3F = math::Vector3<float>;
+
+      static constexpr float kPi = std::numbers::pi_v<float>;
+
+
+      Vec3F vec_;
+
+      Vec3F axis1_;
+
+      Vec3F axis2_;
+
+
+    public:
+      // Frame of (h, s, v) as Color::to_hsv returns it.
+      explicit ColorOrbit(const std::tuple<float, float, float>& hsv)
+      {
+        const auto [h, s, v] = hsv;
+        const float theta = kPi / 2.f * v;
+        const float phi = 2.f * kPi * h;
+
+        vec_ = {
+          s * std::sin(theta) * std::cos(phi),
+          s * std::sin(theta) * std::sin(phi),
+          -std::cos(theta)
+        };
+        const Vec3F vec_normal = vec_.normalize();
+        const Vec3F up = {0.f, 0.f, 1.f};
+        axis1_ = vec_normal.cross(up).normalize();
+        axis2_ = vec_normal.cross(axis1_).normalize();
+      }
+
+      // (h, s, v) of color `number`, h as a fraction of a turn.
+      std::tuple<float, float, float> At(const int number) const noexcept
+      {
+        const float step = kPi / 36.f * number;
+        const Vec3F new_vec = (
+          std::sin(step) * (std::cos(step) * axis1_ + std::sin(step) * axis2_)
+          + std::cos(step) * vec_
+        );
+
+        const float new_v = 1.f - std::acos(-new_vec.z_) / kPi;
+        const float r = std::sqrt(
+          new_vec.x_ * new_vec.x_ + new_vec.y_ * new_vec.y_
+        );
+        const float new_s = r / std::sin(kPi / 2.f * new_v);
+        float new_h = std::atan2(new_vec.y_, new_vec.x_) / (2.f * kPi);
+        if (new_h < 0.f) {
+          new_h += 1.f;
+        }
+        return {new_h, new_s, new_v};
+      }
+    };
+  }
+
+
   class Color
   {
     using RGB = std::tuple<unsigned char, unsigned char, unsigned char>;
@@ -154,42 +216,7 @@ namespace csp::utils
 
     Color GenerateColor(const int number) const
     {
-      static constexpr float pi = std::numbers::pi_v<float>;
-
-      auto [h, s, v] = to_hsv();
-      const float theta = pi / 2.f * v;
-      const float phi = 2.f * pi * h;
-
-      using Vec3F = math::Vector3<float>;
-
-      Vec3F vec = {
-        s * std::sin(theta) * std::cos(phi),
-        s * std::sin(theta) * std::sin(phi),
-        -std::cos(theta)
-      };
-      Vec3F vec_normal = vec.normalize();
-      Vec3F up = {0.f, 0.f, 1.f};
-      Vec3F axis1 = vec_normal.cross(up).normalize();
-      Vec3F axis2 = vec_normal.cross(axis1).normalize();
-
-      const float step = pi / 36.f * number;
-
-      Vec3F new_vec = (
-        std::sin(step) * (std::cos(step) * axis1 + std::sin(step) * axis2)
-        + std::cos(step) * vec
-      );
-
-      const float new_v = 1.f - std::acos(-new_vec.z_) / pi;
-      const float r = std::sqrt(
-        new_vec.x_ * new_vec.x_ + new_vec.y_ * new_vec.y_
-      );
-      const float new_s = r / std::sin(pi / 2.f * new_v);
-      float new_h = std::atan2(new_vec.y_, new_vec.x_) / (2.f * pi);
-      if (new_h < 0.f) {
-        new_h += 1.f;
-      }
-
-      return {new_h, new_s, new_v};
+      return Color(detail::ColorOrbit(to_hsv()).At(number));
     }
   };
 }
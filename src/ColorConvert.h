@@ -0,0 +1,195 @@
+#ifndef CXXCOLORCONVERT_H
+#define CXXCOLORCONVERT_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <span>
+#include <stdexcept>
+#include <tuple>
+
+#include "Color.h"
+#include "ThreadPool.h"
+
+
+
+namespace csp::utils
+{
+  // HSV triple as produced by Color::to_hsv: h in degrees [0, 360),
+  // s and v in [0, 1].
+  struct Hsv
+  {
+    float h_;
+    float s_;
+    float v_;
+  };
+
+
+  namespace detail
+  {
+    // Pixels converted together: deinterleaved into float arrays, run
+    // through straight-line loops the compiler vectorizes, and stored back.
+    inline constexpr std::size_t kColorBlock = 64;
+
+    inline constexpr std::size_t kColorParallelThreshold = 1 << 16;
+
+    inline constexpr std::size_t kColorParallelGrain = 1 << 14;
+
+
+    // std::round for |x| < 2^31, without the libm call: halves round away
+    // from zero.
+    inline float Round(const float x) noexcept
+    {
+      const float t = static_cast<float>(static_cast<int>(x));
+      const float frac = x - t;
+      return t + (frac >= 0.5f ? 1.f : 0.f) - (frac <= -0.5f ? 1.f : 0.f);
+    }
+
+    // std::trunc in plain float arithmetic, which vectorizes where the
+    // libm call does not: adding and subtracting 2^23 rounds |x| to an
+    // integer, and a round-up is stepped back. Floats of magnitude 2^23
+    // and up are integral already.
+    inline float Trunc(const float x) noexcept
+    {
+      constexpr float kIntegral = 8388608.f;
+      const float a = std::abs(x);
+      const float rounded = (a + kIntegral) - kIntegral;
+      const float t = rounded - (rounded > a ? 1.f : 0.f);
+      return std::copysign(a < kIntegral ? t : a, x);
+    }
+
+    inline void CheckPixels(const bool is_valid)
+    {
+      if (!is_valid) {
+        throw std::invalid_argument("color buffer size mismatch");
+      }
+    }
+
+
+    // Branchless form of Color::to_hsv: the three hue candidates of the
+    // scalar if-chain are computed with the same operations, and selected.
+    inline void ToHsvBlock(
+      const Color* src, Hsv* dst, const std::size_t n
+    ) noexcept
+    {
+      float r[kColorBlock];
+      float g[kColorBlock];
+      float b[kColorBlock];
+      float h[kColorBlock];
+      float s[kColorBlock];
+      float v[kColorBlock];
+      for (std::size_t i = 0; i < n; ++i) {
+        const auto [cr, cg, cb] = src[i].to_rgb();
+        r[i] = cr / 255.f;
+        g[i] = cg / 255.f;
+        b[i] = cb / 255.f;
+      }
+      for (std::size_t i = 0; i < n; ++i) {
+        // Value selects rather than std::max/min: those return references,
+        // which the vectorizer treats as gathers.
+        const float ri = r[i];
+        const float gi = g[i];
+        const float bi = b[i];
+        const float max_rg = ri < gi ? gi : ri;
+        const float min_rg = gi < ri ? gi : ri;
+        const float max_val = max_rg < bi ? bi : max_rg;
+        const float min_val = bi < min_rg ? bi : min_rg;
+        const float delta = max_val - min_val;
+        const bool is_red = max_val == ri;
+        const bool is_green = max_val == gi;
+        const float num = is_red ? gi - bi : is_green ? bi - ri : ri - gi;
+        const float quotient = num / (delta == 0.f ? 1.f : delta);
+        float hue = 60.f * (
+          is_red ? quotient : quotient + (is_green ? 2.f : 4.f)
+        );
+        hue = hue < 0.f ? hue + 360.f : hue;
+        h[i] = delta == 0.f ? 0.f : hue;
+        s[i] = max_val == 0.f ? 0.f : delta / (max_val == 0.f ? 1.f : max_val);
+        v[i] = max_val;
+      }
+      for (std::size_t i = 0; i < n; ++i) {
+        dst[i] = {h[i], s[i], v[i]};
+      }
+    }
+
+    // Branchless form of Color(h, s, v): fmod(t, 2) is t - 2 trunc(t / 2),
+    // which is exact, and the six hue sectors become selects.
+    inline void ToRgbBlock(
+      const Hsv* src, Color* dst, const std::size_t n
+    ) noexcept
+    {
+      float h[kColorBlock];
+      float s[kColorBlock];
+      float v[kColorBlock];
+      float r[kColorBlock];
+      float g[kColorBlock];
+      float b[kColorBlock];
+      for (std::size_t i = 0; i < n; ++i) {
+        h[i] = src[i].h_;
+        s[i] = src[i].s_;
+        v[i] = src[i].v_;
+      }
+      for (std::size_t i = 0; i < n; ++i) {
+        const float t = h[i] / 60.f;
+        const float fmod = t - 2.f * Trunc(t / 2.f);
+        const float max_val = Round(255.f * v[i]);
+        const float min_val = Round(255.f * v[i] * (1.f - s[i]));
+        const float x_val = Round(
+          255.f * v[i] * (1.f - s[i] * std::abs(fmod - 1.f))
+        );
+
+        const float hi = h[i];
+        r[i] = hi < 60.f ? max_val : hi < 120.f ? x_val
+          : hi < 240.f ? min_val : hi < 300.f ? x_val : max_val;
+        g[i] = hi < 60.f ? x_val : hi < 180.f ? max_val
+          : hi < 240.f ? x_val : min_val;
+        b[i] = hi < 120.f ? min_val : hi < 180.f ? x_val
+          : hi < 300.f ? max_val : x_val;
+      }
+      for (std::size_t i = 0; i < n; ++i) {
+        dst[i] = Color(
+          static_cast<unsigned char>(static_cast<int>(r[i])),
+          static_cast<unsigned char>(static_cast<int>(g[i])),
+          static_cast<unsigned char>(static_cast<int>(b[i]))
+        );
+      }
+    }
+  }
+
+
+  // dst[i] = src[i].to_hsv(), bit for bit.
+  inline void ToHsv(std::span<const Color> src, std::span<Hsv> dst)
+  {
+    detail::CheckPixels(dst.size() >= src.size());
+    ParallelForIfLarge(
+      src.size(), detail::kColorParallelThreshold, detail::kColorParallelGrain,
+      [&](const std::size_t lo, const std::size_t hi) {
+        for (std::size_t i = lo; i < hi; i += detail::kColorBlock) {
+          const std::size_t n = std::min(detail::kColorBlock, hi - i);
+          detail::ToHsvBlock(src.data() + i, dst.data() + i, n);
+        }
+      }
+    );
+  }
+
+  // dst[i] = Color(src[i].h_, src[i].s_, src[i].v_), bit for bit.
+  // Channels pushed out of [0, 255] (s > 1, as GenerateColor produces)
+  // wrap modulo 256, as the scalar conversion does on x86.
+  inline void ToRgb(std::span<const Hsv> src, std::span<Color> dst)
+  {
+    detail::CheckPixels(dst.size() >= src.size());
+    ParallelForIfLarge(
+      src.size(), detail::kColorParallelThreshold, detail::kColorParallelGrain,
+      [&](const std::size_t lo, const std::size_t hi) {
+        for (std::size_t i = lo; i < hi; i += detail::kColorBlock) {
+          const std::size_t n = std::min(detail::kColorBlock, hi - i);
+          detail::ToRgbBlock(src.data() + i, dst.data() + i, n);
+        }
+      }
+    );
+  }
+}
+
+
+
+#endif // CXXCOLORCONVERT_H
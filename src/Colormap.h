@@ -0,0 +1,272 @@
+#ifndef CXXCOLORMAP_H
+#define CXXCOLORMAP_H
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include "Color.h"
+#include "ColorConvert.h"
+#include "MatrixExpr.h"
+
+
+
+namespace csp::utils
+{
+  namespace detail
+  {
+    inline void CheckColormap(const bool is_valid, const char* message)
+    {
+      if (!is_valid) {
+        throw std::invalid_argument(message);
+      }
+    }
+  }
+
+
+  // Scalar-to-color map baked into a fixed table of kLutSize colors.  The
+  // stops are interpolated linearly in RGB once, at construction; mapping
+  // a value is then a scale, a clamp and a table load.
+  class Colormap
+  {
+  public:
+    static constexpr std::size_t kLutSize = 1024;
+
+
+  private:
+    std::array<Color, kLutSize> lut_;
+
+    float lower_;
+
+    float upper_;
+
+    // (kLutSize - 1) / (upper_ - lower_)
+    float scale_;
+
+
+    // Table positions of `n` values, rounded and clamped to the table; NaN
+    // goes to the first entry.  Kept apart from the table loads so the
+    // loop stays free of conversions and vectorizes.
+    template <typename T>
+    void Positions(const T* src, float* pos, const std::size_t n)
+      const noexcept
+    {
+      constexpr float kLast = static_cast<float>(kLutSize - 1);
+      for (std::size_t i = 0; i < n; ++i) {
+        const float x = (static_cast<float>(src[i]) - lower_) * scale_ + 0.5f;
+        pos[i] = x > 0.f ? (x < kLast ? x : kLast) : 0.f;
+      }
+    }
+
+    template <typename T>
+    void MapRange(const T* src, Color* dst, const std::size_t size) const
+    {
+      float pos[detail::kColorBlock];
+      for (std::size_t i = 0; i < size; i += detail::kColorBlock) {
+        const std::size_t n = std::min(detail::kColorBlock, size - i);
+        Positions(src + i, pos, n);
+        for (std::size_t k = 0; k < n; ++k) {
+          dst[i + k] = lut_[static_cast<std::size_t>(pos[k])];
+        }
+      }
+    }
+
+    template <typename T>
+    void MapBlocks(const T* src, Color* dst, const std::size_t size) const
+    {
+      ParallelForIfLarge(
+        size, detail::kColorParallelThreshold, detail::kColorParallelGrain,
+        [&](const std::size_t lo, const std::size_t hi) {
+          MapRange(src + lo, dst + lo, hi - lo);
+        }
+      );
+    }
+
+    static std::vector<float> EvenPositions(const std::size_t count)
+    {
+      std::vector<float> positions(count);
+      for (std::size_t k = 0; k < count; ++k) {
+        positions[k] = count > 1
+          ? static_cast<float>(k) / static_cast<float>(count - 1) : 0.f;
+      }
+      return positions;
+    }
+
+
+  public:
+    // Stops at `positions`, which rise from 0 to 1.
+    Colormap(std::span<const float> positions, std::span<const Color> stops)
+    : lower_(0.f), upper_(1.f), scale_(kLutSize - 1)
+    {
+      detail::CheckColormap(
+        stops.size() >= 2 && positions.size() == stops.size(),
+        "colormap needs matching positions for at least two stops"
+      );
+      detail::CheckColormap(
+        positions.front() == 0.f && positions.back() == 1.f
+          && std::is_sorted(positions.begin(), positions.end()),
+        "colormap positions must rise from 0 to 1"
+      );
+
+      std::size_t segment = 0;
+      for (std::size_t j = 0; j < kLutSize; ++j) {
+        const float t = static_cast<float>(j) / (kLutSize - 1);
+        while (segment + 2 < stops.size() && t > positions[segment + 1]) {
+          ++segment;
+        }
+        const float width = positions[segment + 1] - positions[segment];
+        const float f = width > 0.f ? (t - positions[segment]) / width : 1.f;
+        const auto [r0, g0, b0] = stops[segment].to_rgb();
+        const auto [r1, g1, b1] = stops[segment + 1].to_rgb();
+        const auto lerp = [f](const unsigned char a, const unsigned char b) {
+          return static_cast<unsigned char>(std::round(a + (b - a) * f));
+        };
+        lut_[j] = Color(lerp(r0, r1), lerp(g0, g1), lerp(b0, b1));
+      }
+    }
+
+    // Evenly spaced stops.
+    explicit Colormap(std::span<const Color> stops)
+    : Colormap(EvenPositions(stops.size()), stops)
+    {
+    }
+
+    ~Colormap() = default;
+
+    Colormap(const Colormap& rh) = default;
+
+    Colormap(Colormap&& rh) = default;
+
+    Colormap& operator=(const Colormap& rh) = default;
+
+    Colormap& operator=(Colormap&& rh) = default;
+
+
+    // Evenly spaced stops given as 0xRRGGBB.
+    template <std::size_t N>
+    static Colormap FromHex(const std::array<std::uint32_t, N>& hex)
+    {
+      std::array<Color, N> stops;
+      for (std::size_t k = 0; k < N; ++k) {
+        stops[k] = Color(hex[k]);
+      }
+      return Colormap(std::span<const Color>(stops));
+    }
+
+    // Perceptually uniform maps after matplotlib's, from ten samples each.
+    static Colormap Viridis()
+    {
+      static constexpr std::array<std::uint32_t, 10> kStops = {
+        0x440154, 0x482878, 0x3E4A89, 0x31688E, 0x26828E,
+        0x1F9E89, 0x35B779, 0x6DCD59, 0xB4DE2C, 0xFDE725
+      };
+      return FromHex(kStops);
+    }
+
+    static Colormap Magma()
+    {
+      static constexpr std::array<std::uint32_t, 10> kStops = {
+        0x000004, 0x180F3D, 0x440F76, 0x721F81, 0x9E2F7F,
+        0xCD4071, 0xF1605D, 0xFD9668, 0xFEC98D, 0xFCFDBF
+      };
+      return FromHex(kStops);
+    }
+
+
+    // Values at or below `lower` take the first color, at or above
+    // `upper` the last.
+    void SetRange(const float lower, const float upper)
+    {
+      detail::CheckColormap(lower < upper, "colormap range is empty");
+      lower_ = lower;
+      upper_ = upper;
+      scale_ = (kLutSize - 1) / (upper - lower);
+    }
+
+    float get_lower() const noexcept
+    {
+      return lower_;
+    }
+
+    float get_upper() const noexcept
+    {
+      return upper_;
+    }
+
+    std::span<const Color, kLutSize> get_table() const noexcept
+    {
+      return lut_;
+    }
+
+
+    Color Map(const float value) const noexcept
+    {
+      float pos;
+      Positions(&value, &pos, 1);
+      return lut_[static_cast<std::size_t>(pos)];
+    }
+
+    // out[i] = Map(values[i]), on the global thread pool for large inputs.
+    void Map(std::span<const float> values, std::span<Color> out) const
+    {
+      detail::CheckPixels(out.size() >= values.size());
+      MapBlocks(values.data(), out.data(), values.size());
+    }
+
+    // Row-major image of a real Matrix or DynMatrix, one pixel per element.
+    template <typename Mat>
+      requires math::MatrixExpression<Mat> && Mat::kIsLeaf
+        && std::is_arithmetic_v<typename Mat::ElemType>
+    void Map(const Mat& mat, std::span<Color> out) const
+    {
+      const std::size_t size = mat.rows() * mat.cols();
+      detail::CheckPixels(out.size() >= size);
+      MapBlocks(mat.data(), out.data(), size);
+    }
+
+    // Image of a 2-D buffer whose rows start `stride` values apart.
+    void Map(
+      std::span<const float> values,
+      const std::size_t rows,
+      const std::size_t cols,
+      const std::size_t stride,
+      std::span<Color> out
+    ) const
+    {
+      detail::CheckPixels(
+        cols <= stride && out.size() >= rows * cols
+          && (rows == 0 || values.size() >= (rows - 1) * stride + cols)
+      );
+      if (stride == cols || cols == 0) {
+        MapBlocks(values.data(), out.data(), rows * cols);
+        return;
+      }
+      // Pixel ranges split across rows: each row is mapped in pieces.
+      ParallelForIfLarge(
+        rows * cols,
+        detail::kColorParallelThreshold, detail::kColorParallelGrain,
+        [&](const std::size_t lo, const std::size_t hi) {
+          for (std::size_t row = lo / cols; row * cols < hi; ++row) {
+            const std::size_t begin = std::max(lo, row * cols);
+            const std::size_t end = std::min(hi, (row + 1) * cols);
+            MapRange(
+              values.data() + row * stride + (begin - row * cols),
+              out.data() + begin,
+              end - begin
+            );
+          }
+        }
+      );
+    }
+  };
+}
+
+
+
+#endif // CXXCOLORMAP_H
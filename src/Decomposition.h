@@ -0,0 +1,766 @@
+#ifndef CXXDECOMPOSITION_H
+#define CXXDECOMPOSITION_H
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstddef>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "Gemm.h"
+#include "MatrixExpr.h"
+
+
+
+namespace csp::math
+{
+  namespace linalg
+  {
+    // Panel width of the blocked LU.
+    inline constexpr std::size_t kLuBlock = 64;
+
+
+    template <typename T>
+    struct IsComplex : std::false_type
+    {
+    };
+
+    template <typename T>
+    struct IsComplex<std::complex<T>> : std::true_type
+    {
+    };
+
+    template <typename Elem>
+    concept FieldElement = (
+      std::is_floating_point_v<Elem> || IsComplex<Elem>::value
+    );
+
+
+    template <typename Elem>
+    constexpr Elem Conj(const Elem x) noexcept
+    {
+      if constexpr (IsComplex<Elem>::value) {
+        return std::conj(x);
+      } else {
+        return x;
+      }
+    }
+
+    template <typename Elem>
+    constexpr auto Abs2(const Elem x) noexcept
+    {
+      if constexpr (IsComplex<Elem>::value) {
+        return std::norm(x);
+      } else {
+        return x * x;
+      }
+    }
+
+    template <typename Elem>
+    constexpr auto RealPart(const Elem x) noexcept
+    {
+      if constexpr (IsComplex<Elem>::value) {
+        return x.real();
+      } else {
+        return x;
+      }
+    }
+
+
+    // In-place blocked LU with partial pivoting of a row-major n x n matrix:
+    // P A = L U, with the unit lower L and U sharing `a`.  Row i was
+    // swapped with row piv[i] at step i.  Returns the permutation parity
+    // (+1 / -1); zero pivots are left in place.
+    template <FieldElement Elem>
+    int LuFactor(
+      Elem* a, const std::size_t n, const std::size_t lda, std::size_t* piv
+    )
+    {
+      int sign = 1;
+
+      for (std::size_t k0 = 0; k0 < n; k0 += kLuBlock) {
+        const std::size_t kb = std::min(kLuBlock, n - k0);
+        const std::size_t k1 = k0 + kb;
+
+        for (std::size_t j = k0; j < k1; ++j) {
+          std::size_t p = j;
+          auto best = std::abs(a[j * lda + j]);
+          for (std::size_t i = j + 1; i < n; ++i) {
+            const auto val = std::abs(a[i * lda + j]);
+            if (val > best) {
+              best = val;
+              p = i;
+            }
+          }
+          piv[j] = p;
+          if (p != j) {
+            std::swap_ranges(a + j * lda, a + j * lda + n, a + p * lda);
+            sign = -sign;
+          }
+
+          const Elem pivot = a[j * lda + j];
+          if (pivot == Elem(0)) {
+            continue;
+          }
+          for (std::size_t i = j + 1; i < n; ++i) {
+            Elem* row = a + i * lda;
+            row[j] /= pivot;
+            for (std::size_t c = j + 1; c < k1; ++c) {
+              row[c] -= row[j] * a[j * lda + c];
+            }
+          }
+        }
+
+        if (k1 == n) {
+          break;
+        }
+
+        // U12 = L11^-1 A12
+        for (std::size_t j = k0; j < k1; ++j) {
+          for (std::size_t i = j + 1; i < k1; ++i) {
+            const Elem l_ij = a[i * lda + j];
+            for (std::size_t c = k1; c < n; ++c) {
+              a[i * lda + c] -= l_ij * a[j * lda + c];
+            }
+          }
+        }
+
+        // A22 -= L21 U12
+        gemm::Multiply(
+          n - k1, n - k1, kb, Elem(-1),
+          a + k1 * lda + k0, lda,
+          a + k0 * lda + k1, lda,
+          a + k1 * lda + k1, lda
+        );
+      }
+
+      return sign;
+    }
+
+
+    // Solves A X = B in place of the row-major n x nrhs `b`, from the
+    // factors of LuFactor.
+    template <FieldElement Elem>
+    void LuSolve(
+      const Elem* lu, const std::size_t n, const std::size_t lda,
+      const std::size_t* piv, Elem* b, const std::size_t nrhs,
+      const std::size_t ldb
+    )
+    {
+      for (std::size_t i = 0; i < n; ++i) {
+        if (piv[i] != i) {
+          std::swap_ranges(b + i * ldb, b + i * ldb + nrhs, b + piv[i] * ldb);
+        }
+      }
+
+      for (std::size_t i = 0; i < n; ++i) {
+        for (std::size_t k = 0; k < i; ++k) {
+          const Elem l_ik = lu[i * lda + k];
+          for (std::size_t c = 0; c < nrhs; ++c) {
+            b[i * ldb + c] -= l_ik * b[k * ldb + c];
+          }
+        }
+      }
+
+      for (std::size_t i = n; i-- > 0;) {
+        for (std::size_t k = i + 1; k < n; ++k) {
+          const Elem u_ik = lu[i * lda + k];
+          for (std::size_t c = 0; c < nrhs; ++c) {
+            b[i * ldb + c] -= u_ik * b[k * ldb + c];
+          }
+        }
+        const Elem u_ii = lu[i * lda + i];
+        for (std::size_t c = 0; c < nrhs; ++c) {
+          b[i * ldb + c] /= u_ii;
+        }
+      }
+    }
+
+
+    // In-place Cholesky of a Hermitian positive-definite row-major n x n
+    // matrix: A = L L^H.  Only the lower triangle is read; the strict upper
+    // triangle is zeroed.
+    template <FieldElement Elem>
+    void CholeskyFactor(Elem* a, const std::size_t n, const std::size_t lda)
+    {
+      for (std::size_t j = 0; j < n; ++j) {
+        Elem* row_j = a + j * lda;
+
+        auto diag = RealPart(row_j[j]);
+        for (std::size_t k = 0; k < j; ++k) {
+          diag -= Abs2(row_j[k]);
+        }
+        if (!(diag > 0)) {
+          throw std::domain_error("Matrix is not positive definite");
+        }
+        const auto l_jj = std::sqrt(diag);
+        row_j[j] = Elem(l_jj);
+
+        for (std::size_t i = j + 1; i < n; ++i) {
+          Elem* row_i = a + i * lda;
+          Elem val = row_i[j];
+          for (std::size_t k = 0; k < j; ++k) {
+            val -= row_i[k] * Conj(row_j[k]);
+          }
+          row_i[j] = val / l_jj;
+        }
+        std::fill(row_j + j + 1, row_j + n, Elem(0));
+      }
+    }
+
+
+    // Solves A X = B in place of `b`, from the factor of CholeskyFactor.
+    template <FieldElement Elem>
+    void CholeskySolve(
+      const Elem* l, const std::size_t n, const std::size_t lda,
+      Elem* b, const std::size_t nrhs, const std::size_t ldb
+    )
+    {
+      for (std::size_t i = 0; i < n; ++i) {
+        for (std::size_t k = 0; k < i; ++k) {
+          const Elem l_ik = l[i * lda + k];
+          for (std::size_t c = 0; c < nrhs; ++c) {
+            b[i * ldb + c] -= l_ik * b[k * ldb + c];
+          }
+        }
+        const Elem l_ii = l[i * lda + i];
+        for (std::size_t c = 0; c < nrhs; ++c) {
+          b[i * ldb + c] /= l_ii;
+        }
+      }
+
+      for (std::size_t i = n; i-- > 0;) {
+        for (std::size_t k = i + 1; k < n; ++k) {
+          const Elem l_ki = Conj(l[k * lda + i]);
+          for (std::size_t c = 0; c < nrhs; ++c) {
+            b[i * ldb + c] -= l_ki * b[k * ldb + c];
+          }
+        }
+        const Elem l_ii = l[i * lda + i];
+        for (std::size_t c = 0; c < nrhs; ++c) {
+          b[i * ldb + c] /= l_ii;
+        }
+      }
+    }
+
+
+    // In-place Householder QR of a row-major m x n matrix (m >= n):
+    // A = Q R with Q = H_0 ... H_{n-1} and H_k = I - tau_k v_k v_k^H.
+    // R is stored on and above the diagonal, v_k below it (v_k[k] = 1).
+    template <FieldElement Elem>
+    void QrFactor(
+      Elem* a, const std::size_t m, const std::size_t n, const std::size_t lda,
+      Elem* tau
+    )
+    {
+      using Real = decltype(RealPart(Elem()));
+
+      for (std::size_t k = 0; k < n; ++k) {
+        const Elem alpha = a[k * lda + k];
+        Real tail = 0;
+        for (std::size_t i = k + 1; i < m; ++i) {
+          tail += Abs2(a[i * lda + k]);
+        }
+
+        if (tail == Real(0) && Abs2(alpha) == Abs2(RealPart(alpha))) {
+          tau[k] = Elem(0);
+          continue;
+        }
+
+        const Real norm = std::sqrt(Abs2(alpha) + tail);
+        const Real beta = RealPart(alpha) >= Real(0) ? -norm : norm;
+        tau[k] = (Elem(beta) - alpha) / Elem(beta);
+        const Elem scale = Elem(1) / (alpha - Elem(beta));
+        for (std::size_t i = k + 1; i < m; ++i) {
+          a[i * lda + k] *= scale;
+        }
+        a[k * lda + k] = Elem(beta);
+
+        // A[k:, k+1:] = H_k^H A[k:, k+1:]
+        const Elem tau_h = Conj(tau[k]);
+        for (std::size_t c = k + 1; c < n; ++c) {
+          Elem w = a[k * lda + c];
+          for (std::size_t i = k + 1; i < m; ++i) {
+            w += Conj(a[i * lda + k]) * a[i * lda + c];
+          }
+          w *= tau_h;
+          a[k * lda + c] -= w;
+          for (std::size_t i = k + 1; i < m; ++i) {
+            a[i * lda + c] -= a[i * lda + k] * w;
+          }
+        }
+      }
+    }
+
+
+    // Overwrites the row-major m x nrhs `b` with Q^H B.
+    template <FieldElement Elem>
+    void QrApplyQh(
+      const Elem* qr, const std::size_t m, const std::size_t n,
+      const std::size_t lda, const Elem* tau,
+      Elem* b, const std::size_t nrhs, const std::size_t ldb
+    )
+    {
+      for (std::size_t k = 0; k < n; ++k) {
+        const Elem tau_h = Conj(tau[k]);
+        for (std::size_t c = 0; c < nrhs; ++c) {
+          Elem w = b[k * ldb + c];
+          for (std::size_t i = k + 1; i < m; ++i) {
+            w += Conj(qr[i * lda + k]) * b[i * ldb + c];
+          }
+          w *= tau_h;
+          b[k * ldb + c] -= w;
+          for (std::size_t i = k + 1; i < m; ++i) {
+            b[i * ldb + c] -= qr[i * lda + k] * w;
+          }
+        }
+      }
+    }
+
+
+    // Fully unrolled determinants and inverses of row-major 2x2 - 4x4.
+    template <std::size_t kN, typename Elem>
+      requires (kN >= 2 && kN <= 4)
+    constexpr Elem SmallDeterminant(const Elem* m) noexcept
+    {
+      if constexpr (kN == 2) {
+        return m[0] * m[3] - m[1] * m[2];
+      } else if constexpr (kN == 3) {
+        return (
+          m[0] * (m[4] * m[8] - m[5] * m[7])
+          - m[1] * (m[3] * m[8] - m[5] * m[6])
+          + m[2] * (m[3] * m[7] - m[4] * m[6])
+        );
+      } else {
+        const Elem s0 = m[0] * m[5] - m[4] * m[1];
+        const Elem s1 = m[0] * m[6] - m[4] * m[2];
+        const Elem s2 = m[0] * m[7] - m[4] * m[3];
+        const Elem s3 = m[1] * m[6] - m[5] * m[2];
+        const Elem s4 = m[1] * m[7] - m[5] * m[3];
+        const Elem s5 = m[2] * m[7] - m[6] * m[3];
+        const Elem c5 = m[10] * m[15] - m[14] * m[11];
+        const Elem c4 = m[9] * m[15] - m[13] * m[11];
+        const Elem c3 = m[9] * m[14] - m[13] * m[10];
+        const Elem c2 = m[8] * m[15] - m[12] * m[11];
+        const Elem c1 = m[8] * m[14] - m[12] * m[10];
+        const Elem c0 = m[8] * m[13] - m[12] * m[9];
+        return s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0;
+      }
+    }
+
+    // Writes the inverse of `m` to `inv`; returns false when singular.
+    template <std::size_t kN, typename Elem>
+      requires (kN >= 2 && kN <= 4)
+    constexpr bool SmallInverse(const Elem* m, Elem* inv) noexcept
+    {
+      if constexpr (kN == 2) {
+        const Elem det = SmallDeterminant<2>(m);
+        if (det == Elem(0)) {
+          return false;
+        }
+        const Elem r = Elem(1) / det;
+        inv[0] = m[3] * r;
+        inv[1] = -m[1] * r;
+        inv[2] = -m[2] * r;
+        inv[3] = m[0] * r;
+      } else if constexpr (kN == 3) {
+        const Elem a0 = m[4] * m[8] - m[5] * m[7];
+        const Elem a1 = m[5] * m[6] - m[3] * m[8];
+        const Elem a2 = m[3] * m[7] - m[4] * m[6];
+        const Elem det = m[0] * a0 + m[1] * a1 + m[2] * a2;
+        if (det == Elem(0)) {
+          return false;
+        }
+        const Elem r = Elem(1) / det;
+        inv[0] = a0 * r;
+        inv[1] = (m[2] * m[7] - m[1] * m[8]) * r;
+        inv[2] = (m[1] * m[5] - m[2] * m[4]) * r;
+        inv[3] = a1 * r;
+        inv[4] = (m[0] * m[8] - m[2] * m[6]) * r;
+        inv[5] = (m[2] * m[3] - m[0] * m[5]) * r;
+        inv[6] = a2 * r;
+        inv[7] = (m[1] * m[6] - m[0] * m[7]) * r;
+        inv[8] = (m[0] * m[4] - m[1] * m[3]) * r;
+      } else {
+        const Elem s0 = m[0] * m[5] - m[4] * m[1];
+        const Elem s1 = m[0] * m[6] - m[4] * m[2];
+        const Elem s2 = m[0] * m[7] - m[4] * m[3];
+        const Elem s3 = m[1] * m[6] - m[5] * m[2];
+        const Elem s4 = m[1] * m[7] - m[5] * m[3];
+        const Elem s5 = m[2] * m[7] - m[6] * m[3];
+        const Elem c5 = m[10] * m[15] - m[14] * m[11];
+        const Elem c4 = m[9] * m[15] - m[13] * m[11];
+        const Elem c3 = m[9] * m[14] - m[13] * m[10];
+        const Elem c2 = m[8] * m[15] - m[12] * m[11];
+        const Elem c1 = m[8] * m[14] - m[12] * m[10];
+        const Elem c0 = m[8] * m[13] - m[12] * m[9];
+        const Elem det = s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1
+          + s5 * c0;
+        if (det == Elem(0)) {
+          return false;
+        }
+        const Elem r = Elem(1) / det;
+        inv[0] = (m[5] * c5 - m[6] * c4 + m[7] * c3) * r;
+        inv[1] = (-m[1] * c5 + m[2] * c4 - m[3] * c3) * r;
+        inv[2] = (m[13] * s5 - m[14] * s4 + m[15] * s3) * r;
+        inv[3] = (-m[9] * s5 + m[10] * s4 - m[11] * s3) * r;
+        inv[4] = (-m[4] * c5 + m[6] * c2 - m[7] * c1) * r;
+        inv[5] = (m[0] * c5 - m[2] * c2 + m[3] * c1) * r;
+        inv[6] = (-m[12] * s5 + m[14] * s2 - m[15] * s1) * r;
+        inv[7] = (m[8] * s5 - m[10] * s2 + m[11] * s1) * r;
+        inv[8] = (m[4] * c4 - m[5] * c2 + m[7] * c0) * r;
+        inv[9] = (-m[0] * c4 + m[1] * c2 - m[3] * c0) * r;
+        inv[10] = (m[12] * s4 - m[13] * s2 + m[15] * s0) * r;
+        inv[11] = (-m[8] * s4 + m[9] * s2 - m[11] * s0) * r;
+        inv[12] = (-m[4] * c3 + m[5] * c1 - m[6] * c0) * r;
+        inv[13] = (m[0] * c3 - m[1] * c1 + m[2] * c0) * r;
+        inv[14] = (-m[12] * s3 + m[13] * s1 - m[14] * s0) * r;
+        inv[15] = (m[8] * s3 - m[9] * s1 + m[10] * s0) * r;
+      }
+      return true;
+    }
+
+
+    template <typename Mat>
+    constexpr bool kIsSmallFixed = (
+      Mat::kRows == Mat::kCols && Mat::kRows >= 2 && Mat::kRows <= 4
+    );
+
+    template <typename Mat>
+    concept SquareField = (
+      FieldElement<typename Mat::ElemType> && Mat::kIsLeaf
+      && Mat::kRows == Mat::kCols
+    );
+
+    template <typename Mat, typename B>
+    concept RightHandSide = (
+      B::kIsLeaf
+      && std::is_same_v<typename Mat::ElemType, typename B::ElemType>
+      && (Mat::kRows == kDynamic) == (B::kRows == kDynamic)
+      && Mat::kRows == B::kRows
+    );
+  }
+
+
+  // LU decomposition with partial pivoting of a square Matrix / DynMatrix.
+  template <typename Mat>
+    requires linalg::SquareField<Mat>
+  class Lu
+  {
+    using Elem = typename Mat::ElemType;
+
+
+  private:
+    Mat lu_;
+
+    std::vector<std::size_t> piv_;
+
+    int sign_;
+
+
+  public:
+    explicit Lu(const Mat& a)
+    : Lu(expr::Copy(a))
+    {
+    }
+
+    // Factors `a` in its own storage.
+    explicit Lu(Mat&& a)
+    : lu_(std::move(a)), piv_(lu_.rows())
+    {
+      expr::CheckShape(lu_.rows() == lu_.cols());
+      sign_ = linalg::LuFactor(
+        lu_.data(), lu_.rows(), lu_.cols(), piv_.data()
+      );
+    }
+
+    ~Lu() = default;
+
+    Lu(const Lu& rh) = delete;
+
+    Lu(Lu&& rh) = default;
+
+    Lu& operator=(const Lu& rh) = delete;
+
+    Lu& operator=(Lu&& rh) = default;
+
+
+    const Mat& get_lu() const noexcept
+    {
+      return lu_;
+    }
+
+    const std::vector<std::size_t>& get_pivots() const noexcept
+    {
+      return piv_;
+    }
+
+
+    bool is_singular() const noexcept
+    {
+      for (std::size_t i = 0; i < lu_.rows(); ++i) {
+        if (lu_.cgetf(i, i) == Elem(0)) {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    Elem determinant() const noexcept
+    {
+      Elem det = Elem(sign_);
+      for (std::size_t i = 0; i < lu_.rows(); ++i) {
+        det *= lu_.cgetf(i, i);
+      }
+      return det;
+    }
+
+    template <typename B>
+      requires linalg::RightHandSide<Mat, B>
+    B solve(const B& b) const
+    {
+      expr::CheckShape(b.rows() == lu_.rows());
+      if (is_singular()) {
+        throw std::domain_error("Matrix is singular");
+      }
+      B x = expr::Copy(b);
+      linalg::LuSolve(
+        lu_.data(), lu_.rows(), lu_.cols(), piv_.data(),
+        x.data(), x.cols(), x.cols()
+      );
+      return x;
+    }
+
+    Mat inverse() const
+    {
+      const std::size_t n = lu_.rows();
+      Mat inv = expr::MakePlain<Mat>(n, n);
+      std::fill_n(inv.data(), n * n, Elem(0));
+      for (std::size_t i = 0; i < n; ++i) {
+        inv.getf(i, i) = Elem(1);
+      }
+      if (is_singular()) {
+        throw std::domain_error("Matrix is singular");
+      }
+      linalg::LuSolve(lu_.data(), n, n, piv_.data(), inv.data(), n, n);
+      return inv;
+    }
+  };
+
+
+  // Cholesky decomposition A = L L^H of a Hermitian positive-definite
+  // Matrix / DynMatrix.  Throws std::domain_error otherwise.
+  template <typename Mat>
+    requires linalg::SquareField<Mat>
+  class Cholesky
+  {
+    using Elem = typename Mat::ElemType;
+
+
+  private:
+    Mat l_;
+
+
+  public:
+    explicit Cholesky(const Mat& a)
+    : Cholesky(expr::Copy(a))
+    {
+    }
+
+    // Factors `a` in its own storage.
+    explicit Cholesky(Mat&& a)
+    : l_(std::move(a))
+    {
+      expr::CheckShape(l_.rows() == l_.cols());
+      linalg::CholeskyFactor(l_.data(), l_.rows(), l_.cols());
+    }
+
+    ~Cholesky() = default;
+
+    Cholesky(const Cholesky& rh) = delete;
+
+    Cholesky(Cholesky&& rh) = default;
+
+    Cholesky& operator=(const Cholesky& rh) = delete;
+
+    Cholesky& operator=(Cholesky&& rh) = default;
+
+
+    const Mat& get_l() const noexcept
+    {
+      return l_;
+    }
+
+
+    Elem determinant() const noexcept
+    {
+      Elem det = Elem(1);
+      for (std::size_t i = 0; i < l_.rows(); ++i) {
+        det *= l_.cgetf(i, i) * l_.cgetf(i, i);
+      }
+      return det;
+    }
+
+    template <typename B>
+      requires linalg::RightHandSide<Mat, B>
+    B solve(const B& b) const
+    {
+      expr::CheckShape(b.rows() == l_.rows());
+      B x = expr::Copy(b);
+      linalg::CholeskySolve(
+        l_.data(), l_.rows(), l_.cols(), x.data(), x.cols(), x.cols()
+      );
+      return x;
+    }
+
+    Mat inverse() const
+    {
+      const std::size_t n = l_.rows();
+      Mat inv = expr::MakePlain<Mat>(n, n);
+      std::fill_n(inv.data(), n * n, Elem(0));
+      for (std::size_t i = 0; i < n; ++i) {
+        inv.getf(i, i) = Elem(1);
+      }
+      linalg::CholeskySolve(l_.data(), n, n, inv.data(), n, n);
+      return inv;
+    }
+  };
+
+
+  // Householder QR of an m x n (m >= n) Matrix / DynMatrix.  `solve`
+  // returns the least-squares solution for overdetermined systems.
+  template <typename Mat>
+    requires linalg::FieldElement<typename Mat::ElemType> && Mat::kIsLeaf
+  class Qr
+  {
+    using Elem = typename Mat::ElemType;
+
+
+  private:
+    Mat qr_;
+
+    std::vector<Elem> tau_;
+
+
+  public:
+    explicit Qr(const Mat& a)
+    : Qr(expr::Copy(a))
+    {
+    }
+
+    // Factors `a` in its own storage.
+    explicit Qr(Mat&& a)
+    : qr_(std::move(a)), tau_(qr_.cols())
+    {
+      expr::CheckShape(qr_.rows() >= qr_.cols());
+      linalg::QrFactor(
+        qr_.data(), qr_.rows(), qr_.cols(), qr_.cols(), tau_.data()
+      );
+    }
+
+    ~Qr() = default;
+
+    Qr(const Qr& rh) = delete;
+
+    Qr(Qr&& rh) = default;
+
+    Qr& operator=(const Qr& rh) = delete;
+
+    Qr& operator=(Qr&& rh) = default;
+
+
+    const Mat& get_qr() const noexcept
+    {
+      return qr_;
+    }
+
+    const std::vector<Elem>& get_tau() const noexcept
+    {
+      return tau_;
+    }
+
+
+    template <typename B>
+      requires linalg::RightHandSide<Mat, B>
+    auto solve(const B& b) const
+    {
+      using X = typename B::template Resized<Mat::kCols, B::kCols>;
+
+      const std::size_t m = qr_.rows();
+      const std::size_t n = qr_.cols();
+      const std::size_t nrhs = b.cols();
+      expr::CheckShape(b.rows() == m);
+      for (std::size_t i = 0; i < n; ++i) {
+        if (qr_.cgetf(i, i) == Elem(0)) {
+          throw std::domain_error("Matrix is rank deficient");
+        }
+      }
+
+      B qb = expr::Copy(b);
+      linalg::QrApplyQh(
+        qr_.data(), m, n, n, tau_.data(), qb.data(), nrhs, nrhs
+      );
+
+      X x = expr::MakePlain<X>(n, nrhs);
+      for (std::size_t i = n; i-- > 0;) {
+        for (std::size_t c = 0; c < nrhs; ++c) {
+          Elem val = qb.cgetf(i, c);
+          for (std::size_t k = i + 1; k < n; ++k) {
+            val -= qr_.cgetf(i, k) * x.cgetf(k, c);
+          }
+          x.getf(i, c) = val / qr_.cgetf(i, i);
+        }
+      }
+      return x;
+    }
+  };
+
+
+  template <typename Mat>
+    requires linalg::SquareField<Mat>
+  typename Mat::ElemType Determinant(const Mat& a)
+  {
+    if constexpr (linalg::kIsSmallFixed<Mat>) {
+      return linalg::SmallDeterminant<Mat::kRows>(a.data());
+    } else {
+      return Lu<Mat>(a).determinant();
+    }
+  }
+
+
+  template <typename Mat>
+    requires linalg::SquareField<Mat>
+  Mat Inverse(const Mat& a)
+  {
+    if constexpr (linalg::kIsSmallFixed<Mat>) {
+      Mat inv(kUninitialized);
+      if (!linalg::SmallInverse<Mat::kRows>(a.data(), inv.data())) {
+        throw std::domain_error("Matrix is singular");
+      }
+      return inv;
+    } else {
+      return Lu<Mat>(a).inverse();
+    }
+  }
+
+
+  // Solves A X = B.
+  template <typename Mat, typename B>
+    requires linalg::SquareField<Mat> && linalg::RightHandSide<Mat, B>
+  B Solve(const Mat& a, const B& b)
+  {
+    if constexpr (linalg::kIsSmallFixed<Mat>) {
+      const Mat inv = Inverse(a);
+      return inv * b;
+    } else {
+      return Lu<Mat>(a).solve(b);
+    }
+  }
+}
+
+
+
+#endif // CXXDECOMPOSITION_H
@@ -0,0 +1,309 @@
+#ifndef CXXDYNMATRIX_H
+#define CXXDYNMATRIX_H
+
+#include <algorithm>
+#include <cstddef>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include "AlignedAllocator.h"
+#include "Matrix.h"
+#include "MatrixExpr.h"
+
+
+
+namespace csp::math
+{
+  // Runtime-sized counterpart of Matrix, stored row-major on the heap with
+  // 64-byte alignment.  Copies are explicit (`Clone`), moves only transfer
+  // the buffer.
+  template <MatrixElement Elem>
+  class DynMatrix : public MatrixExprTag
+  {
+    using Mat = DynMatrix<Elem>;
+
+
+  public:
+    using ElemType = Elem;
+
+    using PlainType = Mat;
+
+    template <std::size_t kRow2, std::size_t kCol2>
+    using Resized = Mat;
+
+
+    static constexpr std::size_t kRows = kDynamic;
+
+    static constexpr std::size_t kCols = kDynamic;
+
+    static constexpr bool kIsLeaf = true;
+
+    static constexpr bool kLazyProduct = false;
+
+
+  private:
+    std::size_t rows_;
+
+    std::size_t cols_;
+
+    std::vector<Elem, AlignedAllocator<Elem>> arr_;
+
+
+  public:
+    DynMatrix() noexcept
+    : rows_(0), cols_(0)
+    {
+    }
+
+    DynMatrix(const std::size_t rows, const std::size_t cols)
+    : DynMatrix(rows, cols, Elem(0))
+    {
+    }
+
+    DynMatrix(const std::size_t rows, const std::size_t cols, const Elem elem)
+    : rows_(rows), cols_(cols), arr_(rows * cols, elem)
+    {
+    }
+
+    // Storage is left for the caller to overwrite.
+    DynMatrix(const std::size_t rows, const std::size_t cols, Uninitialized)
+    : rows_(rows), cols_(cols), arr_(rows * cols)
+    {
+    }
+
+    template <std::size_t kRow, std::size_t kCol>
+    explicit DynMatrix(const Matrix<Elem, kRow, kCol>& mat)
+    : DynMatrix(kRow, kCol, kUninitialized)
+    {
+      std::copy_n(mat.data(), kRow * kCol, arr_.data());
+    }
+
+    template <MatrixExpression E>
+      requires (!std::is_same_v<expr::Bare<E>, Mat>)
+        && expr::SameShape<E, Mat>
+    DynMatrix(const E& e)
+    : DynMatrix(e.rows(), e.cols(), kUninitialized)
+    {
+      expr::Assign(arr_.data(), e);
+    }
+
+    // Element-wise conversion from another precision, e.g. double to float.
+    template <MatrixElement Other>
+      requires (!std::is_same_v<Other, Elem>)
+        && std::is_constructible_v<Elem, Other>
+    explicit DynMatrix(const DynMatrix<Other>& rh)
+    : DynMatrix(rh.rows(), rh.cols(), kUninitialized)
+    {
+      for (std::size_t i = 0; i < arr_.size(); ++i) {
+        arr_[i] = static_cast<Elem>(rh.cgetf(i));
+      }
+    }
+
+    ~DynMatrix() = default;
+
+    DynMatrix(const Mat& rh) = delete;
+
+    DynMatrix(Mat&& rh) noexcept
+    : rows_(rh.rows_), cols_(rh.cols_), arr_(std::move(rh.arr_))
+    {
+      rh.rows_ = 0;
+      rh.cols_ = 0;
+    }
+
+    DynMatrix& operator=(const Mat& rh) = delete;
+
+    DynMatrix& operator=(Mat&& rh) noexcept
+    {
+      rows_ = rh.rows_;
+      cols_ = rh.cols_;
+      arr_ = std::move(rh.arr_);
+      rh.rows_ = 0;
+      rh.cols_ = 0;
+      return *this;
+    }
+
+    template <MatrixExpression E>
+      requires (!std::is_same_v<expr::Bare<E>, Mat>)
+        && expr::SameShape<E, Mat>
+    DynMatrix& operator=(const E& e)
+    {
+      if (
+        (E::kLazyProduct && e.Aliases(arr_.data()))
+        || e.rows() != rows_ || e.cols() != cols_
+      ) {
+        *this = Mat(e);
+      } else {
+        expr::Assign(arr_.data(), e);
+      }
+      return *this;
+    }
+
+
+    Elem& get(const std::size_t i)
+    {
+      return arr_.at(i);
+    }
+
+    Elem cget(const std::size_t i) const
+    {
+      return arr_.at(i);
+    }
+
+    Elem& get(const std::size_t row, const std::size_t col)
+    {
+      if (row >= rows_ || col >= cols_) {
+        throw std::out_of_range("DynMatrix index out of range");
+      }
+      return arr_[row * cols_ + col];
+    }
+
+    Elem cget(const std::size_t row, const std::size_t col) const
+    {
+      if (row >= rows_ || col >= cols_) {
+        throw std::out_of_range("DynMatrix index out of range");
+      }
+      return arr_[row * cols_ + col];
+    }
+
+    Elem& getf(const std::size_t i) noexcept
+    {
+      return arr_[i];
+    }
+
+    Elem cgetf(const std::size_t i) const noexcept
+    {
+      return arr_[i];
+    }
+
+    Elem& getf(const std::size_t row, const std::size_t col) noexcept
+    {
+      return arr_[row * cols_ + col];
+    }
+
+    Elem cgetf(const std::size_t row, const std::size_t col) const noexcept
+    {
+      return arr_[row * cols_ + col];
+    }
+
+    Elem* data() noexcept
+    {
+      return arr_.data();
+    }
+
+    const Elem* data() const noexcept
+    {
+      return arr_.data();
+    }
+
+    std::size_t rows() const noexcept
+    {
+      return rows_;
+    }
+
+    std::size_t cols() const noexcept
+    {
+      return cols_;
+    }
+
+    std::size_t size() const noexcept
+    {
+      return arr_.size();
+    }
+
+    bool Aliases(const void* ptr) const noexcept
+    {
+      return arr_.data() == ptr;
+    }
+
+
+    void operator+=(const Elem rh)
+    {
+      expr::CheckShape(rows_ == cols_);
+      for (std::size_t i = 0; i < rows_; ++i) {
+        getf(i, i) += rh;
+      }
+    }
+
+    template <MatrixExpression E>
+      requires expr::SameShape<E, Mat>
+    void operator+=(const E& rh)
+    {
+      expr::CheckSameShape(*this, rh);
+      if constexpr (E::kLazyProduct) {
+        if (rh.Aliases(arr_.data())) {
+          *this += Mat(rh);
+          return;
+        }
+      }
+      expr::AddTo(arr_.data(), rh, Elem(1));
+    }
+
+    void operator-=(const Elem rh)
+    {
+      expr::CheckShape(rows_ == cols_);
+      for (std::size_t i = 0; i < rows_; ++i) {
+        getf(i, i) -= rh;
+      }
+    }
+
+    template <MatrixExpression E>
+      requires expr::SameShape<E, Mat>
+    void operator-=(const E& rh)
+    {
+      expr::CheckSameShape(*this, rh);
+      if constexpr (E::kLazyProduct) {
+        if (rh.Aliases(arr_.data())) {
+          *this -= Mat(rh);
+          return;
+        }
+      }
+      expr::AddTo(arr_.data(), rh, Elem(-1));
+    }
+
+    void operator*=(const Elem rh) noexcept
+    {
+      for (Elem& elem : arr_) {
+        elem *= rh;
+      }
+    }
+
+
+    Mat Clone() const
+    {
+      Mat mat(rows_, cols_, kUninitialized);
+      std::copy(arr_.begin(), arr_.end(), mat.arr_.begin());
+      return mat;
+    }
+
+    template <std::size_t kRow, std::size_t kCol>
+    Matrix<Elem, kRow, kCol> ToMatrix() const
+    {
+      expr::CheckShape(rows_ == kRow && cols_ == kCol);
+      Matrix<Elem, kRow, kCol> mat(kUninitialized);
+      std::copy_n(arr_.data(), kRow * kCol, mat.data());
+      return mat;
+    }
+
+    // Summed in expr::Accumulator<Elem>.
+    Elem trace() const
+    {
+      expr::CheckShape(rows_ == cols_);
+      expr::Accumulator<Elem> result = 0;
+      for (std::size_t i = 0; i < rows_; ++i) {
+        result += cgetf(i, i);
+      }
+      return Elem(result);
+    }
+
+    Mat commute(const Mat& rh) const
+    {
+      expr::CheckShape(rows_ == cols_);
+      return (*this) * rh - rh * (*this);
+    }
+  };
+}
+
+
+
+#endif // CXXDYNMATRIX_H
@@ -0,0 +1,440 @@
+#ifndef CXXGEMM_H
+#define CXXGEMM_H
+
+#include <algorithm>
+#include <complex>
+#include <cstddef>
+#include <vector>
+
+#include "ThreadPool.h"
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+
+
+namespace csp::math::gemm
+{
+  // Row-major, packed, register-tiled GEMM in the GotoBLAS layout.
+  // B is packed into kKc x kNc slabs of kNr-wide column panels, A into
+  // kMc x kKc blocks of kMr-tall row panels, and every micro tile is
+  // computed in registers before being added to C.
+
+
+  template <typename Elem>
+  struct KernelShape
+  {
+    static constexpr std::size_t kMr = 4;
+    static constexpr std::size_t kNr = 4;
+  };
+
+#if defined(__AVX512F__)
+  template <>
+  struct KernelShape<double>
+  {
+    static constexpr std::size_t kMr = 4;
+    static constexpr std::size_t kNr = 16;
+  };
+
+  template <>
+  struct KernelShape<float>
+  {
+    static constexpr std::size_t kMr = 4;
+    static constexpr std::size_t kNr = 32;
+  };
+#elif defined(__AVX2__) && defined(__FMA__)
+  template <>
+  struct KernelShape<double>
+  {
+    static constexpr std::size_t kMr = 4;
+    static constexpr std::size_t kNr = 8;
+  };
+
+  template <>
+  struct KernelShape<float>
+  {
+    static constexpr std::size_t kMr = 4;
+    static constexpr std::size_t kNr = 16;
+  };
+#endif
+
+
+  inline constexpr std::size_t kKc = 256;
+
+  inline constexpr std::size_t kMc = 96;
+
+  inline constexpr std::size_t kNc = 2048;
+
+  // Products with fewer multiply-adds than this use the plain loop.
+  inline constexpr std::size_t kBlockedThreshold = 16 * 16 * 16;
+
+  // Products with at least this many multiply-adds are split into tiles of
+  // kTileRows x kTileCols over the global thread pool, when one is set.
+  inline constexpr std::size_t kParallelThreshold = 128 * 128 * 128;
+
+  inline constexpr std::size_t kTileRows = 48;
+
+  inline constexpr std::size_t kTileCols = 256;
+
+
+  template <typename Elem>
+  constexpr void MulAdd(Elem& acc, const Elem a, const Elem b) noexcept
+  {
+    acc += a * b;
+  }
+
+  // std::complex::operator* is required to handle NaN/Inf, which keeps the
+  // compiler from vectorizing it.  Inside the kernel the plain formula is
+  // enough.
+  template <typename T>
+  constexpr void MulAdd(
+    std::complex<T>& acc, const std::complex<T> a, const std::complex<T> b
+  ) noexcept
+  {
+    acc = {
+      acc.real() + a.real() * b.real() - a.imag() * b.imag(),
+      acc.imag() + a.real() * b.imag() + a.imag() * b.real()
+    };
+  }
+
+
+  template <typename Elem>
+  void MicroKernel(
+    const std::size_t kc, const Elem* a, const Elem* b, Elem* tile
+  ) noexcept
+  {
+    constexpr std::size_t kMr = KernelShape<Elem>::kMr;
+    constexpr std::size_t kNr = KernelShape<Elem>::kNr;
+
+    Elem acc[kMr][kNr] = {};
+    for (std::size_t p = 0; p < kc; ++p) {
+      for (std::size_t i = 0; i < kMr; ++i) {
+        for (std::size_t j = 0; j < kNr; ++j) {
+          MulAdd(acc[i][j], a[i], b[j]);
+        }
+      }
+      a += kMr;
+      b += kNr;
+    }
+
+    for (std::size_t i = 0; i < kMr; ++i) {
+      for (std::size_t j = 0; j < kNr; ++j) {
+        tile[i * kNr + j] = acc[i][j];
+      }
+    }
+  }
+
+#if defined(__AVX512F__)
+  inline void MicroKernel(
+    const std::size_t kc, const double* a, const double* b, double* tile
+  ) noexcept
+  {
+    __m512d c[4][2];
+    for (auto& row : c) {
+      row[0] = _mm512_setzero_pd();
+      row[1] = _mm512_setzero_pd();
+    }
+    for (std::size_t p = 0; p < kc; ++p) {
+      const __m512d b0 = _mm512_loadu_pd(b);
+      const __m512d b1 = _mm512_loadu_pd(b + 8);
+      for (std::size_t i = 0; i < 4; ++i) {
+        const __m512d ai = _mm512_set1_pd(a[i]);
+        c[i][0] = _mm512_fmadd_pd(ai, b0, c[i][0]);
+        c[i][1] = _mm512_fmadd_pd(ai, b1, c[i][1]);
+      }
+      a += 4;
+      b += 16;
+    }
+    for (std::size_t i = 0; i < 4; ++i) {
+      _mm512_storeu_pd(tile + i * 16, c[i][0]);
+      _mm512_storeu_pd(tile + i * 16 + 8, c[i][1]);
+    }
+  }
+
+  inline void MicroKernel(
+    const std::size_t kc, const float* a, const float* b, float* tile
+  ) noexcept
+  {
+    __m512 c[4][2];
+    for (auto& row : c) {
+      row[0] = _mm512_setzero_ps();
+      row[1] = _mm512_setzero_ps();
+    }
+    for (std::size_t p = 0; p < kc; ++p) {
+      const __m512 b0 = _mm512_loadu_ps(b);
+      const __m512 b1 = _mm512_loadu_ps(b + 16);
+      for (std::size_t i = 0; i < 4; ++i) {
+        const __m512 ai = _mm512_set1_ps(a[i]);
+        c[i][0] = _mm512_fmadd_ps(ai, b0, c[i][0]);
+        c[i][1] = _mm512_fmadd_ps(ai, b1, c[i][1]);
+      }
+      a += 4;
+      b += 32;
+    }
+    for (std::size_t i = 0; i < 4; ++i) {
+      _mm512_storeu_ps(tile + i * 32, c[i][0]);
+      _mm512_storeu_ps(tile + i * 32 + 16, c[i][1]);
+    }
+  }
+#elif defined(__AVX2__) && defined(__FMA__)
+  inline void MicroKernel(
+    const std::size_t kc, const double* a, const double* b, double* tile
+  ) noexcept
+  {
+    __m256d c[4][2];
+    for (auto& row : c) {
+      row[0] = _mm256_setzero_pd();
+      row[1] = _mm256_setzero_pd();
+    }
+    for (std::size_t p = 0; p < kc; ++p) {
+      const __m256d b0 = _mm256_loadu_pd(b);
+      const __m256d b1 = _mm256_loadu_pd(b + 4);
+      for (std::size_t i = 0; i < 4; ++i) {
+        const __m256d ai = _mm256_broadcast_sd(a + i);
+        c[i][0] = _mm256_fmadd_pd(ai, b0, c[i][0]);
+        c[i][1] = _mm256_fmadd_pd(ai, b1, c[i][1]);
+      }
+      a += 4;
+      b += 8;
+    }
+    for (std::size_t i = 0; i < 4; ++i) {
+      _mm256_storeu_pd(tile + i * 8, c[i][0]);
+      _mm256_storeu_pd(tile + i * 8 + 4, c[i][1]);
+    }
+  }
+
+  inline void MicroKernel(
+    const std::size_t kc, const float* a, const float* b, float* tile
+  ) noexcept
+  {
+    __m256 c[4][2];
+    for (auto& row : c) {
+      row[0] = _mm256_setzero_ps();
+      row[1] = _mm256_setzero_ps();
+    }
+    for (std::size_t p = 0; p < kc; ++p) {
+      const __m256 b0 = _mm256_loadu_ps(b);
+      const __m256 b1 = _mm256_loadu_ps(b + 8);
+      for (std::size_t i = 0; i < 4; ++i) {
+        const __m256 ai = _mm256_broadcast_ss(a + i);
+        c[i][0] = _mm256_fmadd_ps(ai, b0, c[i][0]);
+        c[i][1] = _mm256_fmadd_ps(ai, b1, c[i][1]);
+      }
+      a += 4;
+      b += 16;
+    }
+    for (std::size_t i = 0; i < 4; ++i) {
+      _mm256_storeu_ps(tile + i * 16, c[i][0]);
+      _mm256_storeu_ps(tile + i * 16 + 8, c[i][1]);
+    }
+  }
+#endif
+
+
+  // Panels are converted to Elem while packing, so a narrower source type
+  // is widened once per element.
+  template <typename Elem, typename Src>
+  void PackA(
+    const std::size_t mc, const std::size_t kc,
+    const Src* a, const std::size_t lda, Elem* packed
+  ) noexcept
+  {
+    constexpr std::size_t kMr = KernelShape<Elem>::kMr;
+
+    for (std::size_t i0 = 0; i0 < mc; i0 += kMr) {
+      const std::size_t mr = std::min(kMr, mc - i0);
+      for (std::size_t p = 0; p < kc; ++p) {
+        for (std::size_t i = 0; i < mr; ++i) {
+          packed[i] = Elem(a[(i0 + i) * lda + p]);
+        }
+        for (std::size_t i = mr; i < kMr; ++i) {
+          packed[i] = Elem(0);
+        }
+        packed += kMr;
+      }
+    }
+  }
+
+  template <typename Elem, typename Src>
+  void PackB(
+    const std::size_t kc, const std::size_t nc,
+    const Src* b, const std::size_t ldb, Elem* packed
+  ) noexcept
+  {
+    constexpr std::size_t kNr = KernelShape<Elem>::kNr;
+
+    for (std::size_t j0 = 0; j0 < nc; j0 += kNr) {
+      const std::size_t nr = std::min(kNr, nc - j0);
+      for (std::size_t p = 0; p < kc; ++p) {
+        const Src* src = b + p * ldb + j0;
+        for (std::size_t j = 0; j < nr; ++j) {
+          packed[j] = Elem(src[j]);
+        }
+        for (std::size_t j = nr; j < kNr; ++j) {
+          packed[j] = Elem(0);
+        }
+        packed += kNr;
+      }
+    }
+  }
+
+
+  // C[m x n] += alpha * A[m x k] * B[k x n], all row-major.
+  template <typename Elem, typename Src = Elem>
+  void MultiplySmall(
+    const std::size_t m, const std::size_t n, const std::size_t k,
+    const Elem alpha,
+    const Src* a, const std::size_t lda,
+    const Src* b, const std::size_t ldb,
+    Elem* c, const std::size_t ldc
+  ) noexcept
+  {
+    for (std::size_t i = 0; i < m; ++i) {
+      Elem* c_row = c + i * ldc;
+      for (std::size_t p = 0; p < k; ++p) {
+        const Elem a_ip = alpha * Elem(a[i * lda + p]);
+        const Src* b_row = b + p * ldb;
+        for (std::size_t j = 0; j < n; ++j) {
+          MulAdd(c_row[j], a_ip, Elem(b_row[j]));
+        }
+      }
+    }
+  }
+
+
+  // C[m x n] += alpha * A[m x k] * B[k x n], all row-major.
+  template <typename Elem, typename Src = Elem>
+  void MultiplyBlocked(
+    const std::size_t m, const std::size_t n, const std::size_t k,
+    const Elem alpha,
+    const Src* a, const std::size_t lda,
+    const Src* b, const std::size_t ldb,
+    Elem* c, const std::size_t ldc
+  )
+  {
+    constexpr std::size_t kMr = KernelShape<Elem>::kMr;
+    constexpr std::size_t kNr = KernelShape<Elem>::kNr;
+
+    static thread_local std::vector<Elem> a_buf;
+    static thread_local std::vector<Elem> b_buf;
+    a_buf.resize(kMc * kKc);
+    b_buf.resize(kKc * ((std::min(kNc, n) + kNr - 1) / kNr * kNr));
+
+    Elem tile[kMr * kNr];
+
+    for (std::size_t jc = 0; jc < n; jc += kNc) {
+      const std::size_t nc = std::min(kNc, n - jc);
+
+      for (std::size_t pc = 0; pc < k; pc += kKc) {
+        const std::size_t kc = std::min(kKc, k - pc);
+        PackB(kc, nc, b + pc * ldb + jc, ldb, b_buf.data());
+
+        for (std::size_t ic = 0; ic < m; ic += kMc) {
+          const std::size_t mc = std::min(kMc, m - ic);
+          PackA(mc, kc, a + ic * lda + pc, lda, a_buf.data());
+
+          for (std::size_t jr = 0; jr < nc; jr += kNr) {
+            const std::size_t nr = std::min(kNr, nc - jr);
+            const Elem* b_panel = b_buf.data() + jr * kc;
+
+            for (std::size_t ir = 0; ir < mc; ir += kMr) {
+              const std::size_t mr = std::min(kMr, mc - ir);
+              MicroKernel(kc, a_buf.data() + ir * kc, b_panel, tile);
+
+              Elem* c_tile = c + (ic + ir) * ldc + jc + jr;
+              for (std::size_t i = 0; i < mr; ++i) {
+                for (std::size_t j = 0; j < nr; ++j) {
+                  MulAdd(c_tile[i * ldc + j], alpha, tile[i * kNr + j]);
+                }
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+
+
+  // C[m x n] += alpha * A[m x k] * B[k x n], all row-major.
+  // Every tile of C is owned by exactly one task, which packs its own
+  // panels into thread-local buffers.
+  template <typename Elem, typename Src = Elem>
+  void MultiplyParallel(
+    utils::ThreadPool& pool,
+    const std::size_t m, const std::size_t n, const std::size_t k,
+    const Elem alpha,
+    const Src* a, const std::size_t lda,
+    const Src* b, const std::size_t ldb,
+    Elem* c, const std::size_t ldc
+  )
+  {
+    const std::size_t tile_rows = (m + kTileRows - 1) / kTileRows;
+    const std::size_t tile_cols = (n + kTileCols - 1) / kTileCols;
+
+    pool.ParallelFor(0, tile_rows * tile_cols, 1,
+      [=](const std::size_t lo, const std::size_t hi) {
+        for (std::size_t tile = lo; tile < hi; ++tile) {
+          const std::size_t i0 = tile / tile_cols * kTileRows;
+          const std::size_t j0 = tile % tile_cols * kTileCols;
+          MultiplyBlocked(
+            std::min(kTileRows, m - i0), std::min(kTileCols, n - j0), k,
+            alpha, a + i0 * lda, lda, b + j0, ldb, c + i0 * ldc + j0, ldc
+          );
+        }
+      }
+    );
+  }
+
+
+  // C[m x n] += alpha * A[m x k] * B[k x n], all row-major.  A and B may
+  // be stored in a type Src narrower than Elem.
+  template <typename Elem, typename Src = Elem>
+  void Multiply(
+    const std::size_t m, const std::size_t n, const std::size_t k,
+    const Elem alpha,
+    const Src* a, const std::size_t lda,
+    const Src* b, const std::size_t ldb,
+    Elem* c, const std::size_t ldc
+  )
+  {
+    const std::size_t work = m * n * k;
+    if (work < kBlockedThreshold) {
+      MultiplySmall(m, n, k, alpha, a, lda, b, ldb, c, ldc);
+    } else if (
+      utils::ThreadPool* const pool = utils::GlobalThreadPool();
+      pool != nullptr && work >= kParallelThreshold
+    ) {
+      MultiplyParallel(*pool, m, n, k, alpha, a, lda, b, ldb, c, ldc);
+    } else {
+      MultiplyBlocked(m, n, k, alpha, a, lda, b, ldb, c, ldc);
+    }
+  }
+
+
+  // C[m x n] += alpha * A[m x k] * B[k x n] for operands stored as Elem,
+  // with every product and sum carried out in the wider type Acc.  C is
+  // rounded back to Elem once, at the end.
+  template <typename Acc, typename Elem>
+  void MultiplyWidened(
+    const std::size_t m, const std::size_t n, const std::size_t k,
+    const Elem alpha,
+    const Elem* a, const std::size_t lda,
+    const Elem* b, const std::size_t ldb,
+    Elem* c, const std::size_t ldc
+  )
+  {
+    static thread_local std::vector<Acc> acc;
+    acc.assign(m * n, Acc(0));
+    Multiply(m, n, k, Acc(alpha), a, lda, b, ldb, acc.data(), n);
+    for (std::size_t i = 0; i < m; ++i) {
+      for (std::size_t j = 0; j < n; ++j) {
+        c[i * ldc + j] += Elem(acc[i * n + j]);
+      }
+    }
+  }
+}
+
+
+
+#endif // CXXGEMM_H
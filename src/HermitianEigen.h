@@ -0,0 +1,371 @@
+#ifndef CXXHERMITIANEIGEN_H
+#define CXXHERMITIANEIGEN_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+#include "Decomposition.h"
+#include "MatrixExpr.h"
+#include "ThreadPool.h"
+
+
+
+namespace csp::math
+{
+  // Eigen-decomposition of Hermitian (or real symmetric) n x n matrices.
+  //
+  // The matrix is reduced to a real symmetric tridiagonal T = Q^H A Q by
+  // Householder reflections, then T is diagonalized by the implicit QL
+  // algorithm with Wilkinson shifts, rotating Q into the eigenvectors.
+  // All buffers are sized once for n, so Compute does not allocate.
+  template <linalg::FieldElement Elem>
+  class HermitianEigenSolver
+  {
+    using Real = decltype(linalg::RealPart(Elem()));
+
+
+  public:
+    static constexpr int kMaxIterations = 60;
+
+
+  private:
+    std::size_t n_;
+
+    std::vector<Elem> work_;
+
+    std::vector<Elem> vectors_;
+
+    std::vector<Real> values_;
+
+    std::vector<Real> off_diag_;
+
+    std::vector<Elem> v_;
+
+    std::vector<Elem> w_;
+
+    // Workspaces of ComputeBatch's parallel chunks, one per chunk, made on
+    // the first parallel call and reused after it.
+    std::vector<HermitianEigenSolver> batch_solvers_;
+
+
+    // Reduces work_ to tridiagonal form.  With `with_vectors`, vectors_
+    // receives Q.
+    void Tridiagonalize(const bool with_vectors) noexcept
+    {
+      const std::size_t n = n_;
+      Elem* a = work_.data();
+      Elem* q = vectors_.data();
+
+      if (with_vectors) {
+        std::fill(vectors_.begin(), vectors_.end(), Elem(0));
+        for (std::size_t i = 0; i < n; ++i) {
+          q[i * n + i] = Elem(1);
+        }
+      }
+
+      for (std::size_t k = 0; k + 1 < n; ++k) {
+        values_[k] = linalg::RealPart(a[k * n + k]);
+
+        const std::size_t k1 = k + 1;
+        const std::size_t m = n - k1;
+        const Elem alpha = a[k1 * n + k];
+        Real tail = 0;
+        for (std::size_t i = 1; i < m; ++i) {
+          tail += linalg::Abs2(a[(k1 + i) * n + k]);
+        }
+
+        if (
+          tail == Real(0)
+          && linalg::Abs2(alpha) == linalg::Abs2(linalg::RealPart(alpha))
+        ) {
+          off_diag_[k] = linalg::RealPart(alpha);
+          continue;
+        }
+
+        const Real norm = std::sqrt(linalg::Abs2(alpha) + tail);
+        const Real beta = linalg::RealPart(alpha) >= Real(0) ? -norm : norm;
+        const Elem tau = (Elem(beta) - alpha) / Elem(beta);
+        const Elem scale = Elem(1) / (alpha - Elem(beta));
+        off_diag_[k] = beta;
+
+        v_[0] = Elem(1);
+        for (std::size_t i = 1; i < m; ++i) {
+          v_[i] = a[(k1 + i) * n + k] * scale;
+        }
+
+        // p = tau A22 v,  w = p - tau^* (v^H p) v / 2
+        Elem vp = 0;
+        for (std::size_t i = 0; i < m; ++i) {
+          const Elem* row = a + (k1 + i) * n + k1;
+          Elem sum = 0;
+          for (std::size_t j = 0; j < m; ++j) {
+            sum += row[j] * v_[j];
+          }
+          w_[i] = tau * sum;
+          vp += linalg::Conj(v_[i]) * w_[i];
+        }
+        const Elem half = Real(0.5) * linalg::Conj(tau) * vp;
+        for (std::size_t i = 0; i < m; ++i) {
+          w_[i] -= half * v_[i];
+        }
+
+        // A22 -= v w^H + w v^H
+        for (std::size_t i = 0; i < m; ++i) {
+          Elem* row = a + (k1 + i) * n + k1;
+          const Elem v_i = v_[i];
+          const Elem w_i = w_[i];
+          for (std::size_t j = 0; j < m; ++j) {
+            row[j] -= v_i * linalg::Conj(w_[j]) + w_i * linalg::Conj(v_[j]);
+          }
+        }
+
+        // Q[:, k1:] -= (Q[:, k1:] v) tau v^H
+        if (with_vectors) {
+          for (std::size_t r = 0; r < n; ++r) {
+            Elem* row = q + r * n + k1;
+            Elem sum = 0;
+            for (std::size_t j = 0; j < m; ++j) {
+              sum += row[j] * v_[j];
+            }
+            sum *= tau;
+            for (std::size_t j = 0; j < m; ++j) {
+              row[j] -= sum * linalg::Conj(v_[j]);
+            }
+          }
+        }
+      }
+
+      values_[n - 1] = linalg::RealPart(a[(n - 1) * n + n - 1]);
+      off_diag_[n - 1] = 0;
+    }
+
+    // Implicit QL on (values_, off_diag_), where off_diag_[i] couples i and
+    // i + 1.  Rotations are applied to the columns of vectors_.
+    void Diagonalize(const bool with_vectors)
+    {
+      const std::ptrdiff_t n = static_cast<std::ptrdiff_t>(n_);
+      Real* d = values_.data();
+      Real* e = off_diag_.data();
+      Elem* z = vectors_.data();
+      constexpr Real kEps = std::numeric_limits<Real>::epsilon();
+
+      for (std::ptrdiff_t l = 0; l < n; ++l) {
+        int iteration = 0;
+        std::ptrdiff_t m;
+        do {
+          for (m = l; m < n - 1; ++m) {
+            const Real dd = std::abs(d[m]) + std::abs(d[m + 1]);
+            if (std::abs(e[m]) <= kEps * dd) {
+              break;
+            }
+          }
+          if (m == l) {
+            break;
+          }
+          if (++iteration > kMaxIterations) {
+            throw std::runtime_error("Eigenvalue iteration did not converge");
+          }
+
+          Real g = (d[l + 1] - d[l]) / (Real(2) * e[l]);
+          Real r = std::hypot(g, Real(1));
+          g = d[m] - d[l] + e[l] / (g + std::copysign(r, g));
+          Real s = 1;
+          Real c = 1;
+          Real p = 0;
+          std::ptrdiff_t i;
+          for (i = m - 1; i >= l; --i) {
+            const Real f = s * e[i];
+            const Real b = c * e[i];
+            r = std::hypot(f, g);
+            e[i + 1] = r;
+            if (r == Real(0)) {
+              d[i + 1] -= p;
+              e[m] = 0;
+              break;
+            }
+            s = f / r;
+            c = g / r;
+            g = d[i + 1] - p;
+            r = (d[i] - g) * s + Real(2) * c * b;
+            p = s * r;
+            d[i + 1] = g + p;
+            g = c * r - b;
+
+            if (with_vectors) {
+              for (std::ptrdiff_t k = 0; k < n; ++k) {
+                Elem* row = z + k * n;
+                const Elem z_next = row[i + 1];
+                row[i + 1] = s * row[i] + c * z_next;
+                row[i] = c * row[i] - s * z_next;
+              }
+            }
+          }
+          if (r == Real(0) && i >= l) {
+            continue;
+          }
+          d[l] -= p;
+          e[l] = g;
+          e[m] = 0;
+        } while (m != l);
+      }
+    }
+
+    // Sorts the eigenvalues in ascending order, together with the columns
+    // of vectors_.
+    void Sort(const bool with_vectors) noexcept
+    {
+      const std::size_t n = n_;
+      for (std::size_t i = 0; i + 1 < n; ++i) {
+        std::size_t best = i;
+        for (std::size_t j = i + 1; j < n; ++j) {
+          if (values_[j] < values_[best]) {
+            best = j;
+          }
+        }
+        if (best == i) {
+          continue;
+        }
+        std::swap(values_[i], values_[best]);
+        if (with_vectors) {
+          for (std::size_t r = 0; r < n; ++r) {
+            std::swap(vectors_[r * n + i], vectors_[r * n + best]);
+          }
+        }
+      }
+    }
+
+
+  public:
+    explicit HermitianEigenSolver(const std::size_t n)
+    : n_(n),
+      work_(n * n),
+      vectors_(n * n),
+      values_(n),
+      off_diag_(n),
+      v_(n),
+      w_(n)
+    {
+    }
+
+    ~HermitianEigenSolver() = default;
+
+    HermitianEigenSolver(const HermitianEigenSolver& rh) = default;
+
+    HermitianEigenSolver(HermitianEigenSolver&& rh) = default;
+
+    HermitianEigenSolver& operator=(const HermitianEigenSolver& rh) = default;
+
+    HermitianEigenSolver& operator=(HermitianEigenSolver&& rh) = default;
+
+
+    std::size_t size() const noexcept
+    {
+      return n_;
+    }
+
+    // Eigenvalues in ascending order.
+    std::span<const Real> get_values() const noexcept
+    {
+      return values_;
+    }
+
+    // Row-major n x n matrix whose column j is the eigenvector of
+    // get_values()[j].  Only valid after Compute with `with_vectors`.
+    std::span<const Elem> get_vectors() const noexcept
+    {
+      return vectors_;
+    }
+
+
+    // Decomposes the row-major n x n Hermitian matrix `a`.  Only its lower
+    // triangle is read.
+    void Compute(const Elem* a, const bool with_vectors = true)
+    {
+      const std::size_t n = n_;
+      if (n == 0) {
+        return;
+      }
+      for (std::size_t r = 0; r < n; ++r) {
+        for (std::size_t c = 0; c <= r; ++c) {
+          work_[r * n + c] = a[r * n + c];
+          work_[c * n + r] = linalg::Conj(a[r * n + c]);
+        }
+      }
+
+      Tridiagonalize(with_vectors);
+      Diagonalize(with_vectors);
+      Sort(with_vectors);
+    }
+
+    template <typename Mat>
+      requires std::is_same_v<typename Mat::ElemType, Elem> && Mat::kIsLeaf
+    void Compute(const Mat& a, const bool with_vectors = true)
+    {
+      expr::CheckShape(a.rows() == n_ && a.cols() == n_);
+      Compute(a.data(), with_vectors);
+    }
+
+
+    // Decomposes every matrix of `mats`.  The eigenvalues of mats[i] go to
+    // values[i * n, (i + 1) * n), and when `vectors` is not empty its
+    // eigenvectors to vectors[i * n * n, (i + 1) * n * n).  Runs on the
+    // global thread pool when one is set, in one chunk per thread, each on
+    // a workspace kept by this solver.
+    template <typename Mat>
+      requires std::is_same_v<typename Mat::ElemType, Elem> && Mat::kIsLeaf
+    void ComputeBatch(
+      std::span<const Mat> mats,
+      std::span<Real> values,
+      std::span<Elem> vectors = {}
+    )
+    {
+      const std::size_t n = n_;
+      const bool with_vectors = !vectors.empty();
+      expr::CheckShape(values.size() >= mats.size() * n);
+      expr::CheckShape(!with_vectors || vectors.size() >= mats.size() * n * n);
+
+      const auto run = [&](
+        HermitianEigenSolver& solver, const std::size_t lo, const std::size_t hi
+      ) {
+        for (std::size_t i = lo; i < hi; ++i) {
+          solver.Compute(mats[i], with_vectors);
+          std::copy(
+            solver.values_.begin(), solver.values_.end(), values.begin() + i * n
+          );
+          if (with_vectors) {
+            std::copy(
+              solver.vectors_.begin(), solver.vectors_.end(),
+              vectors.begin() + i * n * n
+            );
+          }
+        }
+      };
+
+      utils::ThreadPool* const pool = utils::GlobalThreadPool();
+      if (pool == nullptr || mats.size() < 2) {
+        run(*this, 0, mats.size());
+        return;
+      }
+      // The pool's workers and the calling thread.
+      const std::size_t chunks = std::min(mats.size(), pool->size() + 1);
+      if (batch_solvers_.size() < chunks) {
+        batch_solvers_.resize(chunks, HermitianEigenSolver(n));
+      }
+      const std::size_t grain = (mats.size() + chunks - 1) / chunks;
+      pool->ParallelFor(0, mats.size(), grain,
+        [&](const std::size_t lo, const std::size_t hi) {
+          run(batch_solvers_[lo / grain], lo, hi);
+        }
+      );
+    }
+  };
+}
+
+
+
+#endif // CXXHERMITIANEIGEN_H
@@ -0,0 +1,336 @@
+#ifndef CXXIMAGE_H
+#define CXXIMAGE_H
+
+#include <bit>
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <ios>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "Color.h"
+#include "Vector3.h"
+
+
+
+namespace csp
+{
+  namespace utils
+  {
+    // Row-major pixel buffer.  Image<Color> is packed RGB8, Image<float>
+    // and Image<math::Vector3<float>> hold grey and RGB float channels.
+    template <typename Pixel>
+    class Image
+    {
+      std::size_t rows_;
+
+      std::size_t cols_;
+
+      std::vector<Pixel> pixels_;
+
+
+      void CheckRow(const std::size_t row) const
+      {
+        if (row >= rows_) {
+          throw std::out_of_range("Image row out of range");
+        }
+      }
+
+      void CheckIndex(const std::size_t row, const std::size_t col) const
+      {
+        if (row >= rows_ || col >= cols_) {
+          throw std::out_of_range("Image index out of range");
+        }
+      }
+
+
+    public:
+      using PixelType = Pixel;
+
+
+      Image()
+      : rows_(0), cols_(0)
+      {
+      }
+
+      Image(const std::size_t rows, const std::size_t cols)
+      : rows_(rows), cols_(cols), pixels_(rows * cols)
+      {
+      }
+
+      Image(const std::size_t rows, const std::size_t cols, const Pixel& fill)
+      : rows_(rows), cols_(cols), pixels_(rows * cols, fill)
+      {
+      }
+
+      ~Image() = default;
+
+      Image(const Image& rh) = default;
+
+      Image(Image&& rh) = default;
+
+      Image& operator=(const Image& rh) = default;
+
+      Image& operator=(Image&& rh) = default;
+
+
+      std::size_t rows() const noexcept
+      {
+        return rows_;
+      }
+
+      std::size_t cols() const noexcept
+      {
+        return cols_;
+      }
+
+      std::size_t size() const noexcept
+      {
+        return pixels_.size();
+      }
+
+      Pixel* data() noexcept
+      {
+        return pixels_.data();
+      }
+
+      const Pixel* data() const noexcept
+      {
+        return pixels_.data();
+      }
+
+      std::span<Pixel> pixels() noexcept
+      {
+        return pixels_;
+      }
+
+      std::span<const Pixel> pixels() const noexcept
+      {
+        return pixels_;
+      }
+
+      std::span<Pixel> row(const std::size_t index)
+      {
+        CheckRow(index);
+        return {pixels_.data() + index * cols_, cols_};
+      }
+
+      std::span<const Pixel> row(const std::size_t index) const
+      {
+        CheckRow(index);
+        return {pixels_.data() + index * cols_, cols_};
+      }
+
+
+      Pixel& get(const std::size_t row, const std::size_t col)
+      {
+        CheckIndex(row, col);
+        return pixels_[row * cols_ + col];
+      }
+
+      Pixel cget(const std::size_t row, const std::size_t col) const
+      {
+        CheckIndex(row, col);
+        return pixels_[row * cols_ + col];
+      }
+
+      Pixel& getf(const std::size_t row, const std::size_t col) noexcept
+      {
+        return pixels_[row * cols_ + col];
+      }
+
+      Pixel cgetf(const std::size_t row, const std::size_t col)
+        const noexcept
+      {
+        return pixels_[row * cols_ + col];
+      }
+    };
+  }
+
+
+  namespace file
+  {
+    namespace detail
+    {
+      // Netpbm header for each pixel type.  Pixels go to disk as their
+      // object representation, so the layouts are pinned here.
+      template <typename Pixel>
+      struct PnmFormat;
+
+      template <>
+      struct PnmFormat<utils::Color>
+      {
+        static_assert(sizeof(utils::Color) == 3);
+        static_assert(std::is_trivially_copyable_v<utils::Color>);
+
+        static constexpr const char* kMagic = "P6";
+
+        static constexpr bool kIsFloat = false;
+      };
+
+      template <>
+      struct PnmFormat<unsigned char>
+      {
+        static constexpr const char* kMagic = "P5";
+
+        static constexpr bool kIsFloat = false;
+      };
+
+      template <>
+      struct PnmFormat<float>
+      {
+        static constexpr const char* kMagic = "Pf";
+
+        static constexpr bool kIsFloat = true;
+      };
+
+      template <>
+      struct PnmFormat<math::Vector3<float>>
+      {
+        static_assert(sizeof(math::Vector3<float>) == 3 * sizeof(float));
+        static_assert(std::is_trivially_copyable_v<math::Vector3<float>>);
+
+        static constexpr const char* kMagic = "PF";
+
+        static constexpr bool kIsFloat = true;
+      };
+    }
+
+
+    // Writes a PPM (Color), PGM (unsigned char) or PFM (float,
+    // Vector3<float>) file one row at a time, top row first, straight from
+    // the caller's pixels: memory stays constant whatever the image size.
+    // PFM stores rows bottom-up, so its rows are placed by seeking.
+    template <typename Pixel>
+    class PnmWriter
+    {
+      using Format = detail::PnmFormat<Pixel>;
+
+
+      std::filesystem::path filepath_;
+
+      std::ofstream ofs_;
+
+      std::size_t rows_;
+
+      std::size_t cols_;
+
+      std::size_t rows_written_;
+
+      std::streamoff header_size_;
+
+
+      void CheckStream() const
+      {
+        if (!ofs_) {
+          throw std::runtime_error(
+            "Error writing file: " + filepath_.string()
+          );
+        }
+      }
+
+
+    public:
+      PnmWriter(
+        const std::filesystem::path& filepath,
+        const std::size_t rows,
+        const std::size_t cols
+      )
+      : filepath_(filepath),
+        ofs_(filepath, std::ios::binary | std::ios::out | std::ios::trunc),
+        rows_(rows), cols_(cols), rows_written_(0)
+      {
+        if (!ofs_) {
+          throw std::runtime_error(
+            "Failed to open file: " + filepath_.string()
+          );
+        }
+
+        std::string header = Format::kMagic;
+        header += '\n' + std::to_string(cols) + ' ' + std::to_string(rows);
+        if constexpr (Format::kIsFloat) {
+          // A negative scale marks little-endian samples.
+          header += std::endian::native == std::endian::little
+            ? "\n-1.0\n" : "\n1.0\n";
+        } else {
+          header += "\n255\n";
+        }
+        ofs_.write(header.data(), header.size());
+        header_size_ = static_cast<std::streamoff>(header.size());
+        CheckStream();
+      }
+
+      ~PnmWriter() = default;
+
+      PnmWriter(const PnmWriter& rh) = delete;
+
+      PnmWriter(PnmWriter&& rh) = default;
+
+      PnmWriter& operator=(const PnmWriter& rh) = delete;
+
+      PnmWriter& operator=(PnmWriter&& rh) = default;
+
+
+      std::size_t rows_written() const noexcept
+      {
+        return rows_written_;
+      }
+
+      void WriteRow(std::span<const Pixel> row)
+      {
+        if (row.size() != cols_ || rows_written_ == rows_) {
+          throw std::invalid_argument(
+            "Image row does not fit: " + filepath_.string()
+          );
+        }
+
+        const std::size_t row_bytes = cols_ * sizeof(Pixel);
+        if constexpr (Format::kIsFloat) {
+          const std::size_t slot = rows_ - 1 - rows_written_;
+          ofs_.seekp(
+            header_size_ + static_cast<std::streamoff>(slot * row_bytes)
+          );
+        }
+        ofs_.write(reinterpret_cast<const char*>(row.data()), row_bytes);
+        CheckStream();
+        ++rows_written_;
+      }
+
+      // Flushes the file; throws unless every row was written.
+      void Close()
+      {
+        if (rows_written_ != rows_) {
+          throw std::runtime_error(
+            "Image rows missing: " + filepath_.string()
+          );
+        }
+        ofs_.close();
+        CheckStream();
+      }
+
+    };
+
+
+    // Whole image through PnmWriter, row by row, without a staging copy.
+    template <typename Pixel>
+    void WriteImage(
+      const std::filesystem::path& filepath,
+      const utils::Image<Pixel>& image
+    )
+    {
+      PnmWriter<Pixel> writer(filepath, image.rows(), image.cols());
+      for (std::size_t row = 0; row < image.rows(); ++row) {
+        writer.WriteRow(image.row(row));
+      }
+      writer.Close();
+    }
+  }
+}
+
+
+
+#endif // CXXIMAGE_H
@@ -0,0 +1,404 @@
+#ifndef CXXKRON_H
+#define CXXKRON_H
+
+#include <algorithm>
+#include <cstddef>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "DynMatrix.h"
+#include "MatrixExpr.h"
+
+
+
+namespace csp::math
+{
+  // Identity factor of a Kronecker product, stored as its size only.
+  struct KronIdentity
+  {
+    std::size_t size_;
+  };
+
+
+  namespace detail
+  {
+    template <typename... Factors>
+    struct KronElem;
+
+    template <typename... Factors>
+    struct KronElem<KronIdentity, Factors...> : KronElem<Factors...>
+    {
+    };
+
+    template <typename Factor, typename... Factors>
+    struct KronElem<Factor, Factors...>
+    {
+      using type = typename Factor::ElemType;
+    };
+  }
+
+
+  // c (A_0 x A_1 x ... x A_{k-1}) of square factors, never materialized.
+  //
+  // A state of the product space is a row-major tensor with one index per
+  // factor, the first factor varying slowest.  Apply contracts one factor
+  // at a time, which costs dim * sum(d_m) instead of dim^2 operations and
+  // keeps only the factors in memory.
+  template <MatrixElement Elem>
+  class KronProduct
+  {
+    struct Factor
+    {
+      std::size_t size_;
+      std::size_t offset_;
+      bool is_identity_;
+    };
+
+
+  private:
+    std::vector<Factor> factors_;
+
+    std::vector<Elem> data_;
+
+    std::size_t dim_;
+
+    Elem coefficient_;
+
+
+    // out = (I_left x A x I_right) in, for the factor A of size d.
+    static void ApplyFactor(
+      const Elem* a, const std::size_t d, const std::size_t left,
+      const std::size_t right, const Elem* in, Elem* out
+    ) noexcept
+    {
+      for (std::size_t l = 0; l < left; ++l) {
+        const Elem* in_block = in + l * d * right;
+        Elem* out_block = out + l * d * right;
+        for (std::size_t i = 0; i < d; ++i) {
+          Elem* out_row = out_block + i * right;
+          std::fill_n(out_row, right, Elem(0));
+          for (std::size_t j = 0; j < d; ++j) {
+            const Elem a_ij = a[i * d + j];
+            if (a_ij == Elem(0)) {
+              continue;
+            }
+            const Elem* in_row = in_block + j * right;
+            for (std::size_t r = 0; r < right; ++r) {
+              out_row[r] += a_ij * in_row[r];
+            }
+          }
+        }
+      }
+    }
+
+
+  public:
+    KronProduct() noexcept
+    : dim_(1), coefficient_(1)
+    {
+    }
+
+    ~KronProduct() = default;
+
+    KronProduct(const KronProduct& rh) = default;
+
+    KronProduct(KronProduct&& rh) = default;
+
+    KronProduct& operator=(const KronProduct& rh) = default;
+
+    KronProduct& operator=(KronProduct&& rh) = default;
+
+
+    // Appends A as the new last (fastest varying) factor.  Factors are
+    // square and not empty.
+    template <MatrixExpression Mat>
+      requires Mat::kIsLeaf && std::is_same_v<typename Mat::ElemType, Elem>
+    KronProduct& Append(const Mat& a)
+    {
+      expr::CheckShape(a.rows() == a.cols() && a.rows() > 0);
+      const std::size_t d = a.rows();
+      factors_.push_back({d, data_.size(), false});
+      data_.insert(data_.end(), a.data(), a.data() + d * d);
+      dim_ *= d;
+      return *this;
+    }
+
+    KronProduct& Append(const KronIdentity identity)
+    {
+      expr::CheckShape(identity.size_ > 0);
+      factors_.push_back({identity.size_, data_.size(), true});
+      dim_ *= identity.size_;
+      return *this;
+    }
+
+
+    // Dimension of the product space.
+    std::size_t size() const noexcept
+    {
+      return dim_;
+    }
+
+    std::size_t factors() const noexcept
+    {
+      return factors_.size();
+    }
+
+    Elem get_coefficient() const noexcept
+    {
+      return coefficient_;
+    }
+
+    // Bytes held by the factors.
+    std::size_t memory() const noexcept
+    {
+      return data_.size() * sizeof(Elem) + factors_.size() * sizeof(Factor);
+    }
+
+    // Elements of scratch space needed by AddTo.
+    std::size_t workspace_size() const noexcept
+    {
+      return 2 * dim_;
+    }
+
+
+    void operator*=(const Elem rh) noexcept
+    {
+      coefficient_ *= rh;
+    }
+
+
+    // y += c (A_0 x ... x A_{k-1}) x, with `work` of workspace_size().
+    void AddTo(
+      std::span<const Elem> x, std::span<Elem> y, std::span<Elem> work
+    ) const
+    {
+      expr::CheckShape(x.size() == dim_ && y.size() == dim_);
+      expr::CheckShape(work.size() >= workspace_size());
+
+      const Elem* in = x.data();
+      Elem* buffers[2] = {work.data(), work.data() + dim_};
+      std::size_t left = 1;
+      for (const Factor& factor : factors_) {
+        const std::size_t right = dim_ / (left * factor.size_);
+        if (!factor.is_identity_) {
+          Elem* const out = in == buffers[0] ? buffers[1] : buffers[0];
+          ApplyFactor(
+            data_.data() + factor.offset_, factor.size_, left, right, in, out
+          );
+          in = out;
+        }
+        left *= factor.size_;
+      }
+      for (std::size_t i = 0; i < dim_; ++i) {
+        y[i] += coefficient_ * in[i];
+      }
+    }
+
+    std::vector<Elem> operator*(const std::vector<Elem>& x) const
+    {
+      std::vector<Elem> y(dim_);
+      std::vector<Elem> work(workspace_size());
+      AddTo(x, y, work);
+      return y;
+    }
+
+
+    // Dense dim x dim matrix, for checks on small spaces.
+    DynMatrix<Elem> ToDynMatrix() const
+    {
+      DynMatrix<Elem> result(dim_, dim_);
+      std::vector<Elem> unit(dim_);
+      std::vector<Elem> column(dim_);
+      std::vector<Elem> work(workspace_size());
+      for (std::size_t j = 0; j < dim_; ++j) {
+        std::fill(unit.begin(), unit.end(), Elem(0));
+        std::fill(column.begin(), column.end(), Elem(0));
+        unit[j] = Elem(1);
+        AddTo(unit, column, work);
+        for (std::size_t i = 0; i < dim_; ++i) {
+          result.getf(i, j) = column[i];
+        }
+      }
+      return result;
+    }
+  };
+
+
+  // Sum of Kronecker products over the same space, the usual form of a
+  // many-body Hamiltonian.
+  template <MatrixElement Elem>
+  class KronSum
+  {
+  private:
+    std::vector<KronProduct<Elem>> terms_;
+
+    std::size_t dim_;
+
+
+  public:
+    KronSum() noexcept
+    : dim_(0)
+    {
+    }
+
+    explicit KronSum(KronProduct<Elem> term)
+    : dim_(term.size())
+    {
+      terms_.push_back(std::move(term));
+    }
+
+    ~KronSum() = default;
+
+    KronSum(const KronSum& rh) = default;
+
+    KronSum(KronSum&& rh) = default;
+
+    KronSum& operator=(const KronSum& rh) = default;
+
+    KronSum& operator=(KronSum&& rh) = default;
+
+
+    std::size_t size() const noexcept
+    {
+      return dim_;
+    }
+
+    std::span<const KronProduct<Elem>> get_terms() const noexcept
+    {
+      return terms_;
+    }
+
+    std::size_t memory() const noexcept
+    {
+      std::size_t result = 0;
+      for (const KronProduct<Elem>& term : terms_) {
+        result += term.memory();
+      }
+      return result;
+    }
+
+    std::size_t workspace_size() const noexcept
+    {
+      return 2 * dim_;
+    }
+
+
+    KronSum& operator+=(KronProduct<Elem> term)
+    {
+      expr::CheckShape(terms_.empty() || term.size() == dim_);
+      dim_ = term.size();
+      terms_.push_back(std::move(term));
+      return *this;
+    }
+
+    KronSum& operator+=(const KronSum& rh)
+    {
+      for (const KronProduct<Elem>& term : rh.terms_) {
+        *this += term;
+      }
+      return *this;
+    }
+
+    void operator*=(const Elem rh) noexcept
+    {
+      for (KronProduct<Elem>& term : terms_) {
+        term *= rh;
+      }
+    }
+
+
+    // y += sum_t term_t x, with `work` of workspace_size().
+    void AddTo(
+      std::span<const Elem> x, std::span<Elem> y, std::span<Elem> work
+    ) const
+    {
+      for (const KronProduct<Elem>& term : terms_) {
+        term.AddTo(x, y, work);
+      }
+    }
+
+    // y = sum_t term_t x
+    void Apply(
+      std::span<const Elem> x, std::span<Elem> y, std::span<Elem> work
+    ) const
+    {
+      std::fill(y.begin(), y.end(), Elem(0));
+      AddTo(x, y, work);
+    }
+
+    std::vector<Elem> operator*(const std::vector<Elem>& x) const
+    {
+      std::vector<Elem> y(dim_);
+      std::vector<Elem> work(workspace_size());
+      AddTo(x, y, work);
+      return y;
+    }
+
+    DynMatrix<Elem> ToDynMatrix() const
+    {
+      DynMatrix<Elem> result(dim_, dim_);
+      for (const KronProduct<Elem>& term : terms_) {
+        result += term.ToDynMatrix();
+      }
+      return result;
+    }
+  };
+
+
+  // Lazy Kronecker product of Matrix / DynMatrix factors and KronIdentity.
+  template <typename... Factors>
+  auto Kron(const Factors&... factors)
+  {
+    KronProduct<typename detail::KronElem<Factors...>::type> result;
+    (result.Append(factors), ...);
+    return result;
+  }
+
+
+  template <MatrixElement Elem>
+  KronProduct<Elem> operator*(
+    KronProduct<Elem> lh, const std::type_identity_t<Elem> rh
+  ) noexcept
+  {
+    lh *= rh;
+    return lh;
+  }
+
+  template <MatrixElement Elem>
+  KronProduct<Elem> operator*(
+    const std::type_identity_t<Elem> lh, KronProduct<Elem> rh
+  ) noexcept
+  {
+    rh *= lh;
+    return rh;
+  }
+
+  template <MatrixElement Elem>
+  KronSum<Elem> operator+(KronSum<Elem> lh, KronProduct<Elem> rh)
+  {
+    lh += std::move(rh);
+    return lh;
+  }
+
+  template <MatrixElement Elem>
+  KronSum<Elem> operator+(KronProduct<Elem> lh, KronProduct<Elem> rh)
+  {
+    KronSum<Elem> result(std::move(lh));
+    result += std::move(rh);
+    return result;
+  }
+
+  template <MatrixElement Elem>
+  KronSum<Elem> operator+(KronSum<Elem> lh, const KronSum<Elem>& rh)
+  {
+    lh += rh;
+    return lh;
+  }
+}
+
+
+
+#endif // CXXKRON_H
@@ -10,34 +10,76 @@
 #include <ranges>
 #include <type_traits>
 
+#include "Gemm.h"
+#include "MatrixExpr.h"
+
 
 
 namespace csp::math
 {
-  template <typename Elem, std::size_t kRow, std::size_t kCol>
-    requires (
-      std::is_arithmetic_v<Elem> || std::is_same_v<Elem, std::complex<double>>
-    )
-  class Matrix
+  template <MatrixElement Elem, std::size_t kRow, std::size_t kCol>
+  class Matrix : public MatrixExprTag
   {
     using Mat = Matrix<Elem, kRow, kCol>;
 
 
+  public:
+    using ElemType = Elem;
+
+    using PlainType = Mat;
+
+    template <std::size_t kRow2, std::size_t kCol2>
+    using Resized = Matrix<Elem, kRow2, kCol2>;
+
+
+    static constexpr std::size_t kRows = kRow;
+
+    static constexpr std::size_t kCols = kCol;
+
+    static constexpr bool kIsLeaf = true;
+
+    static constexpr bool kLazyProduct = false;
+
+
   private:
     std::array<Elem, kRow * kCol> arr_;
 
 
   public:
-    Matrix()
+    constexpr Matrix()
     : Matrix(0)
     {
     }
 
-    explicit Matrix(const Elem elem)
+    explicit constexpr Matrix(const Elem elem)
     {
       arr_.fill(elem);
     }
 
+    // Storage is left for the caller to overwrite.
+    explicit constexpr Matrix(Uninitialized)
+    {
+    }
+
+    template <MatrixExpression E>
+      requires (!std::is_same_v<expr::Bare<E>, Mat>)
+        && expr::SameShape<E, Mat>
+    constexpr Matrix(const E& e)
+    {
+      expr::Assign(arr_.data(), e);
+    }
+
+    // Element-wise conversion from another precision, e.g. double to float.
+    template <MatrixElement Other>
+      requires (!std::is_same_v<Other, Elem>)
+        && std::is_constructible_v<Elem, Other>
+    explicit constexpr Matrix(const Matrix<Other, kRow, kCol>& rh)
+    {
+      for (std::size_t i = 0; i < kRow * kCol; ++i) {
+        arr_[i] = static_cast<Elem>(rh.cgetf(i));
+      }
+    }
+
     ~Matrix() = default;
 
     Matrix(const Mat& rh) = default;
@@ -48,130 +90,131 @@ namespace csp::math
 
     Matrix& operator=(Mat&& rh) = default;
 
+    template <MatrixExpression E>
+      requires (!std::is_same_v<expr::Bare<E>, Mat>)
+        && expr::SameShape<E, Mat>
+    constexpr Matrix& operator=(const E& e)
+    {
+      if (E::kLazyProduct && e.Aliases(arr_.data())) {
+        *this = Mat(e);
+      } else {
+        expr::Assign(arr_.data(), e);
+      }
+      return *this;
+    }
 
-    Elem& get(const std::size_t i)
+
+    constexpr Elem& get(const std::size_t i)
     {
       return arr_.at(i);
     }
 
-    Elem cget(const std::size_t i) const
+    constexpr Elem cget(const std::size_t i) const
     {
       return arr_.at(i);
     }
 
-    Elem& get(const std::size_t row, const std::size_t col)
+    constexpr Elem& get(const std::size_t row, const std::size_t col)
     {
       return arr_.at(row * kCol + col);
     }
 
-    Elem cget(const std::size_t row, const std::size_t col) const
+    constexpr Elem cget(const std::size_t row, const std::size_t col) const
     {
       return arr_.at(row * kCol + col);
     }
 
-    Elem& getf(const std::size_t i) noexcept
+    constexpr Elem& getf(const std::size_t i) noexcept
     {
       return arr_[i];
     }
 
-    Elem cgetf(const std::size_t i) const noexcept
+    constexpr Elem cgetf(const std::size_t i) const noexcept
     {
       return arr_[i];
     }
 
-    Elem& getf(const std::size_t row, const std::size_t col) noexcept
+    constexpr Elem& getf(const std::size_t row, const std::size_t col)
+      noexcept
     {
       return arr_[row * kCol + col];
     }
 
-    Elem cgetf(const std::size_t row, const std::size_t col) const noexcept
+    constexpr Elem cgetf(const std::size_t row, const std::size_t col)
+      const noexcept
     {
       return arr_[row * kCol + col];
     }
 
-
-    Mat operator-() const noexcept
+    constexpr Elem* data() noexcept
     {
-      Mat mat = *this;
-      mat *= Elem(-1);
-      return mat;
+      return arr_.data();
     }
 
-    void operator+=(const Elem rh) noexcept
-      requires (kRow == kCol)
+    constexpr const Elem* data() const noexcept
     {
-      for (std::size_t i = 0; i < kRow; ++i) {
-        getf(i, i) += rh;
-      }
+      return arr_.data();
     }
 
-    Mat operator+(const Elem rh) const noexcept
-      requires (kRow == kCol)
+    constexpr std::size_t rows() const noexcept
     {
-      Mat mat = *this;
-      mat += rh;
-      return mat;
+      return kRow;
     }
 
-    template <typename Elem2, std::size_t kRow2, std::size_t kCol2>
-      requires (kRow2 == kCol2)
-    friend constexpr Matrix<Elem2, kRow2, kCol2> operator+(
-      const Elem2 lh, const Matrix<Elem2, kRow2, kCol2>& rh
-    ) noexcept
+    constexpr std::size_t cols() const noexcept
     {
-      return rh + lh;
+      return kCol;
     }
 
-    void operator+=(const Mat& rh) noexcept
+    constexpr bool Aliases(const void* ptr) const noexcept
     {
-      std::ranges::transform(arr_, rh.arr_, arr_.begin(), std::plus<>());
+      return arr_.data() == ptr;
     }
 
-    Mat operator+(const Mat& rh) const noexcept
-    {
-      Mat mat;
-      std::ranges::transform(arr_, rh.arr_, mat.arr_.begin(), std::plus<>());
-      return mat;
-    }
 
-    void operator-=(const Elem rh) noexcept
+    constexpr void operator+=(const Elem rh) noexcept
       requires (kRow == kCol)
     {
       for (std::size_t i = 0; i < kRow; ++i) {
-        getf(i, i) -= rh;
+        getf(i, i) += rh;
       }
     }
 
-    Mat operator-(const Elem rh) const noexcept
-      requires (kRow == kCol)
-    {
-      Mat mat = *this;
-      mat -= rh;
-      return mat;
-    }
-
-    template <typename Elem2, std::size_t kRow2, std::size_t kCol2>
-      requires (kRow2 == kCol2)
-    friend constexpr Matrix<Elem2, kRow2, kCol2> operator-(
-      const Elem2 lh, const Matrix<Elem2, kRow2, kCol2>& rh
-    ) noexcept
+    template <MatrixExpression E>
+      requires expr::SameShape<E, Mat>
+    constexpr void operator+=(const E& rh)
     {
-      return -(rh - lh);
+      if constexpr (E::kLazyProduct) {
+        if (rh.Aliases(arr_.data())) {
+          *this += Mat(rh);
+          return;
+        }
+      }
+      expr::AddTo(arr_.data(), rh, Elem(1));
     }
 
-    void operator-=(const Mat& rh) noexcept
+    constexpr void operator-=(const Elem rh) noexcept
+      requires (kRow == kCol)
     {
-      std::ranges::transform(arr_, rh.arr_, arr_.begin(), std::minus<>());
+      for (std::size_t i = 0; i < kRow; ++i) {
+        getf(i, i) -= rh;
+      }
     }
 
-    Mat operator-(const Mat& rh) const noexcept
+    template <MatrixExpression E>
+      requires expr::SameShape<E, Mat>
+    constexpr void operator-=(const E& rh)
     {
-      Mat mat;
-      std::ranges::transform(arr_, rh.arr_, mat.arr_.begin(), std::minus<>());
-      return mat;
+      if constexpr (E::kLazyProduct) {
+        if (rh.Aliases(arr_.data())) {
+          *this -= Mat(rh);
+          return;
+        }
+      }
+      expr::AddTo(arr_.data(), rh, Elem(-1));
     }
 
-    void operator*=(const Elem rh) noexcept
+    constexpr void operator*=(const Elem rh) noexcept
     {
       std::ranges::for_each(arr_,
         [rh](Elem& elem) {
@@ -180,62 +223,22 @@ namespace csp::math
       );
     }
 
-    Mat operator*(const Elem rh) const noexcept
-    {
-      Mat mat;
-      std::ranges::transform(arr_, mat.arr_.begin(),
-        [rh](const Elem& elem) {
-          return elem * rh;
-        }
-      );
-      return mat;
-    }
-
-    template <typename Elem2, std::size_t kRow2, std::size_t kCol2>
-    friend constexpr Matrix<Elem2, kRow2, kCol2> operator*(
-      const Elem2 lh, const Matrix<Elem2, kRow2, kCol2>& rh
-    ) noexcept
-    {
-      return rh * lh;
-    }
-
-    template <std::size_t kCol2>
-    Matrix<Elem, kRow, kCol2> operator*(
-      const Matrix<Elem, kCol, kCol2>& rh
-    ) const noexcept
-    {
-      Matrix<Elem, kRow, kCol2> result;
-
-      for (std::size_t row = 0; row < kRow; ++row) {
-        for (std::size_t col = 0; col < kCol2; ++col) {
-          Elem val = 0.;
-          for (std::size_t tmp = 0; tmp < kCol; ++tmp) {
-            val += cgetf(row, tmp) * rh.cgetf(tmp, col);
-          }
-          result.getf(row, col) = val;
-        }
-      }
-      return result;
-    }
-
 
-    Elem trace() const noexcept
+    // Summed in expr::Accumulator<Elem>.
+    constexpr Elem trace() const noexcept
       requires (kRow == kCol)
     {
-      Elem result = 0;
+      expr::Accumulator<Elem> result = 0;
       for (std::size_t i = 0; i < kRow; ++i) {
         result += cgetf(i, i);
       }
-      return result;
+      return Elem(result);
     }
 
-    Mat commute(const Mat& rh) const noexcept
+    constexpr Mat commute(const Mat& rh) const
       requires (kRow == kCol)
     {
-      Mat result = (*this) * rh;
-      Mat tmp = rh * (*this);
-      result -= tmp;
-      return result;
+      return (*this) * rh - rh * (*this);
     }
   };
 }
@@ -0,0 +1,395 @@
+#ifndef CXXMATRIXBATCH_H
+#define CXXMATRIXBATCH_H
+
+#include <algorithm>
+#include <cstddef>
+#include <span>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "AlignedAllocator.h"
+#include "Matrix.h"
+#include "MatrixExpr.h"
+#include "ThreadPool.h"
+
+
+
+namespace csp::math
+{
+  // N small kRow x kCol matrices in structure-of-arrays layout: coefficient
+  // (i, j) of every matrix is stored contiguously, so the batched kernels
+  // below run one SIMD lane per matrix with no shuffles.  Each coefficient
+  // stream is padded to 64 bytes.
+  template <MatrixElement Elem, std::size_t kRow, std::size_t kCol>
+  class MatrixBatch
+  {
+    using Batch = MatrixBatch<Elem, kRow, kCol>;
+
+
+  public:
+    using ElemType = Elem;
+
+    using MatrixType = Matrix<Elem, kRow, kCol>;
+
+
+    static constexpr std::size_t kRows = kRow;
+
+    static constexpr std::size_t kCols = kCol;
+
+    // Matrices processed together by the kernels, chosen so that all the
+    // operand streams of a block stay in L1.
+    static constexpr std::size_t kBlock = 64;
+
+
+  private:
+    static constexpr std::size_t kLanes = std::max<std::size_t>(
+      1, 64 / sizeof(Elem)
+    );
+
+
+    std::size_t size_;
+
+    std::size_t stride_;
+
+    std::vector<Elem, AlignedAllocator<Elem>> arr_;
+
+
+  public:
+    MatrixBatch() noexcept
+    : size_(0), stride_(0)
+    {
+    }
+
+    explicit MatrixBatch(const std::size_t size)
+    : MatrixBatch(size, kUninitialized)
+    {
+      std::fill(arr_.begin(), arr_.end(), Elem(0));
+    }
+
+    // Storage is left for the caller to overwrite.
+    MatrixBatch(const std::size_t size, Uninitialized)
+    : size_(size),
+      stride_((size + kLanes - 1) / kLanes * kLanes),
+      arr_(stride_ * kRow * kCol)
+    {
+    }
+
+    explicit MatrixBatch(std::span<const MatrixType> mats)
+    : MatrixBatch(mats.size(), kUninitialized)
+    {
+      Scatter(mats);
+    }
+
+    ~MatrixBatch() = default;
+
+    MatrixBatch(const Batch& rh) = delete;
+
+    MatrixBatch(Batch&& rh) noexcept
+    : size_(rh.size_), stride_(rh.stride_), arr_(std::move(rh.arr_))
+    {
+      rh.size_ = 0;
+      rh.stride_ = 0;
+    }
+
+    MatrixBatch& operator=(const Batch& rh) = delete;
+
+    MatrixBatch& operator=(Batch&& rh) noexcept
+    {
+      size_ = rh.size_;
+      stride_ = rh.stride_;
+      arr_ = std::move(rh.arr_);
+      rh.size_ = 0;
+      rh.stride_ = 0;
+      return *this;
+    }
+
+
+    // Number of matrices.
+    std::size_t size() const noexcept
+    {
+      return size_;
+    }
+
+    // Coefficient (row, col) of every matrix, size() values.
+    Elem* data(const std::size_t row, const std::size_t col) noexcept
+    {
+      return arr_.data() + (row * kCol + col) * stride_;
+    }
+
+    const Elem* data(const std::size_t row, const std::size_t col)
+      const noexcept
+    {
+      return arr_.data() + (row * kCol + col) * stride_;
+    }
+
+
+    MatrixType Gather(const std::size_t n) const
+    {
+      if (n >= size_) {
+        throw std::out_of_range("MatrixBatch index out of range");
+      }
+      MatrixType mat(kUninitialized);
+      for (std::size_t e = 0; e < kRow * kCol; ++e) {
+        mat.getf(e) = arr_[e * stride_ + n];
+      }
+      return mat;
+    }
+
+    void Scatter(const std::size_t n, const MatrixType& mat)
+    {
+      if (n >= size_) {
+        throw std::out_of_range("MatrixBatch index out of range");
+      }
+      for (std::size_t e = 0; e < kRow * kCol; ++e) {
+        arr_[e * stride_ + n] = mat.cgetf(e);
+      }
+    }
+
+    // Copies mats[n] into matrix n, for n < mats.size().
+    void Scatter(std::span<const MatrixType> mats)
+    {
+      expr::CheckShape(mats.size() <= size_);
+      for (std::size_t e = 0; e < kRow * kCol; ++e) {
+        Elem* stream = arr_.data() + e * stride_;
+        for (std::size_t n = 0; n < mats.size(); ++n) {
+          stream[n] = mats[n].cgetf(e);
+        }
+      }
+    }
+
+    // Copies matrix n into mats[n], for n < mats.size().
+    void Gather(std::span<MatrixType> mats) const
+    {
+      expr::CheckShape(mats.size() <= size_);
+      for (std::size_t e = 0; e < kRow * kCol; ++e) {
+        const Elem* stream = arr_.data() + e * stride_;
+        for (std::size_t n = 0; n < mats.size(); ++n) {
+          mats[n].getf(e) = stream[n];
+        }
+      }
+    }
+
+
+    Batch Clone() const
+    {
+      Batch batch(size_, kUninitialized);
+      std::copy(arr_.begin(), arr_.end(), batch.arr_.begin());
+      return batch;
+    }
+
+    // out[n] = trace of matrix n, summed in expr::Accumulator<Elem> as
+    // Matrix::trace is.
+    void trace(std::span<Elem> out) const
+      requires (kRow == kCol)
+    {
+      expr::CheckShape(out.size() >= size_);
+      const Elem* diag[kRow];
+      for (std::size_t i = 0; i < kRow; ++i) {
+        diag[i] = data(i, i);
+      }
+      Elem* dst = out.data();
+      for (std::size_t n = 0; n < size_; ++n) {
+        expr::Accumulator<Elem> sum = 0;
+        for (std::size_t i = 0; i < kRow; ++i) {
+          sum += diag[i][n];
+        }
+        dst[n] = Elem(sum);
+      }
+    }
+
+    Batch commute(const Batch& rh) const
+      requires (kRow == kCol)
+    {
+      Batch result(size_, kUninitialized);
+      Commute(*this, rh, result);
+      return result;
+    }
+  };
+
+
+  namespace detail
+  {
+    // Calls `body(lo, hi)` on blocks of at most kBlock matrices.  Batches
+    // of about expr::kParallelThreshold scalar operations and more are
+    // split over the pool in whole blocks.
+    template <std::size_t kBlock, typename F>
+    void ForBatch(
+      const std::size_t size, const std::size_t work_per_matrix, const F& body
+    )
+    {
+      const std::size_t threshold =
+        (expr::kParallelThreshold + work_per_matrix - 1) / work_per_matrix;
+      const std::size_t grain = std::max(
+        kBlock, expr::kParallelGrain / work_per_matrix / kBlock * kBlock
+      );
+      utils::ParallelForIfLarge(size, threshold, grain,
+        [&](const std::size_t begin, const std::size_t end) {
+          for (std::size_t lo = begin; lo < end; lo += kBlock) {
+            body(lo, std::min(end, lo + kBlock));
+          }
+        }
+      );
+    }
+
+    // c[n] (+)= a[n] b[n] over the matrices [lo, hi), each entry summed in
+    // expr::Accumulator<Elem> as Matrix products are.
+    template <
+      bool kAccumulate, MatrixElement Elem,
+      std::size_t kRow, std::size_t kInner, std::size_t kCol
+    >
+    void MultiplyBlock(
+      const MatrixBatch<Elem, kRow, kInner>& a,
+      const MatrixBatch<Elem, kInner, kCol>& b,
+      MatrixBatch<Elem, kRow, kCol>& c,
+      const Elem alpha, const std::size_t lo, const std::size_t hi
+    ) noexcept
+    {
+      using Acc = expr::Accumulator<Elem>;
+
+      for (std::size_t i = 0; i < kRow; ++i) {
+        for (std::size_t j = 0; j < kCol; ++j) {
+          const Elem* lhs[kInner];
+          const Elem* rhs[kInner];
+          for (std::size_t k = 0; k < kInner; ++k) {
+            lhs[k] = a.data(i, k);
+            rhs[k] = b.data(k, j);
+          }
+          Elem* dst = c.data(i, j);
+          for (std::size_t n = lo; n < hi; ++n) {
+            Acc sum = Acc(lhs[0][n]) * Acc(rhs[0][n]);
+            for (std::size_t k = 1; k < kInner; ++k) {
+              sum += Acc(lhs[k][n]) * Acc(rhs[k][n]);
+            }
+            if constexpr (kAccumulate) {
+              dst[n] += Elem(Acc(alpha) * sum);
+            } else {
+              dst[n] = Elem(Acc(alpha) * sum);
+            }
+          }
+        }
+      }
+    }
+  }
+
+
+  // c[n] = a[n] b[n] for every n.
+  template <
+    MatrixElement Elem, std::size_t kRow, std::size_t kInner, std::size_t kCol
+  >
+  void Multiply(
+    const MatrixBatch<Elem, kRow, kInner>& a,
+    const MatrixBatch<Elem, kInner, kCol>& b,
+    MatrixBatch<Elem, kRow, kCol>& c
+  )
+  {
+    using Out = MatrixBatch<Elem, kRow, kCol>;
+
+    if (
+      static_cast<const void*>(&c) == &a || static_cast<const void*>(&c) == &b
+    ) {
+      Out result;
+      Multiply(a, b, result);
+      c = std::move(result);
+      return;
+    }
+    expr::CheckShape(a.size() == b.size());
+    if (c.size() != a.size()) {
+      c = Out(a.size(), kUninitialized);
+    }
+    detail::ForBatch<Out::kBlock>(a.size(), kRow * kInner * kCol,
+      [&](const std::size_t lo, const std::size_t hi) {
+        detail::MultiplyBlock<false>(a, b, c, Elem(1), lo, hi);
+      }
+    );
+  }
+
+  // c[n] = a[n] + b[n] for every n.  Element-wise, so c may be a or b.
+  template <MatrixElement Elem, std::size_t kRow, std::size_t kCol>
+  void Add(
+    const MatrixBatch<Elem, kRow, kCol>& a,
+    const MatrixBatch<Elem, kRow, kCol>& b,
+    MatrixBatch<Elem, kRow, kCol>& c
+  )
+  {
+    using Out = MatrixBatch<Elem, kRow, kCol>;
+
+    expr::CheckShape(a.size() == b.size());
+    if (c.size() != a.size()) {
+      c = Out(a.size(), kUninitialized);
+    }
+    detail::ForBatch<Out::kBlock>(a.size(), kRow * kCol,
+      [&](const std::size_t lo, const std::size_t hi) {
+        for (std::size_t i = 0; i < kRow; ++i) {
+          for (std::size_t j = 0; j < kCol; ++j) {
+            const Elem* lhs = a.data(i, j);
+            const Elem* rhs = b.data(i, j);
+            Elem* dst = c.data(i, j);
+            for (std::size_t n = lo; n < hi; ++n) {
+              dst[n] = lhs[n] + rhs[n];
+            }
+          }
+        }
+      }
+    );
+  }
+
+  // c[n] = a[n] b[n] - b[n] a[n] for every n.
+  template <MatrixElement Elem, std::size_t kSize>
+  void Commute(
+    const MatrixBatch<Elem, kSize, kSize>& a,
+    const MatrixBatch<Elem, kSize, kSize>& b,
+    MatrixBatch<Elem, kSize, kSize>& c
+  )
+  {
+    using Out = MatrixBatch<Elem, kSize, kSize>;
+
+    if (
+      static_cast<const void*>(&c) == &a || static_cast<const void*>(&c) == &b
+    ) {
+      Out result;
+      Commute(a, b, result);
+      c = std::move(result);
+      return;
+    }
+    expr::CheckShape(a.size() == b.size());
+    if (c.size() != a.size()) {
+      c = Out(a.size(), kUninitialized);
+    }
+    detail::ForBatch<Out::kBlock>(a.size(), 2 * kSize * kSize * kSize,
+      [&](const std::size_t lo, const std::size_t hi) {
+        detail::MultiplyBlock<false>(a, b, c, Elem(1), lo, hi);
+        detail::MultiplyBlock<true>(b, a, c, Elem(-1), lo, hi);
+      }
+    );
+  }
+
+
+  template <
+    MatrixElement Elem, std::size_t kRow, std::size_t kInner, std::size_t kCol
+  >
+  MatrixBatch<Elem, kRow, kCol> operator*(
+    const MatrixBatch<Elem, kRow, kInner>& a,
+    const MatrixBatch<Elem, kInner, kCol>& b
+  )
+  {
+    MatrixBatch<Elem, kRow, kCol> c(a.size(), kUninitialized);
+    Multiply(a, b, c);
+    return c;
+  }
+
+  template <MatrixElement Elem, std::size_t kRow, std::size_t kCol>
+  MatrixBatch<Elem, kRow, kCol> operator+(
+    const MatrixBatch<Elem, kRow, kCol>& a,
+    const MatrixBatch<Elem, kRow, kCol>& b
+  )
+  {
+    MatrixBatch<Elem, kRow, kCol> c(a.size(), kUninitialized);
+    Add(a, b, c);
+    return c;
+  }
+}
+
+
+
+#endif // CXXMATRIXBATCH_H
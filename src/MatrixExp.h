@@ -0,0 +1,324 @@
+#ifndef CXXMATRIXEXP_H
+#define CXXMATRIXEXP_H
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <complex>
+#include <cstddef>
+#include <limits>
+#include <type_traits>
+#include <utility>
+
+#include "Decomposition.h"
+#include "MatrixExpr.h"
+
+
+
+namespace csp::math
+{
+  namespace linalg
+  {
+    template <typename Mat>
+    auto OneNorm(const Mat& a) noexcept
+    {
+      using Real = decltype(RealPart(typename Mat::ElemType()));
+
+      Real result = 0;
+      for (std::size_t col = 0; col < a.cols(); ++col) {
+        Real sum = 0;
+        for (std::size_t row = 0; row < a.rows(); ++row) {
+          sum += std::abs(a.cgetf(row, col));
+        }
+        result = std::max(result, sum);
+      }
+      return result;
+    }
+
+    template <typename Mat>
+    auto MaxNorm(const Mat& a) noexcept
+    {
+      using Real = decltype(RealPart(typename Mat::ElemType()));
+
+      Real result = 0;
+      for (std::size_t i = 0; i < a.rows() * a.cols(); ++i) {
+        result = std::max<Real>(result, std::abs(a.cgetf(i)));
+      }
+      return result;
+    }
+
+    template <typename Mat>
+    Mat Identity(const std::size_t n)
+    {
+      using Elem = typename Mat::ElemType;
+
+      Mat id = expr::MakePlain<Mat>(n, n);
+      std::fill_n(id.data(), n * n, Elem(0));
+      for (std::size_t i = 0; i < n; ++i) {
+        id.getf(i, i) = Elem(1);
+      }
+      return id;
+    }
+
+
+    // Largest 1-norms for which the [m/m] Pade approximant of degree
+    // m = 3, 5, 7, 9, 13 is accurate to double precision (Higham, 2005).
+    inline constexpr std::array<double, 5> kPadeTheta = {
+      1.495585217958292e-2,
+      2.539398330063230e-1,
+      9.504178996162932e-1,
+      2.097847961257068e+0,
+      5.371920351148152e+0
+    };
+
+
+    // (U, V) of the [m/m] Pade approximant r_m(A) = (V - U)^-1 (V + U).
+    template <typename Mat, std::size_t kM>
+    void PadeTerms(const Mat& a, const Mat& a2, Mat& u, Mat& v)
+    {
+      using Elem = typename Mat::ElemType;
+
+      if constexpr (kM == 3) {
+        constexpr double kB[] = {120., 60., 12., 1.};
+        const Mat odd = a2 * Elem(kB[3]) + Elem(kB[1]);
+        u = a * odd;
+        v = a2 * Elem(kB[2]) + Elem(kB[0]);
+      } else if constexpr (kM == 5) {
+        constexpr double kB[] = {30240., 15120., 3360., 420., 30., 1.};
+        const Mat a4 = a2 * a2;
+        const Mat odd = a4 * Elem(kB[5]) + a2 * Elem(kB[3]) + Elem(kB[1]);
+        u = a * odd;
+        v = a4 * Elem(kB[4]) + a2 * Elem(kB[2]) + Elem(kB[0]);
+      } else if constexpr (kM == 7) {
+        constexpr double kB[] = {
+          17297280., 8648640., 1995840., 277200., 25200., 1512., 56., 1.
+        };
+        const Mat a4 = a2 * a2;
+        const Mat a6 = a4 * a2;
+        const Mat odd = (
+          a6 * Elem(kB[7]) + a4 * Elem(kB[5]) + a2 * Elem(kB[3]) + Elem(kB[1])
+        );
+        u = a * odd;
+        v = a6 * Elem(kB[6]) + a4 * Elem(kB[4]) + a2 * Elem(kB[2])
+          + Elem(kB[0]);
+      } else if constexpr (kM == 9) {
+        constexpr double kB[] = {
+          17643225600., 8821612800., 2075673600., 302702400., 30270240.,
+          2162160., 110880., 3960., 90., 1.
+        };
+        const Mat a4 = a2 * a2;
+        const Mat a6 = a4 * a2;
+        const Mat a8 = a6 * a2;
+        const Mat odd = (
+          a8 * Elem(kB[9]) + a6 * Elem(kB[7]) + a4 * Elem(kB[5])
+          + a2 * Elem(kB[3]) + Elem(kB[1])
+        );
+        u = a * odd;
+        v = a8 * Elem(kB[8]) + a6 * Elem(kB[6]) + a4 * Elem(kB[4])
+          + a2 * Elem(kB[2]) + Elem(kB[0]);
+      } else {
+        constexpr double kB[] = {
+          64764752532480000., 32382376266240000., 7771770303897600.,
+          1187353796428800., 129060195264000., 10559470521600.,
+          670442572800., 33522128640., 1323241920., 40840800., 960960.,
+          16380., 182., 1.
+        };
+        const Mat a4 = a2 * a2;
+        const Mat a6 = a4 * a2;
+        const Mat odd_high = (
+          a6 * Elem(kB[13]) + a4 * Elem(kB[11]) + a2 * Elem(kB[9])
+        );
+        const Mat odd = (
+          a6 * odd_high + a6 * Elem(kB[7]) + a4 * Elem(kB[5])
+          + a2 * Elem(kB[3]) + Elem(kB[1])
+        );
+        u = a * odd;
+        const Mat even_high = (
+          a6 * Elem(kB[12]) + a4 * Elem(kB[10]) + a2 * Elem(kB[8])
+        );
+        v = a6 * even_high + a6 * Elem(kB[6]) + a4 * Elem(kB[4])
+          + a2 * Elem(kB[2]) + Elem(kB[0]);
+      }
+    }
+  }
+
+
+  // exp(A) by scaling and squaring with [m/m] Pade approximants, m chosen
+  // from the 1-norm of A (Higham, 2005).
+  template <typename Mat>
+    requires linalg::SquareField<Mat>
+  Mat Expm(const Mat& a)
+  {
+    using Elem = typename Mat::ElemType;
+
+    expr::CheckShape(a.rows() == a.cols());
+    const double norm = static_cast<double>(linalg::OneNorm(a));
+
+    const Mat a2 = a * a;
+    Mat u = expr::MakePlain<Mat>(a.rows(), a.cols());
+    Mat v = expr::MakePlain<Mat>(a.rows(), a.cols());
+    int squarings = 0;
+
+    if (norm <= linalg::kPadeTheta[0]) {
+      linalg::PadeTerms<Mat, 3>(a, a2, u, v);
+    } else if (norm <= linalg::kPadeTheta[1]) {
+      linalg::PadeTerms<Mat, 5>(a, a2, u, v);
+    } else if (norm <= linalg::kPadeTheta[2]) {
+      linalg::PadeTerms<Mat, 7>(a, a2, u, v);
+    } else if (norm <= linalg::kPadeTheta[3]) {
+      linalg::PadeTerms<Mat, 9>(a, a2, u, v);
+    } else {
+      const double ratio = norm / linalg::kPadeTheta[4];
+      squarings = std::max(0, static_cast<int>(std::ceil(std::log2(ratio))));
+      const Elem scale = Elem(std::ldexp(1., -squarings));
+      const Mat scaled = a * scale;
+      const Mat scaled2 = a2 * (scale * scale);
+      linalg::PadeTerms<Mat, 13>(scaled, scaled2, u, v);
+    }
+
+    Mat denominator = v - u;
+    const Mat numerator = v + u;
+    Mat result = Lu<Mat>(std::move(denominator)).solve(numerator);
+    for (int i = 0; i < squarings; ++i) {
+      result = result * result;
+    }
+    return result;
+  }
+
+
+  // exp(t A) B without forming exp(t A): the action is split into s steps
+  // of a truncated Taylor series, after shifting A by its mean diagonal
+  // (after Al-Mohy and Higham, 2011).  Every step stops as soon as two
+  // consecutive terms are below the double-precision tolerance.
+  template <typename Mat, typename B>
+    requires linalg::SquareField<Mat> && linalg::RightHandSide<Mat, B>
+  B ExpmMultiply(
+    const Mat& a, const B& b, const typename Mat::ElemType t = 1
+  )
+  {
+    using Elem = typename Mat::ElemType;
+    using Real = decltype(linalg::RealPart(Elem()));
+
+    constexpr std::size_t kMaxTerms = 55;
+    const Real tolerance = std::numeric_limits<Real>::epsilon() / 2;
+
+    const std::size_t n = a.rows();
+    expr::CheckShape(a.cols() == n && b.rows() == n);
+
+    Elem mu = 0;
+    for (std::size_t i = 0; i < n; ++i) {
+      mu += a.cgetf(i, i);
+    }
+    mu /= Elem(static_cast<Real>(n));
+    const Mat shifted = a - mu;
+
+    const Real norm = std::abs(t) * linalg::OneNorm(shifted);
+    const std::size_t steps = std::max<std::size_t>(
+      1, static_cast<std::size_t>(std::ceil(norm))
+    );
+    const Elem dt = t / Elem(static_cast<Real>(steps));
+    const Elem eta = std::exp(dt * mu);
+
+    B f = expr::Copy(b);
+    B term = expr::Copy(b);
+    for (std::size_t step = 0; step < steps; ++step) {
+      Real prev = linalg::MaxNorm(term);
+      for (std::size_t k = 1; k <= kMaxTerms; ++k) {
+        term = shifted * term;
+        term *= dt / Elem(static_cast<Real>(k));
+        f += term;
+        const Real curr = linalg::MaxNorm(term);
+        if (prev + curr <= tolerance * linalg::MaxNorm(f)) {
+          break;
+        }
+        prev = curr;
+      }
+      f *= eta;
+      std::copy_n(f.data(), f.rows() * f.cols(), term.data());
+    }
+    return f;
+  }
+
+
+  // Time-evolution operator U = exp(-i H dt) of a complex Hamiltonian.
+  // The exponential is cached and only rebuilt when H or dt change.
+  template <typename Mat>
+    requires linalg::SquareField<Mat>
+      && linalg::IsComplex<typename Mat::ElemType>::value
+  class Propagator
+  {
+    using Elem = typename Mat::ElemType;
+
+    using Real = typename Elem::value_type;
+
+
+  private:
+    Mat hamiltonian_;
+
+    Real dt_;
+
+    Mat propagator_;
+
+    bool is_valid_;
+
+
+  public:
+    Propagator()
+    : dt_(0), is_valid_(false)
+    {
+    }
+
+    ~Propagator() = default;
+
+    Propagator(const Propagator& rh) = delete;
+
+    Propagator(Propagator&& rh) = default;
+
+    Propagator& operator=(const Propagator& rh) = delete;
+
+    Propagator& operator=(Propagator&& rh) = default;
+
+
+    // exp(-i H dt), rebuilt only when `h` or `dt` differ from the last call.
+    const Mat& get(const Mat& h, const Real dt)
+    {
+      const std::size_t size = h.rows() * h.cols();
+      if (
+        is_valid_ && dt == dt_
+        && hamiltonian_.rows() == h.rows() && hamiltonian_.cols() == h.cols()
+        && std::equal(h.data(), h.data() + size, hamiltonian_.data())
+      ) {
+        return propagator_;
+      }
+
+      hamiltonian_ = expr::Copy(h);
+      dt_ = dt;
+      propagator_ = Expm<Mat>(h * Elem(0, -dt));
+      is_valid_ = true;
+      return propagator_;
+    }
+
+    bool is_valid() const noexcept
+    {
+      return is_valid_;
+    }
+
+    void Invalidate() noexcept
+    {
+      is_valid_ = false;
+    }
+
+
+    // psi <- exp(-i H dt) psi
+    template <typename B>
+      requires linalg::RightHandSide<Mat, B>
+    void Apply(const Mat& h, const Real dt, B& psi)
+    {
+      psi = get(h, dt) * psi;
+    }
+  };
+}
+
+
+
+#endif // CXXMATRIXEXP_H
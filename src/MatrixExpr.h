@@ -0,0 +1,724 @@
+#ifndef CXXMATRIXEXPR_H
+#define CXXMATRIXEXPR_H
+
+#include <algorithm>
+#include <complex>
+#include <concepts>
+#include <cstddef>
+#include <functional>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#include "Gemm.h"
+#include "ThreadPool.h"
+
+
+
+namespace csp::math
+{
+  // Lazy expression layer shared by the matrix types.
+  //
+  // Every expression exposes `ElemType`, `PlainType`, the static shape
+  // `kRows` / `kCols` (`kDynamic` for runtime-sized types), `rows()` /
+  // `cols()`, the flat accessor `cgetf(i)` and `Aliases(p)`.  Element-wise
+  // chains are fused into a single pass when they are assigned.  Products
+  // are never read element by element: they are evaluated by GEMM straight
+  // into the destination, and are materialized once when they appear under
+  // a non-additive node.
+
+
+  struct MatrixExprTag
+  {
+  };
+
+
+  inline constexpr std::size_t kDynamic = std::dynamic_extent;
+
+
+  template <typename Elem>
+  concept ComplexElement = requires {
+    typename Elem::value_type;
+    requires std::floating_point<typename Elem::value_type>;
+    requires std::is_same_v<Elem, std::complex<typename Elem::value_type>>;
+  };
+
+  template <typename Elem>
+  concept MatrixElement = std::is_arithmetic_v<Elem> || ComplexElement<Elem>;
+
+
+  // Tag for constructors that leave the storage to be overwritten.
+  struct Uninitialized
+  {
+  };
+
+  inline constexpr Uninitialized kUninitialized{};
+
+
+  template <typename E>
+  concept MatrixExpression = std::derived_from<
+    std::remove_cvref_t<E>, MatrixExprTag
+  >;
+
+
+  namespace expr
+  {
+    template <typename E>
+    using Bare = std::remove_cvref_t<E>;
+
+
+    // Type in which products and traces of Elem are accumulated: single
+    // precision is stored as is but summed in double precision.
+    template <typename Elem>
+    struct AccumulatorOf
+    {
+      using type = Elem;
+    };
+
+    template <>
+    struct AccumulatorOf<float>
+    {
+      using type = double;
+    };
+
+    template <>
+    struct AccumulatorOf<std::complex<float>>
+    {
+      using type = std::complex<double>;
+    };
+
+    template <typename Elem>
+    using Accumulator = typename AccumulatorOf<Elem>::type;
+
+
+    // Leaves are held by reference when they are lvalues, everything else
+    // (rvalue leaves, nodes) by value.
+    template <typename E>
+    using Stored = std::conditional_t<
+      std::is_lvalue_reference_v<E> && Bare<E>::kIsLeaf,
+      const Bare<E>&,
+      Bare<E>
+    >;
+
+    // Operand of a node that needs random access to its coefficients.
+    template <typename E>
+    using Materialized = std::conditional_t<
+      Bare<E>::kLazyProduct, typename Bare<E>::PlainType, Stored<E>
+    >;
+
+    // Operand of a product, which needs contiguous storage.
+    template <typename E>
+    using Evaluated = std::conditional_t<
+      Bare<E>::kIsLeaf, Stored<E>, typename Bare<E>::PlainType
+    >;
+
+
+    template <typename L, typename R>
+    concept SameShape = (
+      std::is_same_v<typename Bare<L>::ElemType, typename Bare<R>::ElemType>
+      && Bare<L>::kRows == Bare<R>::kRows
+      && Bare<L>::kCols == Bare<R>::kCols
+    );
+
+    template <typename L, typename R>
+    concept Conformable = (
+      std::is_same_v<typename Bare<L>::ElemType, typename Bare<R>::ElemType>
+      && Bare<L>::kCols == Bare<R>::kRows
+    );
+
+    template <typename E>
+    concept Square = Bare<E>::kRows == Bare<E>::kCols;
+
+
+    // Shapes of runtime-sized operands are only known here.
+    constexpr void CheckShape(const bool is_valid)
+    {
+      if (!is_valid) {
+        throw std::invalid_argument("Matrix shape mismatch");
+      }
+    }
+
+    template <typename L, typename R>
+    constexpr void CheckSameShape(const L& l, const R& r)
+    {
+      if constexpr (L::kRows == kDynamic || L::kCols == kDynamic) {
+        CheckShape(l.rows() == r.rows() && l.cols() == r.cols());
+      }
+    }
+
+
+    template <typename E>
+    class Negate : public MatrixExprTag
+    {
+      using Operand = Materialized<E>;
+
+
+    public:
+      using ElemType = typename Bare<E>::ElemType;
+
+      using PlainType = typename Bare<E>::PlainType;
+
+
+      static constexpr std::size_t kRows = Bare<E>::kRows;
+
+      static constexpr std::size_t kCols = Bare<E>::kCols;
+
+      static constexpr bool kIsLeaf = false;
+
+      static constexpr bool kLazyProduct = false;
+
+
+    private:
+      Operand e_;
+
+
+    public:
+      explicit constexpr Negate(E&& e)
+      : e_(std::forward<E>(e))
+      {
+      }
+
+
+      constexpr std::size_t rows() const noexcept
+      {
+        return e_.rows();
+      }
+
+      constexpr std::size_t cols() const noexcept
+      {
+        return e_.cols();
+      }
+
+      constexpr ElemType cgetf(const std::size_t i) const noexcept
+      {
+        return -e_.cgetf(i);
+      }
+
+      constexpr bool Aliases(const void* ptr) const noexcept
+      {
+        return e_.Aliases(ptr);
+      }
+    };
+
+
+    template <typename E>
+    class Scale : public MatrixExprTag
+    {
+      using Operand = Materialized<E>;
+
+
+    public:
+      using ElemType = typename Bare<E>::ElemType;
+
+      using PlainType = typename Bare<E>::PlainType;
+
+
+      static constexpr std::size_t kRows = Bare<E>::kRows;
+
+      static constexpr std::size_t kCols = Bare<E>::kCols;
+
+      static constexpr bool kIsLeaf = false;
+
+      static constexpr bool kLazyProduct = false;
+
+
+    private:
+      Operand e_;
+
+      ElemType scalar_;
+
+
+    public:
+      constexpr Scale(E&& e, const ElemType scalar)
+      : e_(std::forward<E>(e)), scalar_(scalar)
+      {
+      }
+
+
+      constexpr std::size_t rows() const noexcept
+      {
+        return e_.rows();
+      }
+
+      constexpr std::size_t cols() const noexcept
+      {
+        return e_.cols();
+      }
+
+      constexpr ElemType cgetf(const std::size_t i) const noexcept
+      {
+        return e_.cgetf(i) * scalar_;
+      }
+
+      constexpr bool Aliases(const void* ptr) const noexcept
+      {
+        return e_.Aliases(ptr);
+      }
+    };
+
+
+    // `e + shift * identity`
+    template <typename E>
+    class DiagShift : public MatrixExprTag
+    {
+      using Operand = Materialized<E>;
+
+
+    public:
+      using ElemType = typename Bare<E>::ElemType;
+
+      using PlainType = typename Bare<E>::PlainType;
+
+
+      static constexpr std::size_t kRows = Bare<E>::kRows;
+
+      static constexpr std::size_t kCols = Bare<E>::kCols;
+
+      static constexpr bool kIsLeaf = false;
+
+      static constexpr bool kLazyProduct = false;
+
+
+    private:
+      Operand e_;
+
+      ElemType shift_;
+
+
+    public:
+      constexpr DiagShift(E&& e, const ElemType shift)
+      : e_(std::forward<E>(e)), shift_(shift)
+      {
+        if constexpr (kRows == kDynamic) {
+          CheckShape(e_.rows() == e_.cols());
+        }
+      }
+
+
+      constexpr std::size_t rows() const noexcept
+      {
+        return e_.rows();
+      }
+
+      constexpr std::size_t cols() const noexcept
+      {
+        return e_.cols();
+      }
+
+      constexpr ElemType cgetf(const std::size_t i) const noexcept
+      {
+        return i % (e_.cols() + 1) == 0 ? e_.cgetf(i) + shift_ : e_.cgetf(i);
+      }
+
+      constexpr bool Aliases(const void* ptr) const noexcept
+      {
+        return e_.Aliases(ptr);
+      }
+    };
+
+
+    // `l + r` or `l - r`.  Product operands are kept lazy so that they can
+    // be accumulated into the destination by GEMM.
+    template <typename L, typename R, typename Op>
+    class Sum : public MatrixExprTag
+    {
+      using LOperand = Stored<L>;
+
+      using ROperand = Stored<R>;
+
+
+    public:
+      using ElemType = typename Bare<L>::ElemType;
+
+      using PlainType = typename Bare<L>::PlainType;
+
+
+      static constexpr std::size_t kRows = Bare<L>::kRows;
+
+      static constexpr std::size_t kCols = Bare<L>::kCols;
+
+      static constexpr bool kIsLeaf = false;
+
+      static constexpr bool kLazyProduct = (
+        Bare<L>::kLazyProduct || Bare<R>::kLazyProduct
+      );
+
+
+    private:
+      LOperand l_;
+
+      ROperand r_;
+
+
+    public:
+      constexpr Sum(L&& l, R&& r)
+      : l_(std::forward<L>(l)), r_(std::forward<R>(r))
+      {
+        CheckSameShape(l_, r_);
+      }
+
+
+      constexpr std::size_t rows() const noexcept
+      {
+        return l_.rows();
+      }
+
+      constexpr std::size_t cols() const noexcept
+      {
+        return l_.cols();
+      }
+
+      static constexpr ElemType Sign() noexcept
+      {
+        return std::is_same_v<Op, std::plus<>> ? ElemType(1) : ElemType(-1);
+      }
+
+      constexpr const LOperand& lhs() const noexcept
+      {
+        return l_;
+      }
+
+      constexpr const ROperand& rhs() const noexcept
+      {
+        return r_;
+      }
+
+      constexpr ElemType cgetf(const std::size_t i) const noexcept
+        requires (!kLazyProduct)
+      {
+        return Op()(l_.cgetf(i), r_.cgetf(i));
+      }
+
+      constexpr bool Aliases(const void* ptr) const noexcept
+      {
+        return l_.Aliases(ptr) || r_.Aliases(ptr);
+      }
+    };
+
+
+    template <typename L, typename R>
+    class Product : public MatrixExprTag
+    {
+      using LOperand = Evaluated<L>;
+
+      using ROperand = Evaluated<R>;
+
+
+    public:
+      using ElemType = typename Bare<L>::ElemType;
+
+      static constexpr std::size_t kRows = Bare<L>::kRows;
+
+      static constexpr std::size_t kCols = Bare<R>::kCols;
+
+      using PlainType = typename Bare<L>::PlainType::template Resized<
+        kRows, kCols
+      >;
+
+
+      static constexpr bool kIsLeaf = false;
+
+      static constexpr bool kLazyProduct = true;
+
+      static constexpr bool kIsSmall = (
+        kRows != kDynamic && kCols != kDynamic && Bare<L>::kCols != kDynamic
+        && kRows * Bare<L>::kCols * kCols < gemm::kBlockedThreshold
+      );
+
+
+    private:
+      LOperand l_;
+
+      ROperand r_;
+
+
+    public:
+      constexpr Product(L&& l, R&& r)
+      : l_(std::forward<L>(l)), r_(std::forward<R>(r))
+      {
+        if constexpr (Bare<L>::kCols == kDynamic) {
+          CheckShape(l_.cols() == r_.rows());
+        }
+      }
+
+
+      constexpr std::size_t rows() const noexcept
+      {
+        return l_.rows();
+      }
+
+      constexpr std::size_t cols() const noexcept
+      {
+        return r_.cols();
+      }
+
+      constexpr bool Aliases(const void* ptr) const noexcept
+      {
+        return l_.Aliases(ptr) || r_.Aliases(ptr);
+      }
+
+
+      // dst += alpha * l * r
+      constexpr void AddTo(ElemType* dst, const ElemType alpha) const
+      {
+        using Acc = Accumulator<ElemType>;
+
+        const std::size_t inner = l_.cols();
+        if (std::is_constant_evaluated()) {
+          for (std::size_t i = 0; i < rows(); ++i) {
+            for (std::size_t k = 0; k < inner; ++k) {
+              const ElemType a_ik = alpha * l_.cgetf(i * inner + k);
+              for (std::size_t j = 0; j < cols(); ++j) {
+                dst[i * cols() + j] += a_ik * r_.cgetf(k * cols() + j);
+              }
+            }
+          }
+        } else if constexpr (!std::is_same_v<Acc, ElemType> && kIsSmall) {
+          Acc acc[kRows * kCols] = {};
+          gemm::MultiplySmall(
+            rows(), cols(), inner, Acc(alpha),
+            l_.data(), inner, r_.data(), cols(), acc, cols()
+          );
+          for (std::size_t i = 0; i < kRows * kCols; ++i) {
+            dst[i] += ElemType(acc[i]);
+          }
+        } else if constexpr (!std::is_same_v<Acc, ElemType>) {
+          gemm::MultiplyWidened<Acc>(
+            rows(), cols(), inner, alpha,
+            l_.data(), inner, r_.data(), cols(), dst, cols()
+          );
+        } else if constexpr (kIsSmall) {
+          gemm::MultiplySmall(
+            rows(), cols(), inner, alpha,
+            l_.data(), inner, r_.data(), cols(), dst, cols()
+          );
+        } else {
+          gemm::Multiply(
+            rows(), cols(), inner, alpha,
+            l_.data(), inner, r_.data(), cols(), dst, cols()
+          );
+        }
+      }
+    };
+
+
+    template <typename E>
+    struct IsSum : std::false_type
+    {
+    };
+
+    template <typename L, typename R, typename Op>
+    struct IsSum<Sum<L, R, Op>> : std::true_type
+    {
+    };
+
+    template <typename E>
+    struct IsProduct : std::false_type
+    {
+    };
+
+    template <typename L, typename R>
+    struct IsProduct<Product<L, R>> : std::true_type
+    {
+    };
+
+
+    // Element-wise loops over at least this many elements are split into
+    // chunks of kParallelGrain over the global thread pool, when one is set.
+    inline constexpr std::size_t kParallelThreshold = 1 << 16;
+
+    inline constexpr std::size_t kParallelGrain = 1 << 14;
+
+
+    // Calls `body(lo, hi)` over [0, size).  Fixed shapes below the
+    // threshold never look at the pool.
+    template <typename E, typename F>
+    void ForRange(const std::size_t size, const F& body)
+    {
+      if constexpr (
+        E::kRows != kDynamic && E::kCols != kDynamic
+        && E::kRows * E::kCols < kParallelThreshold
+      ) {
+        body(std::size_t(0), size);
+      } else {
+        utils::ParallelForIfLarge(
+          size, kParallelThreshold, kParallelGrain, body
+        );
+      }
+    }
+
+
+    // Plain matrix of type P whose storage is left to be overwritten.
+    template <typename P>
+    P MakePlain(const std::size_t rows, const std::size_t cols)
+    {
+      if constexpr (P::kRows == kDynamic || P::kCols == kDynamic) {
+        return P(rows, cols, kUninitialized);
+      } else {
+        return P(kUninitialized);
+      }
+    }
+
+    // Deep copy of a plain matrix, including the move-only ones.
+    template <typename P>
+    P Copy(const P& mat)
+    {
+      P result = MakePlain<P>(mat.rows(), mat.cols());
+      std::copy_n(mat.data(), mat.rows() * mat.cols(), result.data());
+      return result;
+    }
+
+
+    template <typename E>
+    constexpr void AddTo(
+      typename E::ElemType* dst, const E& e, const typename E::ElemType alpha
+    );
+
+
+    // dst = e.  In constant evaluation the loops run serially.
+    template <typename E>
+    constexpr void Assign(typename E::ElemType* dst, const E& e)
+    {
+      using Elem = typename E::ElemType;
+
+      const std::size_t size = e.rows() * e.cols();
+      if constexpr (IsProduct<E>::value) {
+        std::fill(dst, dst + size, Elem(0));
+        e.AddTo(dst, Elem(1));
+      } else if constexpr (IsSum<E>::value && E::kLazyProduct) {
+        Assign(dst, e.lhs());
+        AddTo(dst, e.rhs(), E::Sign());
+      } else if (std::is_constant_evaluated()) {
+        for (std::size_t i = 0; i < size; ++i) {
+          dst[i] = e.cgetf(i);
+        }
+      } else {
+        ForRange<E>(size,
+          [dst, &e](const std::size_t lo, const std::size_t hi) {
+            for (std::size_t i = lo; i < hi; ++i) {
+              dst[i] = e.cgetf(i);
+            }
+          }
+        );
+      }
+    }
+
+
+    // dst += alpha * e
+    template <typename E>
+    constexpr void AddTo(
+      typename E::ElemType* dst, const E& e, const typename E::ElemType alpha
+    )
+    {
+      const std::size_t size = e.rows() * e.cols();
+      if constexpr (IsProduct<E>::value) {
+        e.AddTo(dst, alpha);
+      } else if constexpr (IsSum<E>::value && E::kLazyProduct) {
+        AddTo(dst, e.lhs(), alpha);
+        AddTo(dst, e.rhs(), alpha * E::Sign());
+      } else if (std::is_constant_evaluated()) {
+        for (std::size_t i = 0; i < size; ++i) {
+          dst[i] += alpha * e.cgetf(i);
+        }
+      } else {
+        ForRange<E>(size,
+          [dst, &e, alpha](const std::size_t lo, const std::size_t hi) {
+            for (std::size_t i = lo; i < hi; ++i) {
+              dst[i] += alpha * e.cgetf(i);
+            }
+          }
+        );
+      }
+    }
+  }
+
+
+  template <MatrixExpression E>
+  constexpr auto operator-(E&& e)
+  {
+    return expr::Negate<E>(std::forward<E>(e));
+  }
+
+
+  template <MatrixExpression L, MatrixExpression R>
+    requires expr::SameShape<L, R>
+  constexpr auto operator+(L&& l, R&& r)
+  {
+    return expr::Sum<L, R, std::plus<>>(std::forward<L>(l), std::forward<R>(r));
+  }
+
+  template <MatrixExpression L, MatrixExpression R>
+    requires expr::SameShape<L, R>
+  constexpr auto operator-(L&& l, R&& r)
+  {
+    return expr::Sum<L, R, std::minus<>>(
+      std::forward<L>(l), std::forward<R>(r)
+    );
+  }
+
+
+  template <MatrixExpression E>
+    requires expr::Square<E>
+  constexpr auto operator+(
+    E&& e, const typename expr::Bare<E>::ElemType rh
+  )
+  {
+    return expr::DiagShift<E>(std::forward<E>(e), rh);
+  }
+
+  template <MatrixExpression E>
+    requires expr::Square<E>
+  constexpr auto operator+(
+    const typename expr::Bare<E>::ElemType lh, E&& e
+  )
+  {
+    return expr::DiagShift<E>(std::forward<E>(e), lh);
+  }
+
+  template <MatrixExpression E>
+    requires expr::Square<E>
+  constexpr auto operator-(
+    E&& e, const typename expr::Bare<E>::ElemType rh
+  )
+  {
+    return expr::DiagShift<E>(std::forward<E>(e), -rh);
+  }
+
+  template <MatrixExpression E>
+    requires expr::Square<E>
+  constexpr auto operator-(
+    const typename expr::Bare<E>::ElemType lh, E&& e
+  )
+  {
+    return expr::DiagShift<expr::Negate<E>>(-std::forward<E>(e), lh);
+  }
+
+
+  template <MatrixExpression E>
+  constexpr auto operator*(
+    E&& e, const typename expr::Bare<E>::ElemType rh
+  )
+  {
+    return expr::Scale<E>(std::forward<E>(e), rh);
+  }
+
+  template <MatrixExpression E>
+  constexpr auto operator*(
+    const typename expr::Bare<E>::ElemType lh, E&& e
+  )
+  {
+    return expr::Scale<E>(std::forward<E>(e), lh);
+  }
+
+  template <MatrixExpression L, MatrixExpression R>
+    requires expr::Conformable<L, R>
+  constexpr auto operator*(L&& l, R&& r)
+  {
+    return expr::Product<L, R>(std::forward<L>(l), std::forward<R>(r));
+  }
+}
+
+
+
+#endif // CXXMATRIXEXPR_H
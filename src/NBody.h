@@ -0,0 +1,499 @@
+#ifndef CXXNBODY_H
+#define CXXNBODY_H
+
+#include <algorithm>
+#include <cmath>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "ThreadPool.h"
+#include "Vector3.h"
+#include "phys.h"
+
+
+
+namespace csp::math
+{
+  // Couplings k of the pair force F_i = k q_i q_j (r_i - r_j) / |r_i - r_j|^3
+  // in SI units: charges in coulombs, or masses in kilograms for gravity.
+  inline constexpr double kCoulomb = 1. / (4. * u::pi * u::epsilon_0);
+
+  inline constexpr double kGravity = -u::G;
+
+
+  namespace detail
+  {
+    inline void CheckParticles(const bool is_valid)
+    {
+      if (!is_valid) {
+        throw std::invalid_argument("N-body particle count mismatch");
+      }
+    }
+
+    // Particles per parallel batch and chunk.
+    inline constexpr std::size_t kParticleThreshold = 1 << 9;
+
+    inline constexpr std::size_t kParticleGrain = 1 << 6;
+
+    // Field q d / (|d|^2 + softening2)^(3/2) of a point source at -d.
+    template <std::floating_point T>
+    Vector3<T> PointField(
+      const Vector3<T>& d, const T q, const T softening2
+    ) noexcept
+    {
+      const T r2 = d.norm2() + softening2;
+      if (r2 == T(0)) {
+        return {};
+      }
+      const T inv = T(1) / std::sqrt(r2);
+      return d * (q * inv * inv * inv);
+    }
+
+    // Spreads the low 21 bits of `v` to every third bit.
+    constexpr std::uint64_t SpreadBits(std::uint64_t v) noexcept
+    {
+      v &= 0x1fffff;
+      v = (v | v << 32) & 0x001f00000000ffff;
+      v = (v | v << 16) & 0x001f0000ff0000ff;
+      v = (v | v << 8) & 0x100f00f00f00f00f;
+      v = (v | v << 4) & 0x10c30c30c30c30c3;
+      v = (v | v << 2) & 0x1249249249249249;
+      return v;
+    }
+  }
+
+
+  // F_i = coupling q_i sum_{j != i} q_j (r_i - r_j) / |r_i - r_j|^3, summed
+  // directly in O(N^2).  The reference for BarnesHut.
+  template <std::floating_point T>
+  void DirectForces(
+    std::span<const Vector3<T>> positions, std::span<const T> charges,
+    const T coupling, const T softening, std::span<Vector3<T>> forces
+  )
+  {
+    const std::size_t n = positions.size();
+    detail::CheckParticles(charges.size() == n && forces.size() >= n);
+    const T softening2 = softening * softening;
+    utils::ParallelForIfLarge(
+      n, detail::kParticleThreshold, detail::kParticleGrain,
+      [&](const std::size_t lo, const std::size_t hi) {
+        for (std::size_t i = lo; i < hi; ++i) {
+          Vector3<T> field;
+          for (std::size_t j = 0; j < n; ++j) {
+            if (j != i) {
+              field += detail::PointField(
+                positions[i] - positions[j], charges[j], softening2
+              );
+            }
+          }
+          forces[i] = field * (coupling * charges[i]);
+        }
+      }
+    );
+  }
+
+
+  // Barnes-Hut evaluation of the pair forces of DirectForces in
+  // O(N log N).
+  //
+  // Particles are sorted by the Morton code of their position, so every
+  // octree cell owns a contiguous range of them.  Cells are stored in
+  // depth-first order with a skip link to the next cell outside their
+  // subtree: a traversal is a forward walk over one array, either
+  // descending into a cell or jumping over it.
+  //
+  // A cell is replaced by its monopole and dipole moments about its center
+  // of |charge| when it is farther than size / theta + delta, with delta
+  // the offset of that center from the middle of the cell.  The dipole
+  // term keeps the error small for charges of both signs.  theta = 0
+  // opens every cell and reproduces the direct sum.
+  template <std::floating_point T>
+  class BarnesHut
+  {
+  public:
+    static constexpr std::size_t kLeafSize = 8;
+
+    // Morton code bits per axis, and so the maximum depth.
+    static constexpr std::size_t kLevels = 21;
+
+    // Particles from which the top-level subtrees are built in parallel.
+    static constexpr std::size_t kParallelBuild = 1 << 12;
+
+
+  private:
+    struct Node
+    {
+      Vector3<T> center_;
+      Vector3<T> dipole_;
+      T charge_;
+      T abs_charge_;
+      T size_;
+      T delta_;
+      std::size_t begin_;
+      std::size_t end_;
+      // First cell after the subtree; the first child is the next cell.
+      std::size_t next_;
+      bool is_leaf_;
+    };
+
+
+    T theta_;
+
+    T coupling_;
+
+    T softening2_;
+
+    // Particles in Morton order, and their index in the input.
+    std::vector<Vector3<T>> positions_;
+
+    std::vector<T> charges_;
+
+    std::vector<std::size_t> order_;
+
+    std::vector<std::uint64_t> codes_;
+
+    std::vector<Node> nodes_;
+
+
+    // Monopole and dipole of a cell from its children, or from its
+    // particles for a leaf.
+    void Fit(
+      Node& node, const Vector3<T>& middle, std::span<const Node> children
+    ) const noexcept
+    {
+      T charge = 0;
+      T abs_charge = 0;
+      Vector3<T> weighted;
+      if (node.is_leaf_) {
+        for (std::size_t s = node.begin_; s < node.end_; ++s) {
+          charge += charges_[s];
+          abs_charge += std::abs(charges_[s]);
+          weighted += positions_[s] * std::abs(charges_[s]);
+        }
+      } else {
+        for (const Node& child : children) {
+          charge += child.charge_;
+          abs_charge += child.abs_charge_;
+          weighted += child.center_ * child.abs_charge_;
+        }
+      }
+      node.charge_ = charge;
+      node.abs_charge_ = abs_charge;
+      node.center_ = abs_charge > T(0) ? weighted / abs_charge : middle;
+
+      Vector3<T> dipole;
+      if (node.is_leaf_) {
+        for (std::size_t s = node.begin_; s < node.end_; ++s) {
+          dipole += (positions_[s] - node.center_) * charges_[s];
+        }
+      } else {
+        for (const Node& child : children) {
+          dipole += child.dipole_
+            + (child.center_ - node.center_) * child.charge_;
+        }
+      }
+      node.dipole_ = dipole;
+      node.delta_ = (node.center_ - middle).norm();
+    }
+
+    // Appends the cell of particles [begin, end), which share their Morton
+    // code above `level`, and its subtree to `nodes`.
+    void BuildCell(
+      std::vector<Node>& nodes, const std::size_t begin, const std::size_t end,
+      const std::size_t level, const Vector3<T>& corner, const T size
+    ) const
+    {
+      const std::size_t index = nodes.size();
+      nodes.push_back({});
+      nodes[index].begin_ = begin;
+      nodes[index].end_ = end;
+      nodes[index].size_ = size;
+      nodes[index].is_leaf_ = end - begin <= kLeafSize || level == kLevels;
+      const Vector3<T> middle = corner + Vector3<T>(size, size, size) / T(2);
+
+      std::size_t children[8];
+      std::size_t count = 0;
+      if (!nodes[index].is_leaf_) {
+        const std::size_t shift = 3 * (kLevels - 1 - level);
+        std::size_t lo = begin;
+        for (std::uint64_t octant = 0; octant < 8 && lo < end; ++octant) {
+          const std::size_t hi = std::partition_point(
+            codes_.begin() + lo, codes_.begin() + end,
+            [&](const std::uint64_t code) {
+              return (code >> shift & 7) <= octant;
+            }
+          ) - codes_.begin();
+          if (hi > lo) {
+            children[count++] = nodes.size();
+            BuildCell(
+              nodes, lo, hi, level + 1, Octant(corner, size, octant), size / 2
+            );
+          }
+          lo = hi;
+        }
+      }
+      FitChildren(
+        nodes, index, middle, std::span<const std::size_t>(children, count)
+      );
+    }
+
+    void FitChildren(
+      std::vector<Node>& nodes, const std::size_t index,
+      const Vector3<T>& middle, std::span<const std::size_t> children
+    ) const
+    {
+      Node children_nodes[8];
+      for (std::size_t c = 0; c < children.size(); ++c) {
+        children_nodes[c] = nodes[children[c]];
+      }
+      Fit(
+        nodes[index], middle,
+        std::span<const Node>(children_nodes, children.size())
+      );
+      nodes[index].next_ = nodes.size();
+    }
+
+    static Vector3<T> Octant(
+      const Vector3<T>& corner, const T size, const std::uint64_t octant
+    ) noexcept
+    {
+      const T half = size / 2;
+      return corner + Vector3<T>(
+        octant & 4 ? half : T(0), octant & 2 ? half : T(0),
+        octant & 1 ? half : T(0)
+      );
+    }
+
+    // Field at `point`, leaving out the particle in Morton slot `self`.
+    Vector3<T> FieldAt(
+      const Vector3<T>& point, const std::size_t self
+    ) const noexcept
+    {
+      const T inv_theta = theta_ > T(0)
+        ? T(1) / theta_ : std::numeric_limits<T>::infinity();
+      Vector3<T> field;
+      std::size_t k = 0;
+      while (k < nodes_.size()) {
+        const Node& node = nodes_[k];
+        const Vector3<T> d = point - node.center_;
+        const T d2 = d.norm2();
+        const T open = node.size_ * inv_theta + node.delta_;
+        if (d2 > open * open) {
+          // E = Q d / r^3 + 3 (p . d) d / r^5 - p / r^3
+          const T r2 = d2 + softening2_;
+          const T inv = T(1) / std::sqrt(r2);
+          const T inv3 = inv * inv * inv;
+          const T pd = node.dipole_.dot(d);
+          field += d * (inv3 * (node.charge_ + T(3) * pd / r2))
+            - node.dipole_ * inv3;
+        } else if (node.is_leaf_) {
+          for (std::size_t s = node.begin_; s < node.end_; ++s) {
+            if (s != self) {
+              field += detail::PointField(
+                point - positions_[s], charges_[s], softening2_
+              );
+            }
+          }
+        } else {
+          ++k;
+          continue;
+        }
+        k = node.next_;
+      }
+      return field;
+    }
+
+
+  public:
+    // `theta` in [0, 1]; smaller is more accurate.
+    BarnesHut(const T theta, const T coupling, const T softening = 0)
+    : coupling_(coupling), softening2_(softening * softening)
+    {
+      SetOpeningAngle(theta);
+    }
+
+    ~BarnesHut() = default;
+
+    BarnesHut(const BarnesHut& rh) = default;
+
+    BarnesHut(BarnesHut&& rh) = default;
+
+    BarnesHut& operator=(const BarnesHut& rh) = default;
+
+    BarnesHut& operator=(BarnesHut&& rh) = default;
+
+
+    // Takes effect without a rebuild.
+    void SetOpeningAngle(const T theta)
+    {
+      if (!(theta >= T(0) && theta <= T(1))) {
+        throw std::invalid_argument("opening angle must be in [0, 1]");
+      }
+      theta_ = theta;
+    }
+
+    T get_opening_angle() const noexcept
+    {
+      return theta_;
+    }
+
+    std::size_t size() const noexcept
+    {
+      return positions_.size();
+    }
+
+    // Number of octree cells.
+    std::size_t nodes() const noexcept
+    {
+      return nodes_.size();
+    }
+
+
+    // Builds the octree over the particles.  With the global thread pool
+    // and enough particles, the eight top-level subtrees are built in
+    // parallel and spliced behind the root.
+    void Build(
+      std::span<const Vector3<T>> positions, std::span<const T> charges
+    )
+    {
+      const std::size_t n = positions.size();
+      detail::CheckParticles(charges.size() == n);
+      positions_.resize(n);
+      charges_.resize(n);
+      order_.resize(n);
+      codes_.resize(n);
+      nodes_.clear();
+      if (n == 0) {
+        return;
+      }
+
+      Vector3<T> lower = positions[0];
+      Vector3<T> upper = positions[0];
+      for (const Vector3<T>& p : positions) {
+        lower = {
+          std::min(lower.x_, p.x_), std::min(lower.y_, p.y_),
+          std::min(lower.z_, p.z_)
+        };
+        upper = {
+          std::max(upper.x_, p.x_), std::max(upper.y_, p.y_),
+          std::max(upper.z_, p.z_)
+        };
+      }
+      const Vector3<T> extent = upper - lower;
+      T size = std::max({extent.x_, extent.y_, extent.z_});
+      size = size > T(0) ? size * (T(1) + T(1e-6)) : T(1);
+      const T scale = T(std::uint64_t(1) << kLevels) / size;
+      const auto quantize = [&](const T value) {
+        return std::min<std::uint64_t>(
+          (std::uint64_t(1) << kLevels) - 1,
+          static_cast<std::uint64_t>(value * scale)
+        );
+      };
+
+      std::vector<std::pair<std::uint64_t, std::size_t>> keys(n);
+      utils::ParallelForIfLarge(
+        n, detail::kParticleThreshold, detail::kParticleGrain,
+        [&](const std::size_t lo, const std::size_t hi) {
+          for (std::size_t i = lo; i < hi; ++i) {
+            const Vector3<T> p = positions[i] - lower;
+            keys[i] = {
+              detail::SpreadBits(quantize(p.x_)) << 2
+                | detail::SpreadBits(quantize(p.y_)) << 1
+                | detail::SpreadBits(quantize(p.z_)),
+              i
+            };
+          }
+        }
+      );
+      std::sort(keys.begin(), keys.end());
+      for (std::size_t s = 0; s < n; ++s) {
+        codes_[s] = keys[s].first;
+        order_[s] = keys[s].second;
+        positions_[s] = positions[order_[s]];
+        charges_[s] = charges[order_[s]];
+      }
+
+      utils::ThreadPool* const pool = utils::GlobalThreadPool();
+      if (pool == nullptr || n < kParallelBuild) {
+        BuildCell(nodes_, 0, n, 0, lower, size);
+        return;
+      }
+
+      // Octant ranges of the root, then one subtree per octant.
+      std::size_t bounds[9] = {};
+      const std::size_t shift = 3 * (kLevels - 1);
+      for (std::uint64_t octant = 0; octant < 8; ++octant) {
+        bounds[octant + 1] = std::partition_point(
+          codes_.begin() + bounds[octant], codes_.end(),
+          [&](const std::uint64_t code) { return (code >> shift) <= octant; }
+        ) - codes_.begin();
+      }
+      std::vector<Node> subtrees[8];
+      pool->ParallelFor(0, 8, 1,
+        [&](const std::size_t lo, const std::size_t hi) {
+          for (std::size_t octant = lo; octant < hi; ++octant) {
+            if (bounds[octant + 1] > bounds[octant]) {
+              BuildCell(
+                subtrees[octant], bounds[octant], bounds[octant + 1], 1,
+                Octant(lower, size, octant), size / 2
+              );
+            }
+          }
+        }
+      );
+
+      nodes_.push_back({});
+      nodes_[0].begin_ = 0;
+      nodes_[0].end_ = n;
+      nodes_[0].size_ = size;
+      nodes_[0].is_leaf_ = false;
+      std::vector<std::size_t> children;
+      for (std::vector<Node>& subtree : subtrees) {
+        if (subtree.empty()) {
+          continue;
+        }
+        const std::size_t offset = nodes_.size();
+        children.push_back(offset);
+        for (Node& node : subtree) {
+          node.next_ += offset;
+        }
+        nodes_.insert(nodes_.end(), subtree.begin(), subtree.end());
+      }
+      FitChildren(
+        nodes_, 0, lower + Vector3<T>(size, size, size) / T(2), children
+      );
+    }
+
+    // The force on every particle, in the order given to Build.
+    void Forces(std::span<Vector3<T>> forces) const
+    {
+      detail::CheckParticles(forces.size() >= size());
+      utils::ParallelForIfLarge(
+        size(), detail::kParticleThreshold, detail::kParticleGrain,
+        [&](const std::size_t lo, const std::size_t hi) {
+          for (std::size_t s = lo; s < hi; ++s) {
+            forces[order_[s]] = FieldAt(positions_[s], s)
+              * (coupling_ * charges_[s]);
+          }
+        }
+      );
+    }
+
+    // sum_j q_j (point - r_j) / |point - r_j|^3 over all particles, the
+    // force on a unit test charge divided by the coupling.
+    Vector3<T> Field(const Vector3<T>& point) const noexcept
+    {
+      return FieldAt(point, size());
+    }
+  };
+}
+
+
+
+#endif // CXXNBODY_H
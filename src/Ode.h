@@ -0,0 +1,578 @@
+#ifndef CXXODE_H
+#define CXXODE_H
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <concepts>
+#include <cstddef>
+#include <span>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "MatrixBatch.h"
+#include "MatrixExpr.h"
+#include "ThreadPool.h"
+#include "Vector3.h"
+#include "Vector3Array.h"
+
+
+
+namespace csp::math
+{
+  // How the integrators below see a state: as a few contiguous arrays of
+  // scalars (`Parts`).  Stage buffers are copies of the initial state, and
+  // every update is an elementwise loop over the parts, so a step does no
+  // allocation and vectorizes for the array states.
+  //
+  // A state holding many independent systems (a Vector3Array of particles,
+  // a MatrixBatch, a std::vector) advances them in lockstep.
+  template <typename S>
+  struct StateTraits;
+
+
+  template <std::floating_point T>
+  struct StateTraits<Vector3<T>>
+  {
+    using Elem = T;
+
+    static std::array<std::span<T>, 3> Parts(Vector3<T>& s) noexcept
+    {
+      return {
+        std::span<T>(&s.x_, 1), std::span<T>(&s.y_, 1),
+        std::span<T>(&s.z_, 1)
+      };
+    }
+
+    static std::array<std::span<const T>, 3> Parts(const Vector3<T>& s)
+      noexcept
+    {
+      return {
+        std::span<const T>(&s.x_, 1), std::span<const T>(&s.y_, 1),
+        std::span<const T>(&s.z_, 1)
+      };
+    }
+  };
+
+
+  template <std::floating_point T>
+  struct StateTraits<Vector3Array<T>>
+  {
+    using Elem = T;
+
+    static std::array<std::span<T>, 3> Parts(Vector3Array<T>& s) noexcept
+    {
+      return {s.get_x(), s.get_y(), s.get_z()};
+    }
+
+    static std::array<std::span<const T>, 3> Parts(
+      const Vector3Array<T>& s
+    ) noexcept
+    {
+      return {s.get_x(), s.get_y(), s.get_z()};
+    }
+  };
+
+
+  // Matrix and DynMatrix.
+  template <typename S>
+    requires MatrixExpression<S> && S::kIsLeaf
+  struct StateTraits<S>
+  {
+    using Elem = typename S::ElemType;
+
+    static std::array<std::span<Elem>, 1> Parts(S& s) noexcept
+    {
+      return {std::span<Elem>(s.data(), s.rows() * s.cols())};
+    }
+
+    static std::array<std::span<const Elem>, 1> Parts(const S& s) noexcept
+    {
+      return {std::span<const Elem>(s.data(), s.rows() * s.cols())};
+    }
+  };
+
+
+  template <MatrixElement Elem_, typename Alloc>
+  struct StateTraits<std::vector<Elem_, Alloc>>
+  {
+    using Elem = Elem_;
+
+    static std::array<std::span<Elem>, 1> Parts(
+      std::vector<Elem, Alloc>& s
+    ) noexcept
+    {
+      return {std::span<Elem>(s)};
+    }
+
+    static std::array<std::span<const Elem>, 1> Parts(
+      const std::vector<Elem, Alloc>& s
+    ) noexcept
+    {
+      return {std::span<const Elem>(s)};
+    }
+  };
+
+
+  // One part per coefficient stream.
+  template <MatrixElement Elem_, std::size_t kRow, std::size_t kCol>
+  struct StateTraits<MatrixBatch<Elem_, kRow, kCol>>
+  {
+    using Elem = Elem_;
+
+    using Batch = MatrixBatch<Elem, kRow, kCol>;
+
+    static std::array<std::span<Elem>, kRow * kCol> Parts(Batch& s) noexcept
+    {
+      std::array<std::span<Elem>, kRow * kCol> parts;
+      for (std::size_t e = 0; e < kRow * kCol; ++e) {
+        parts[e] = {s.data(e / kCol, e % kCol), s.size()};
+      }
+      return parts;
+    }
+
+    static std::array<std::span<const Elem>, kRow * kCol> Parts(
+      const Batch& s
+    ) noexcept
+    {
+      std::array<std::span<const Elem>, kRow * kCol> parts;
+      for (std::size_t e = 0; e < kRow * kCol; ++e) {
+        parts[e] = {s.data(e / kCol, e % kCol), s.size()};
+      }
+      return parts;
+    }
+  };
+
+
+  template <typename S>
+  concept OdeState = requires (S& s, const S& cs) {
+    typename StateTraits<S>::Elem;
+    StateTraits<S>::Parts(s);
+    StateTraits<S>::Parts(cs);
+  };
+
+
+  namespace detail
+  {
+    template <OdeState S>
+    using StateElem = typename StateTraits<S>::Elem;
+
+    // Time and step type: T for real and std::complex<T> states.
+    template <OdeState S>
+    using StateReal = decltype(std::abs(StateElem<S>()));
+
+
+    // A state of the same shape, to serve as a stage buffer.
+    template <OdeState S>
+    S CloneState(const S& s)
+    {
+      if constexpr (std::copy_constructible<S>) {
+        return s;
+      } else if constexpr (requires { s.Clone(); }) {
+        return s.Clone();
+      } else {
+        return expr::Copy(s);
+      }
+    }
+
+    // out = base + h sum_j c[j] k[j].  `out` may be `base`.
+    template <OdeState S, std::size_t kStages>
+    void Combine(
+      S& out, const S& base, const StateReal<S> h,
+      const std::array<StateReal<S>, kStages>& c,
+      const std::array<const S*, kStages>& k
+    )
+    {
+      using Elem = StateElem<S>;
+
+      const auto dst = StateTraits<S>::Parts(out);
+      const auto src = StateTraits<S>::Parts(base);
+      for (std::size_t p = 0; p < dst.size(); ++p) {
+        std::array<const Elem*, kStages> stages;
+        std::array<Elem, kStages> weights;
+        for (std::size_t j = 0; j < kStages; ++j) {
+          stages[j] = StateTraits<S>::Parts(*k[j])[p].data();
+          weights[j] = Elem(h * c[j]);
+        }
+        Elem* o = dst[p].data();
+        const Elem* b = src[p].data();
+        utils::ParallelForIfLarge(
+          dst[p].size(), expr::kParallelThreshold, expr::kParallelGrain,
+          [=](const std::size_t lo, const std::size_t hi) {
+            for (std::size_t i = lo; i < hi; ++i) {
+              Elem sum = weights[0] * stages[0][i];
+              for (std::size_t j = 1; j < kStages; ++j) {
+                sum += weights[j] * stages[j][i];
+              }
+              o[i] = b[i] + sum;
+            }
+          }
+        );
+      }
+    }
+
+    template <OdeState S>
+    void CopyState(const S& src, S& dst)
+    {
+      const auto from = StateTraits<S>::Parts(src);
+      const auto to = StateTraits<S>::Parts(dst);
+      for (std::size_t p = 0; p < from.size(); ++p) {
+        std::copy(from[p].begin(), from[p].end(), to[p].begin());
+      }
+    }
+  }
+
+
+  // Classical fixed-step fourth-order Runge-Kutta for y' = f(t, y).  The
+  // right-hand side is called as f(t, y, dydt) and writes into dydt.
+  template <OdeState S>
+  class Rk4
+  {
+    using Real = detail::StateReal<S>;
+
+
+  private:
+    S k1_;
+
+    S k2_;
+
+    S k3_;
+
+    S k4_;
+
+    S stage_;
+
+
+  public:
+    // Stage buffers take the shape of `shape`.
+    explicit Rk4(const S& shape)
+    : k1_(detail::CloneState(shape)),
+      k2_(detail::CloneState(shape)),
+      k3_(detail::CloneState(shape)),
+      k4_(detail::CloneState(shape)),
+      stage_(detail::CloneState(shape))
+    {
+    }
+
+    ~Rk4() = default;
+
+    Rk4(const Rk4& rh) = delete;
+
+    Rk4(Rk4&& rh) = default;
+
+    Rk4& operator=(const Rk4& rh) = delete;
+
+    Rk4& operator=(Rk4&& rh) = default;
+
+
+    // Advances y from t to t + h.
+    template <typename F>
+    void Step(const F& f, Real& t, S& y, const Real h)
+    {
+      const Real half = h / Real(2);
+      f(t, std::as_const(y), k1_);
+      detail::Combine<S, 1>(stage_, y, half, {Real(1)}, {&k1_});
+      f(t + half, std::as_const(stage_), k2_);
+      detail::Combine<S, 1>(stage_, y, half, {Real(1)}, {&k2_});
+      f(t + half, std::as_const(stage_), k3_);
+      detail::Combine<S, 1>(stage_, y, h, {Real(1)}, {&k3_});
+      f(t + h, std::as_const(stage_), k4_);
+      detail::Combine<S, 4>(
+        y, y, h,
+        {Real(1) / Real(6), Real(1) / Real(3), Real(1) / Real(3),
+          Real(1) / Real(6)},
+        {&k1_, &k2_, &k3_, &k4_}
+      );
+      t += h;
+    }
+
+    // `steps` steps of size h.
+    template <typename F>
+    void Integrate(
+      const F& f, Real& t, S& y, const Real h, const std::size_t steps
+    )
+    {
+      for (std::size_t n = 0; n < steps; ++n) {
+        Step(f, t, y, h);
+      }
+    }
+  };
+
+
+  // Adaptive Dormand-Prince 5(4) for y' = f(t, y), with f called as in
+  // Rk4.  The fifth-order solution is propagated, and the embedded
+  // fourth-order one estimates the error.  A step is accepted when
+  //   max_i |err_i| / (atol + rtol max(|y_i|, |y_new_i|)) <= 1,
+  // so a state of many systems is stepped at the pace of the hardest one.
+  template <OdeState S>
+  class DormandPrince
+  {
+    using Real = detail::StateReal<S>;
+
+
+    static constexpr std::array<Real, 6> kC = {
+      Real(1) / 5, Real(3) / 10, Real(4) / 5, Real(8) / 9, Real(1), Real(1)
+    };
+
+    static constexpr std::array<Real, 1> kA2 = {Real(1) / 5};
+
+    static constexpr std::array<Real, 2> kA3 = {Real(3) / 40, Real(9) / 40};
+
+    static constexpr std::array<Real, 3> kA4 = {
+      Real(44) / 45, Real(-56) / 15, Real(32) / 9
+    };
+
+    static constexpr std::array<Real, 4> kA5 = {
+      Real(19372) / 6561, Real(-25360) / 2187, Real(64448) / 6561,
+      Real(-212) / 729
+    };
+
+    static constexpr std::array<Real, 5> kA6 = {
+      Real(9017) / 3168, Real(-355) / 33, Real(46732) / 5247,
+      Real(49) / 176, Real(-5103) / 18656
+    };
+
+    // Fifth-order weights; k2 has weight 0 and is left out.
+    static constexpr std::array<Real, 5> kB = {
+      Real(35) / 384, Real(500) / 1113, Real(125) / 192,
+      Real(-2187) / 6784, Real(11) / 84
+    };
+
+    // Fifth minus fourth-order weights, without k2.
+    static constexpr std::array<Real, 6> kE = {
+      Real(71) / 57600, Real(-71) / 16695, Real(71) / 1920,
+      Real(-17253) / 339200, Real(22) / 525, Real(-1) / 40
+    };
+
+
+  private:
+    std::array<S, 7> k_;
+
+    S stage_;
+
+    Real atol_;
+
+    Real rtol_;
+
+
+    std::array<S, 7> MakeStages(const S& shape)
+    {
+      return {
+        detail::CloneState(shape), detail::CloneState(shape),
+        detail::CloneState(shape), detail::CloneState(shape),
+        detail::CloneState(shape), detail::CloneState(shape),
+        detail::CloneState(shape)
+      };
+    }
+
+    Real ErrorNorm(const S& y, const Real h) const
+    {
+      using Elem = detail::StateElem<S>;
+
+      const auto old = StateTraits<S>::Parts(y);
+      const auto next = StateTraits<S>::Parts(stage_);
+      std::array<const Elem*, 6> k;
+      Real result = 0;
+      for (std::size_t p = 0; p < old.size(); ++p) {
+        std::size_t j = 0;
+        for (const std::size_t stage : {0, 2, 3, 4, 5, 6}) {
+          k[j++] = StateTraits<S>::Parts(k_[stage])[p].data();
+        }
+        for (std::size_t i = 0; i < old[p].size(); ++i) {
+          Elem err = kE[0] * k[0][i];
+          for (std::size_t s = 1; s < 6; ++s) {
+            err += kE[s] * k[s][i];
+          }
+          const Real scale = atol_
+            + rtol_ * std::max(std::abs(old[p][i]), std::abs(next[p][i]));
+          result = std::max(result, std::abs(h * err) / scale);
+        }
+      }
+      return result;
+    }
+
+    // One attempt from (t, y) with k_[0] = f(t, y).  On success y and t
+    // move to the new point and k_[0] holds f there (first same as last).
+    // h becomes the next step size either way.
+    template <typename F>
+    bool Attempt(const F& f, Real& t, S& y, Real& h)
+    {
+      using detail::Combine;
+
+      Combine<S, 1>(stage_, y, h, kA2, {&k_[0]});
+      f(t + kC[0] * h, std::as_const(stage_), k_[1]);
+      Combine<S, 2>(stage_, y, h, kA3, {&k_[0], &k_[1]});
+      f(t + kC[1] * h, std::as_const(stage_), k_[2]);
+      Combine<S, 3>(stage_, y, h, kA4, {&k_[0], &k_[1], &k_[2]});
+      f(t + kC[2] * h, std::as_const(stage_), k_[3]);
+      Combine<S, 4>(stage_, y, h, kA5, {&k_[0], &k_[1], &k_[2], &k_[3]});
+      f(t + kC[3] * h, std::as_const(stage_), k_[4]);
+      Combine<S, 5>(
+        stage_, y, h, kA6, {&k_[0], &k_[1], &k_[2], &k_[3], &k_[4]}
+      );
+      f(t + kC[4] * h, std::as_const(stage_), k_[5]);
+      Combine<S, 5>(
+        stage_, y, h, kB, {&k_[0], &k_[2], &k_[3], &k_[4], &k_[5]}
+      );
+      f(t + h, std::as_const(stage_), k_[6]);
+
+      const Real err = ErrorNorm(y, h);
+      const bool is_accepted = err <= Real(1);
+      // Standard controller: safety 0.9, factor in [0.2, 5], and no growth
+      // right after a rejection.
+      Real factor = err > Real(0)
+        ? Real(0.9) * std::pow(err, Real(-0.2)) : Real(5);
+      factor = std::clamp(factor, Real(0.2), is_accepted ? Real(5) : Real(1));
+      if (is_accepted) {
+        t += h;
+        detail::CopyState(stage_, y);
+        std::swap(k_[0], k_[6]);
+      }
+      h *= factor;
+      return is_accepted;
+    }
+
+
+  public:
+    // Stage buffers take the shape of `shape`.
+    DormandPrince(const S& shape, const Real atol, const Real rtol)
+    : k_(MakeStages(shape)),
+      stage_(detail::CloneState(shape)),
+      atol_(atol),
+      rtol_(rtol)
+    {
+      if (!(atol > Real(0) || rtol > Real(0))) {
+        throw std::invalid_argument("DormandPrince needs a tolerance");
+      }
+    }
+
+    ~DormandPrince() = default;
+
+    DormandPrince(const DormandPrince& rh) = delete;
+
+    DormandPrince(DormandPrince&& rh) = default;
+
+    DormandPrince& operator=(const DormandPrince& rh) = delete;
+
+    DormandPrince& operator=(DormandPrince&& rh) = default;
+
+
+    // One attempted step of size h.  Returns whether it was accepted; if
+    // so t and y have advanced.  h is updated to the suggested next size.
+    template <typename F>
+    bool Step(const F& f, Real& t, S& y, Real& h)
+    {
+      f(t, std::as_const(y), k_[0]);
+      return Attempt(f, t, y, h);
+    }
+
+    // Integrates forward from t to t_end, starting with step size h and
+    // leaving in h the size suggested for a next call.  Returns the number
+    // of accepted steps.
+    template <typename F>
+    std::size_t Integrate(
+      const F& f, Real& t, S& y, const Real t_end, Real& h
+    )
+    {
+      if (!(h > Real(0)) || t_end < t) {
+        throw std::invalid_argument("DormandPrince integrates forward");
+      }
+      f(t, std::as_const(y), k_[0]);
+      std::size_t steps = 0;
+      while (t < t_end) {
+        const bool is_last = t + h >= t_end;
+        Real step = is_last ? t_end - t : h;
+        if (t + step == t) {
+          throw std::runtime_error("DormandPrince step size underflow");
+        }
+        if (Attempt(f, t, y, step)) {
+          ++steps;
+          if (is_last) {
+            t = t_end;
+            break;
+          }
+        }
+        h = is_last ? std::min(h, step) : step;
+      }
+      return steps;
+    }
+  };
+
+
+  // Symplectic velocity Verlet for x'' = a(t, x), e.g. a Vector3Array of
+  // particle positions.  The acceleration is called as a(t, x, accel).
+  // The acceleration at the current positions is kept between steps, so
+  // each step costs one evaluation; call Reset after changing x outside
+  // of Step.
+  template <OdeState S>
+  class VelocityVerlet
+  {
+    using Real = detail::StateReal<S>;
+
+
+  private:
+    S accel_;
+
+    bool is_primed_;
+
+
+  public:
+    explicit VelocityVerlet(const S& shape)
+    : accel_(detail::CloneState(shape)), is_primed_(false)
+    {
+    }
+
+    ~VelocityVerlet() = default;
+
+    VelocityVerlet(const VelocityVerlet& rh) = delete;
+
+    VelocityVerlet(VelocityVerlet&& rh) = default;
+
+    VelocityVerlet& operator=(const VelocityVerlet& rh) = delete;
+
+    VelocityVerlet& operator=(VelocityVerlet&& rh) = default;
+
+
+    void Reset() noexcept
+    {
+      is_primed_ = false;
+    }
+
+    const S& get_acceleration() const noexcept
+    {
+      return accel_;
+    }
+
+
+    // Advances positions x and velocities v from t to t + h.
+    template <typename F>
+    void Step(const F& a, Real& t, S& x, S& v, const Real h)
+    {
+      if (!is_primed_) {
+        a(t, std::as_const(x), accel_);
+        is_primed_ = true;
+      }
+      const Real half = h / Real(2);
+      detail::Combine<S, 1>(v, v, half, {Real(1)}, {&accel_});
+      detail::Combine<S, 1>(x, x, h, {Real(1)}, {&v});
+      t += h;
+      a(t, std::as_const(x), accel_);
+      detail::Combine<S, 1>(v, v, half, {Real(1)}, {&accel_});
+    }
+
+    template <typename F>
+    void Integrate(
+      const F& a, Real& t, S& x, S& v, const Real h, const std::size_t steps
+    )
+    {
+      for (std::size_t n = 0; n < steps; ++n) {
+        Step(a, t, x, v, h);
+      }
+    }
+  };
+}
+
+
+
+#endif // CXXODE_H
@@ -0,0 +1,150 @@
+#ifndef CXXPALETTE_H
+#define CXXPALETTE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "Color.h"
+#include "ColorConvert.h"
+
+
+
+namespace csp::utils
+{
+  // Colors of Color::GenerateColor for one base color.  The base's
+  // detail::ColorOrbit is built once; each index then costs one rotation
+  // and the conversion to RGB.  Results are identical to
+  // base.GenerateColor(number).
+  class Palette
+  {
+    Color base_;
+
+    detail::ColorOrbit orbit_;
+
+
+  public:
+    explicit Palette(const Color& base)
+    : base_(base), orbit_(base.to_hsv())
+    {
+    }
+
+    ~Palette() = default;
+
+    Palette(const Palette& rh) = default;
+
+    Palette(Palette&& rh) = default;
+
+    Palette& operator=(const Palette& rh) = default;
+
+    Palette& operator=(Palette&& rh) = default;
+
+
+    const Color& get_base() const noexcept
+    {
+      return base_;
+    }
+
+    // base.GenerateColor(number)
+    Color get(const int number) const
+    {
+      return Color(orbit_.At(number));
+    }
+
+    // out[k] = base.GenerateColor(first + k).  The HSV points are built a
+    // block at a time and converted together by the batch HSV kernel.
+    void Generate(std::span<Color> out, const int first = 0) const
+    {
+      Hsv hsv[detail::kColorBlock];
+      for (std::size_t i = 0; i < out.size(); i += detail::kColorBlock) {
+        const std::size_t n = std::min(detail::kColorBlock, out.size() - i);
+        for (std::size_t k = 0; k < n; ++k) {
+          const auto [h, s, v] = orbit_.At(first + static_cast<int>(i + k));
+          hsv[k] = {h, s, v};
+        }
+        detail::ToRgbBlock(hsv, out.data() + i, n);
+      }
+    }
+
+    std::vector<Color> Generate(const std::size_t count) const
+    {
+      std::vector<Color> result(count);
+      Generate(result);
+      return result;
+    }
+  };
+
+
+  // Palettes keyed by base color and length, generated on first request
+  // and shared afterwards.  Safe to use from several threads.
+  class PaletteCache
+  {
+    using Key = std::pair<std::uint32_t, std::size_t>;
+
+    using Colors = std::shared_ptr<const std::vector<Color>>;
+
+
+  private:
+    mutable std::mutex mutex_;
+
+    std::map<Key, Colors> palettes_;
+
+
+  public:
+    PaletteCache() = default;
+
+    ~PaletteCache() = default;
+
+    PaletteCache(const PaletteCache& rh) = delete;
+
+    PaletteCache(PaletteCache&& rh) = delete;
+
+    PaletteCache& operator=(const PaletteCache& rh) = delete;
+
+    PaletteCache& operator=(PaletteCache&& rh) = delete;
+
+
+    // base.GenerateColor(k) for k in [0, count).  A miss generates outside
+    // the lock; if another thread stored the same palette meanwhile, that
+    // one is returned.
+    Colors get(const Color& base, const std::size_t count)
+    {
+      const Key key(base.to_hex(), count);
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        const auto it = palettes_.find(key);
+        if (it != palettes_.end()) {
+          return it->second;
+        }
+      }
+
+      Colors colors = std::make_shared<const std::vector<Color>>(
+        Palette(base).Generate(count)
+      );
+      std::lock_guard<std::mutex> lock(mutex_);
+      return palettes_.try_emplace(key, std::move(colors)).first->second;
+    }
+
+    std::size_t size() const
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      return palettes_.size();
+    }
+
+    void Clear()
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      palettes_.clear();
+    }
+  };
+}
+
+
+
+#endif // CXXPALETTE_H
@@ -1,16 +1,27 @@
 #ifndef CXXTIME_H
 #define CXXTIME_H
 
+#include <algorithm>
 #include <atomic>
 #include <chrono>
 #include <cmath>
 #include <concepts>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
 #include <ctime>
+#include <deque>
+#include <functional>
 #include <iomanip>
 #include <iostream>
+#include <iterator>
+#include <memory>
 #include <mutex>
 #include <sstream>
+#include <string>
+#include <thread>
 #include <type_traits>
+#include <utility>
 
 
 
@@ -28,26 +39,103 @@ namespace csp::time
   }
 
 
-  template <std::integral T>
-  class ProgressBar
+  namespace detail
   {
-    using steady_clock = std::chrono::steady_clock;
-    using time_point = std::chrono::time_point<steady_clock>;
+    inline constexpr std::size_t kProgressShards = 64;
 
+    inline constexpr std::size_t kCacheLine = 64;
 
-  private:
-    const T total_;
-    const T step_;
-    const int bar_width_;
 
-    std::atomic<T> progress_;
+    // Index of the calling thread, in order of first use.
+    inline std::size_t ThreadSlot() noexcept
+    {
+      static std::atomic<std::size_t> next_slot(0);
+      thread_local const std::size_t slot = next_slot.fetch_add(
+        1, std::memory_order_relaxed
+      );
+      return slot;
+    }
 
-    const time_point start_time_;
 
-    std::mutex io_mutex_;
+    // Time constant of the rate average: samples older than this weigh
+    // e^-1 of the newest.
+    inline constexpr double kRateTimeConstant = 2.;
+
+
+    // Exponentially weighted rate of a growing amount.  Samples come at
+    // uneven intervals, so each is weighted by 1 - e^(-dt / tau).
+    class RateMeter
+    {
+      double rate_;
+
+      double last_amount_;
+
+      double last_seconds_;
+
+      bool is_primed_;
+
+
+    public:
+      RateMeter() noexcept
+      : rate_(0.), last_amount_(0.), last_seconds_(0.), is_primed_(false)
+      {
+      }
+
+      ~RateMeter() = default;
+
+      RateMeter(const RateMeter& rh) = default;
+
+      RateMeter(RateMeter&& rh) = default;
+
+      RateMeter& operator=(const RateMeter& rh) = default;
 
+      RateMeter& operator=(RateMeter&& rh) = default;
 
-    static std::string DurationPrint(
+
+      // `amount` reached `seconds` after the start.
+      void Update(const double amount, const double seconds) noexcept
+      {
+        const double dt = seconds - last_seconds_;
+        if (dt <= 0.) {
+          return;
+        }
+        const double sample = (amount - last_amount_) / dt;
+        const double weight = is_primed_
+          ? 1. - std::exp(-dt / kRateTimeConstant) : 1.;
+        rate_ += weight * (sample - rate_);
+        last_amount_ = amount;
+        last_seconds_ = seconds;
+        is_primed_ = true;
+      }
+
+      double get_rate() const noexcept
+      {
+        return rate_;
+      }
+    };
+
+
+    // 1234567. -> "1.23M", with three significant digits.
+    inline std::string SiPrint(const double value)
+    {
+      static constexpr const char* kPrefixes[] = {"", "k", "M", "G", "T", "P"};
+
+      double scaled = value;
+      std::size_t prefix = 0;
+      while (std::abs(scaled) >= 999.5 && prefix + 1 < std::size(kPrefixes)) {
+        scaled /= 1000.;
+        ++prefix;
+      }
+      std::stringstream ss;
+      const int precision = std::abs(scaled) < 9.995 ? 2
+        : std::abs(scaled) < 99.95 ? 1 : 0;
+      ss << std::fixed
+         << std::setprecision(prefix == 0 ? 0 : precision)
+         << scaled << kPrefixes[prefix];
+      return ss.str();
+    }
+
+    inline std::string DurationPrint(
       const std::chrono::duration<double>& duration
     ) noexcept
     {
@@ -84,25 +172,219 @@ namespace csp::time
       }
       return ss.str();
     }
+  }
+
+
+  // Count shared by many threads, behind ProgressBar and the tasks of a
+  // ProgressGroup.  Counts land in cache-line-padded shards, so
+  // incrementing never locks or formats; the render side sums them and
+  // keeps exponentially weighted rates for the ETA, items/s and, once any
+  // bytes are reported, bytes/s.
+  template <std::integral T>
+  class ProgressCounter
+  {
+    using steady_clock = std::chrono::steady_clock;
+    using time_point = std::chrono::time_point<steady_clock>;
+
+    struct alignas(detail::kCacheLine) Shard
+    {
+      std::atomic<T> count{0};
+      std::atomic<std::uint64_t> bytes{0};
+    };
 
-    static std::string DurationPrint(const time_point& time) noexcept
+    struct Counts
     {
-      return DurationPrint(steady_clock::now() - time);
+      T items;
+      std::uint64_t bytes;
+    };
+
+
+  public:
+    // Counter for one thread, on a shard of its own: with a single
+    // writer, an increment is a relaxed load and store, i.e. a plain add.
+    class Local
+    {
+      Shard* shard_;
+
+
+    public:
+      explicit Local(Shard& shard) noexcept
+      : shard_(&shard)
+      {
+      }
+
+      ~Local() = default;
+
+      Local(const Local& rh) = delete;
+
+      Local(Local&& rh) = default;
+
+      Local& operator=(const Local& rh) = delete;
+
+      Local& operator=(Local&& rh) = default;
+
+
+      void operator++() noexcept
+      {
+        *this += 1;
+      }
+
+      void operator+=(const T count) noexcept
+      {
+        std::atomic<T>& shard = shard_->count;
+        shard.store(
+          shard.load(std::memory_order_relaxed) + count,
+          std::memory_order_relaxed
+        );
+      }
+
+      void AddBytes(const std::uint64_t bytes) noexcept
+      {
+        std::atomic<std::uint64_t>& shard = shard_->bytes;
+        shard.store(
+          shard.load(std::memory_order_relaxed) + bytes,
+          std::memory_order_relaxed
+        );
+      }
+    };
+
+
+  private:
+    const T total_;
+
+    const time_point start_time_;
+
+    // Shared by threads counting through the counter itself.
+    std::unique_ptr<Shard[]> shards_;
+
+    mutable std::mutex locals_mutex_;
+    std::deque<Shard> locals_;
+
+    // Render side only.
+    detail::RateMeter item_rate_;
+    detail::RateMeter byte_rate_;
+    double done_seconds_;
+
+
+    Counts Sum() const
+    {
+      Counts sum{0, 0};
+      const auto add = [&sum](const Shard& shard) {
+        sum.items += shard.count.load(std::memory_order_relaxed);
+        sum.bytes += shard.bytes.load(std::memory_order_relaxed);
+      };
+      for (std::size_t i = 0; i < detail::kProgressShards; ++i) {
+        add(shards_[i]);
+      }
+      std::lock_guard<std::mutex> lock(locals_mutex_);
+      for (const Shard& shard : locals_) {
+        add(shard);
+      }
+      return sum;
     }
 
-    void Draw(const T progress) const noexcept
+
+  public:
+    explicit ProgressCounter(const T total)
+    : total_(total),
+      start_time_(steady_clock::now()),
+      shards_(std::make_unique<Shard[]>(detail::kProgressShards)),
+      done_seconds_(-1.)
     {
-      std::lock_guard<std::mutex> lock(io_mutex_);
+    }
+
+    ~ProgressCounter() = default;
+
+    ProgressCounter(const ProgressCounter& rh) = delete;
+
+    ProgressCounter(ProgressCounter&& rh) = delete;
+
+    ProgressCounter& operator=(const ProgressCounter& rh) = delete;
+
+    ProgressCounter& operator=(ProgressCounter&& rh) = delete;
+
+
+    // One relaxed add on the calling thread's shard.  Shards are shared
+    // only past kProgressShards threads.
+    void operator++() noexcept
+    {
+      *this += 1;
+    }
+
+    void operator+=(const T count) noexcept
+    {
+      const std::size_t shard = detail::ThreadSlot() % detail::kProgressShards;
+      shards_[shard].count.fetch_add(count, std::memory_order_relaxed);
+    }
+
+    // Bytes processed, for the bytes/s display of I/O jobs.
+    void AddBytes(const std::uint64_t bytes) noexcept
+    {
+      const std::size_t shard = detail::ThreadSlot() % detail::kProgressShards;
+      shards_[shard].bytes.fetch_add(bytes, std::memory_order_relaxed);
+    }
+
+    // Counter for the calling thread alone; it must not outlive this one.
+    Local MakeLocal()
+    {
+      std::lock_guard<std::mutex> lock(locals_mutex_);
+      return Local(locals_.emplace_back());
+    }
+
+    T get_total() const noexcept
+    {
+      return total_;
+    }
+
+    // Sum over the shards; counts still being added may be missed.
+    T get_progress() const
+    {
+      return Sum().items;
+    }
+
+    std::uint64_t get_bytes() const
+    {
+      return Sum().bytes;
+    }
+
+
+    // Status line, for the render side only.  While running, rates are
+    // the weighted averages and the ETA divides the remaining count by
+    // the item rate.  A final line, or one drawn once the count reached
+    // the total, shows the averages over the run up to that point.
+    std::string Line(const int bar_width, const bool is_final)
+    {
+      const Counts counts = Sum();
+      const T progress = counts.items;
+      const double fraction = total_ > 0
+        ? std::min(1., static_cast<double>(progress) / total_) : 1.;
+      double seconds = std::chrono::duration<double>(
+        steady_clock::now() - start_time_
+      ).count();
+      if (progress >= total_ && done_seconds_ < 0.) {
+        done_seconds_ = seconds;
+      }
+      const bool is_done = is_final || done_seconds_ >= 0.;
+      if (done_seconds_ >= 0.) {
+        seconds = done_seconds_;
+      }
+
+      item_rate_.Update(static_cast<double>(progress), seconds);
+      byte_rate_.Update(static_cast<double>(counts.bytes), seconds);
+      const double items_per_second = is_done && seconds > 0.
+        ? progress / seconds : item_rate_.get_rate();
+      const double bytes_per_second = is_done && seconds > 0.
+        ? counts.bytes / seconds : byte_rate_.get_rate();
 
       std::stringstream ss;
       {
-        const int progress_width = bar_width_ * progress / total_;
+        const int progress_width = static_cast<int>(bar_width * fraction);
 
         ss << "[";
         for (int i = 0; i < progress_width; ++i) {
           ss << "#";
         }
-        for (int i = progress_width; i < bar_width_; ++i) {
+        for (int i = progress_width; i < bar_width; ++i) {
           ss << " ";
         }
         ss << "]";
@@ -110,38 +392,156 @@ namespace csp::time
 
       ss << std::setfill(' ')
          << std::setw(3)
-         << 100 * progress / total_
+         << static_cast<int>(100 * fraction)
          << "% ";
 
-      ss << DurationPrint(start_time_);
+      ss << detail::DurationPrint(std::chrono::duration<double>(seconds));
+
+      if (!is_done) {
+        ss << " ETA ";
+        if (items_per_second > 0.) {
+          const double remaining = static_cast<double>(total_ - progress);
+          ss << detail::DurationPrint(
+            std::chrono::duration<double>(remaining / items_per_second)
+          );
+        } else {
+          ss << "--";
+        }
+      }
 
-      if (progress == total_) {
-        std::cout << ss.str() << std::endl;
-      } else {
-        std::cout << ss.str() << "\r";
-        std::cout.flush();
+      ss << " " << detail::SiPrint(items_per_second) << " it/s";
+      if (counts.bytes > 0) {
+        ss << " " << detail::SiPrint(bytes_per_second) << "B/s";
       }
+      return ss.str();
     }
+  };
+
+
+  namespace detail
+  {
+    // Thread calling draw(false) every `refresh` until it is destroyed; the
+    // destructor then stops it and calls draw(true) once.  Declared as the
+    // last member of its owner, so it starts after and stops before
+    // everything the callback reads.
+    class RenderThread
+    {
+      const std::function<void(bool)> draw_;
+
+      const std::chrono::milliseconds refresh_;
+
+      std::mutex mutex_;
+      std::condition_variable cv_;
+      bool is_stopped_;
+
+      std::thread thread_;
+
+
+      void Run()
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!cv_.wait_for(lock, refresh_, [this] { return is_stopped_; })) {
+          lock.unlock();
+          draw_(false);
+          lock.lock();
+        }
+      }
 
 
+    public:
+      RenderThread(
+        std::function<void(bool)> draw,
+        const std::chrono::milliseconds refresh
+      )
+      : draw_(std::move(draw)),
+        refresh_(refresh),
+        is_stopped_(false),
+        thread_([this] { Run(); })
+      {
+      }
+
+      ~RenderThread()
+      {
+        {
+          std::lock_guard<std::mutex> lock(mutex_);
+          is_stopped_ = true;
+        }
+        cv_.notify_one();
+        thread_.join();
+        draw_(true);
+      }
+
+      RenderThread(const RenderThread& rh) = delete;
+
+      RenderThread(RenderThread&& rh) = delete;
+
+      RenderThread& operator=(const RenderThread& rh) = delete;
+
+      RenderThread& operator=(RenderThread&& rh) = delete;
+    };
+  }
+
+
+  // Single progress bar counted from many threads.  A render thread
+  // redraws it in place at a fixed rate, so counting threads never lock
+  // or format.
+  template <std::integral T>
+  class ProgressBar
+  {
   public:
-    ProgressBar(const T total, const int bar_width = 70) noexcept
-    : total_(total),
-      step_(std::max<T>(1, total_ / 100)),
-      bar_width_(bar_width),
-      progress_(0),
-      start_time_(steady_clock::now())
+    using Local = typename ProgressCounter<T>::Local;
+
+
+  private:
+    ProgressCounter<T> counter_;
+
+    const int bar_width_;
+
+    std::ostream& os_;
+
+    // Render side only.
+    std::size_t line_width_;
+
+    detail::RenderThread renderer_;
+
+
+    // Render side only: the render thread, then its final call.
+    void Draw(const bool is_final)
     {
+      // Blank out the rest of a longer previous line.
+      std::string line = counter_.Line(bar_width_, is_final);
+      const std::size_t width = line.size();
+      line.resize(std::max(width, line_width_), ' ');
+      line_width_ = width;
+
+      if (is_final) {
+        os_ << line << std::endl;
+      } else {
+        os_ << line << "\r";
+        os_.flush();
+      }
     }
 
-    ~ProgressBar() noexcept
+
+
+  public:
+    ProgressBar(
+      const T total,
+      const int bar_width = 70,
+      const std::chrono::milliseconds refresh = std::chrono::milliseconds(100),
+      std::ostream& os = std::cout
+    )
+    : counter_(total),
+      bar_width_(bar_width),
+      os_(os),
+      line_width_(0),
+      renderer_([this](const bool is_final) { Draw(is_final); }, refresh)
     {
-      if (progress_ < total_) {
-        progress_ = total_;
-        Draw();
-      }
     }
 
+    // Stops the render thread and draws the final count.
+    ~ProgressBar() = default;
+
     ProgressBar(const ProgressBar& rh) = delete;
 
     ProgressBar(ProgressBar&& rh) = delete;
@@ -153,31 +553,38 @@ namespace csp::time
 
     void operator++() noexcept
     {
-      T progress = progress_.fetch_add(1) + 1;
+      ++counter_;
+    }
 
-      if (progress == 1) {
-        {
-          std::lock_guard<std::mutex> lock(io_mutex_);
-          std::cout
-            << "Estimated time : "
-            << DurationPrint((steady_clock::now() - start_time_) * total_)
-            << std::endl;
-        }
-        Draw(progress);
+    void operator+=(const T count) noexcept
+    {
+      counter_ += count;
+    }
 
-      } else if (progress % step_ == 0 || progress == total_) {
-        Draw(progress);
-      }
+    void AddBytes(const std::uint64_t bytes) noexcept
+    {
+      counter_.AddBytes(bytes);
+    }
+
+    // Counter for the calling thread alone; it must not outlive the bar.
+    Local MakeLocal()
+    {
+      return counter_.MakeLocal();
     }
 
     T get_total() const noexcept
     {
-      return total_;
+      return counter_.get_total();
+    }
+
+    T get_progress() const
+    {
+      return counter_.get_progress();
     }
 
-    T get_progress() const noexcept
+    std::uint64_t get_bytes() const
     {
-      return progress_.load();
+      return counter_.get_bytes();
     }
   };
 }
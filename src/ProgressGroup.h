@@ -0,0 +1,235 @@
+#ifndef CXXPROGRESSGROUP_H
+#define CXXPROGRESSGROUP_H
+
+#include <algorithm>
+#include <chrono>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "ProgressBar.h"
+
+
+
+namespace csp::time
+{
+  // Named progress bars for stages running at once, nested as tasks and
+  // sub-tasks and drawn together in one terminal region.  A render thread
+  // redraws the region at a fixed rate, moving the cursor back to its top
+  // with ANSI escapes.  Each task counts on its own sharded counter, so an
+  // increment costs the same however many bars are live.
+  template <std::integral T>
+  class ProgressGroup
+  {
+  public:
+    class Task
+    {
+      friend class ProgressGroup;
+
+
+      ProgressGroup* group_;
+
+      const std::string name_;
+
+      const std::size_t depth_;
+
+      ProgressCounter<T> counter_;
+
+
+    public:
+      using Local = typename ProgressCounter<T>::Local;
+
+
+      Task(
+        ProgressGroup& group,
+        std::string name,
+        const std::size_t depth,
+        const T total
+      )
+      : group_(&group), name_(std::move(name)), depth_(depth), counter_(total)
+      {
+      }
+
+      ~Task() = default;
+
+      Task(const Task& rh) = delete;
+
+      Task(Task&& rh) = delete;
+
+      Task& operator=(const Task& rh) = delete;
+
+      Task& operator=(Task&& rh) = delete;
+
+
+      void operator++() noexcept
+      {
+        ++counter_;
+      }
+
+      void operator+=(const T count) noexcept
+      {
+        counter_ += count;
+      }
+
+      void AddBytes(const std::uint64_t bytes) noexcept
+      {
+        counter_.AddBytes(bytes);
+      }
+
+      // Counter for the calling thread alone; it must not outlive the
+      // group.
+      Local MakeLocal()
+      {
+        return counter_.MakeLocal();
+      }
+
+      // Task drawn below this one and its earlier sub-tasks, indented one
+      // level deeper.
+      Task& AddSubtask(std::string name, const T total)
+      {
+        return group_->Insert(this, std::move(name), total);
+      }
+
+      const std::string& get_name() const noexcept
+      {
+        return name_;
+      }
+
+      std::size_t get_depth() const noexcept
+      {
+        return depth_;
+      }
+
+      T get_total() const noexcept
+      {
+        return counter_.get_total();
+      }
+
+      T get_progress() const
+      {
+        return counter_.get_progress();
+      }
+
+      std::uint64_t get_bytes() const
+      {
+        return counter_.get_bytes();
+      }
+    };
+
+
+  private:
+    const int bar_width_;
+
+    std::ostream& os_;
+
+    // Tasks in creation order, which keeps their addresses, and in
+    // display order: each sub-task follows its parent's earlier ones.
+    mutable std::mutex tasks_mutex_;
+    std::deque<Task> tasks_;
+    std::vector<Task*> order_;
+
+    // Render side only.
+    std::size_t lines_drawn_;
+
+    detail::RenderThread renderer_;
+
+
+    Task& Insert(Task* parent, std::string name, const T total)
+    {
+      std::lock_guard<std::mutex> lock(tasks_mutex_);
+      const std::size_t depth = parent != nullptr ? parent->depth_ + 1 : 0;
+      Task& task = tasks_.emplace_back(*this, std::move(name), depth, total);
+
+      auto position = order_.end();
+      if (parent != nullptr) {
+        position = std::find(order_.begin(), order_.end(), parent) + 1;
+        while (
+          position != order_.end() && (*position)->depth_ > parent->depth_
+        ) {
+          ++position;
+        }
+      }
+      order_.insert(position, &task);
+      return task;
+    }
+
+    // Render side only: the render thread, then its final call.
+    // The whole region goes out in one write, every line cleared to its
+    // end, so the terminal never shows a half-drawn frame.
+    void Draw(const bool is_final)
+    {
+      std::string region;
+      if (lines_drawn_ > 0) {
+        region += "\x1b[" + std::to_string(lines_drawn_) + "A\r";
+      }
+
+      std::lock_guard<std::mutex> lock(tasks_mutex_);
+      std::size_t label_width = 0;
+      for (const Task* task : order_) {
+        label_width = std::max(
+          label_width, 2 * task->depth_ + task->name_.size()
+        );
+      }
+      for (Task* task : order_) {
+        std::string label(2 * task->depth_, ' ');
+        label += task->name_;
+        label.resize(label_width, ' ');
+        region += label + " " + task->counter_.Line(bar_width_, is_final);
+        region += "\x1b[K\n";
+      }
+      lines_drawn_ = order_.size();
+
+      os_ << region;
+      os_.flush();
+    }
+
+
+  public:
+    explicit ProgressGroup(
+      const int bar_width = 40,
+      const std::chrono::milliseconds refresh = std::chrono::milliseconds(100),
+      std::ostream& os = std::cout
+    )
+    : bar_width_(bar_width),
+      os_(os),
+      lines_drawn_(0),
+      renderer_([this](const bool is_final) { Draw(is_final); }, refresh)
+    {
+    }
+
+    // Stops the render thread and draws the final counts.
+    ~ProgressGroup() = default;
+
+    ProgressGroup(const ProgressGroup& rh) = delete;
+
+    ProgressGroup(ProgressGroup&& rh) = delete;
+
+    ProgressGroup& operator=(const ProgressGroup& rh) = delete;
+
+    ProgressGroup& operator=(ProgressGroup&& rh) = delete;
+
+
+    // Top-level task, drawn below the existing ones.  Safe to call while
+    // other tasks are counting.
+    Task& AddTask(std::string name, const T total)
+    {
+      return Insert(nullptr, std::move(name), total);
+    }
+
+    std::size_t size() const
+    {
+      std::lock_guard<std::mutex> lock(tasks_mutex_);
+      return tasks_.size();
+    }
+  };
+}
+
+
+
+#endif // CXXPROGRESSGROUP_H
@@ -0,0 +1,359 @@
+#ifndef CXXQUATERNION_H
+#define CXXQUATERNION_H
+
+#include <cmath>
+#include <concepts>
+#include <cstddef>
+#include <limits>
+#include <ostream>
+#include <span>
+
+#include "Matrix.h"
+#include "MatrixExpr.h"
+#include "ThreadPool.h"
+#include "Vector3.h"
+#include "Vector3Array.h"
+
+
+
+namespace csp::math
+{
+  namespace detail
+  {
+    // Rotated vectors per parallel batch and chunk: a rotation is nine
+    // multiply-adds, scaled against the element-wise loop constants.
+    inline constexpr std::size_t kRotateThreshold =
+      expr::kParallelThreshold / 9;
+
+    inline constexpr std::size_t kRotateGrain = expr::kParallelGrain / 9;
+  }
+
+
+  // w + x i + y j + z k.  Rotations are unit quaternions: the rotation by
+  // `angle` about the unit axis n is cos(angle / 2) + sin(angle / 2) n,
+  // and q p is the rotation p followed by q.  The rotating members assume
+  // a unit quaternion; the factories below return one.
+  template <std::floating_point T>
+  class Quaternion
+  {
+  public:
+    T w_ = T(1);
+    T x_{};
+    T y_{};
+    T z_{};
+
+
+    // The identity rotation.
+    constexpr Quaternion() = default;
+
+    constexpr Quaternion(const T w, const T x, const T y, const T z)
+    : w_(w), x_(x), y_(y), z_(z)
+    {
+    }
+
+    constexpr Quaternion(const T w, const Vector3<T>& vec)
+    : w_(w), x_(vec.x_), y_(vec.y_), z_(vec.z_)
+    {
+    }
+
+    ~Quaternion() = default;
+
+    Quaternion(const Quaternion& rh) = default;
+
+    Quaternion(Quaternion&& rh) = default;
+
+    Quaternion& operator=(const Quaternion& rh) = default;
+
+    Quaternion& operator=(Quaternion&& rh) = default;
+
+
+    // Rotation by `angle` radians about `axis`, which need not be unit.
+    static Quaternion FromAxisAngle(const Vector3<T>& axis, const T angle)
+    {
+      const Vector3<T> n = axis.normalize();
+      const T half = angle / T(2);
+      return {std::cos(half), n * std::sin(half)};
+    }
+
+    // Rotation of a proper orthogonal matrix (Shepperd's method: the
+    // largest of the four diagonal combinations is taken as the pivot).
+    static Quaternion FromMatrix(const Matrix<T, 3, 3>& mat)
+    {
+      const T m00 = mat.cgetf(0, 0);
+      const T m11 = mat.cgetf(1, 1);
+      const T m22 = mat.cgetf(2, 2);
+      const T trace = m00 + m11 + m22;
+
+      Quaternion q;
+      if (trace >= m00 && trace >= m11 && trace >= m22) {
+        const T s = std::sqrt(T(1) + trace) * T(2);
+        q = {
+          s / T(4),
+          (mat.cgetf(2, 1) - mat.cgetf(1, 2)) / s,
+          (mat.cgetf(0, 2) - mat.cgetf(2, 0)) / s,
+          (mat.cgetf(1, 0) - mat.cgetf(0, 1)) / s
+        };
+      } else if (m00 >= m11 && m00 >= m22) {
+        const T s = std::sqrt(T(1) + m00 - m11 - m22) * T(2);
+        q = {
+          (mat.cgetf(2, 1) - mat.cgetf(1, 2)) / s,
+          s / T(4),
+          (mat.cgetf(0, 1) + mat.cgetf(1, 0)) / s,
+          (mat.cgetf(0, 2) + mat.cgetf(2, 0)) / s
+        };
+      } else if (m11 >= m22) {
+        const T s = std::sqrt(T(1) + m11 - m00 - m22) * T(2);
+        q = {
+          (mat.cgetf(0, 2) - mat.cgetf(2, 0)) / s,
+          (mat.cgetf(0, 1) + mat.cgetf(1, 0)) / s,
+          s / T(4),
+          (mat.cgetf(1, 2) + mat.cgetf(2, 1)) / s
+        };
+      } else {
+        const T s = std::sqrt(T(1) + m22 - m00 - m11) * T(2);
+        q = {
+          (mat.cgetf(1, 0) - mat.cgetf(0, 1)) / s,
+          (mat.cgetf(0, 2) + mat.cgetf(2, 0)) / s,
+          (mat.cgetf(1, 2) + mat.cgetf(2, 1)) / s,
+          s / T(4)
+        };
+      }
+      return q.normalize();
+    }
+
+    // Shortest rotation taking the direction of `from` to that of `to`.
+    static Quaternion FromTwoVectors(
+      const Vector3<T>& from, const Vector3<T>& to
+    )
+    {
+      const Vector3<T> a = from.normalize();
+      const Vector3<T> b = to.normalize();
+      const T c = a.dot(b);
+      if (c < T(-1) + T(16) * std::numeric_limits<T>::epsilon()) {
+        // Antiparallel: half turn about any axis orthogonal to `a`.
+        Vector3<T> axis = a.cross({T(1), T(0), T(0)});
+        if (axis.norm2() < T(1e-6)) {
+          axis = a.cross({T(0), T(1), T(0)});
+        }
+        return {T(0), axis.normalize()};
+      }
+      return Quaternion(T(1) + c, a.cross(b)).normalize();
+    }
+
+
+    constexpr Quaternion& operator*=(const Quaternion& rh) noexcept
+    {
+      *this = *this * rh;
+      return *this;
+    }
+
+
+    constexpr bool operator==(const Quaternion& rh) const noexcept
+    {
+      return w_ == rh.w_ && x_ == rh.x_ && y_ == rh.y_ && z_ == rh.z_;
+    }
+
+    constexpr bool operator!=(const Quaternion& rh) const noexcept
+    {
+      return !(*this == rh);
+    }
+
+    // Hamilton product: the rotation rh followed by *this.
+    constexpr Quaternion operator*(const Quaternion& rh) const noexcept
+    {
+      return {
+        w_ * rh.w_ - x_ * rh.x_ - y_ * rh.y_ - z_ * rh.z_,
+        w_ * rh.x_ + x_ * rh.w_ + y_ * rh.z_ - z_ * rh.y_,
+        w_ * rh.y_ - x_ * rh.z_ + y_ * rh.w_ + z_ * rh.x_,
+        w_ * rh.z_ + x_ * rh.y_ - y_ * rh.x_ + z_ * rh.w_
+      };
+    }
+
+    constexpr Quaternion operator-() const noexcept
+    {
+      return {-w_, -x_, -y_, -z_};
+    }
+
+
+    constexpr Vector3<T> get_vector() const noexcept
+    {
+      return {x_, y_, z_};
+    }
+
+    // Rotation angle in [0, 2 pi].
+    T get_angle() const
+    {
+      return T(2) * std::atan2(get_vector().norm(), w_);
+    }
+
+    // Unit rotation axis, zero for the identity.
+    Vector3<T> get_axis() const
+    {
+      return get_vector().normalize();
+    }
+
+    constexpr T dot(const Quaternion& rh) const noexcept
+    {
+      return w_ * rh.w_ + x_ * rh.x_ + y_ * rh.y_ + z_ * rh.z_;
+    }
+
+    constexpr T norm2() const noexcept
+    {
+      return dot(*this);
+    }
+
+    T norm() const
+    {
+      return std::sqrt(norm2());
+    }
+
+    Quaternion normalize() const
+    {
+      const T n = norm();
+      return n != T(0) ? Quaternion(w_ / n, x_ / n, y_ / n, z_ / n) : *this;
+    }
+
+    constexpr Quaternion conjugate() const noexcept
+    {
+      return {w_, -x_, -y_, -z_};
+    }
+
+    // The inverse rotation, also for a non-unit quaternion.
+    constexpr Quaternion inverse() const
+    {
+      const T n2 = norm2();
+      return {w_ / n2, -x_ / n2, -y_ / n2, -z_ / n2};
+    }
+
+
+    // The 3x3 rotation matrix R, with R v == rotate(v).
+    constexpr Matrix<T, 3, 3> ToMatrix() const noexcept
+    {
+      const T xx = x_ * x_;
+      const T yy = y_ * y_;
+      const T zz = z_ * z_;
+      const T xy = x_ * y_;
+      const T xz = x_ * z_;
+      const T yz = y_ * z_;
+      const T wx = w_ * x_;
+      const T wy = w_ * y_;
+      const T wz = w_ * z_;
+
+      Matrix<T, 3, 3> mat(kUninitialized);
+      mat.getf(0, 0) = T(1) - T(2) * (yy + zz);
+      mat.getf(0, 1) = T(2) * (xy - wz);
+      mat.getf(0, 2) = T(2) * (xz + wy);
+      mat.getf(1, 0) = T(2) * (xy + wz);
+      mat.getf(1, 1) = T(1) - T(2) * (xx + zz);
+      mat.getf(1, 2) = T(2) * (yz - wx);
+      mat.getf(2, 0) = T(2) * (xz - wy);
+      mat.getf(2, 1) = T(2) * (yz + wx);
+      mat.getf(2, 2) = T(1) - T(2) * (xx + yy);
+      return mat;
+    }
+
+
+    // v + 2 w (u x v) + 2 u x (u x v), with u the vector part.
+    constexpr Vector3<T> rotate(const Vector3<T>& vec) const noexcept
+    {
+      const Vector3<T> u = get_vector();
+      const Vector3<T> t = u.cross(vec) * T(2);
+      return vec + t * w_ + u.cross(t);
+    }
+
+    // Rotates every vector in place.  The rotation matrix is built once,
+    // after which each vector costs nine multiply-adds; large batches are
+    // split over the global thread pool.
+    void rotate(std::span<Vector3<T>> vecs) const
+    {
+      const Matrix<T, 3, 3> mat = ToMatrix();
+      const T* r = mat.data();
+      const T r00 = r[0], r01 = r[1], r02 = r[2];
+      const T r10 = r[3], r11 = r[4], r12 = r[5];
+      const T r20 = r[6], r21 = r[7], r22 = r[8];
+      Vector3<T>* v = vecs.data();
+
+      utils::ParallelForIfLarge(
+        vecs.size(), detail::kRotateThreshold, detail::kRotateGrain,
+        [=](const std::size_t lo, const std::size_t hi) {
+          for (std::size_t i = lo; i < hi; ++i) {
+            const T x = v[i].x_;
+            const T y = v[i].y_;
+            const T z = v[i].z_;
+            v[i].x_ = r00 * x + r01 * y + r02 * z;
+            v[i].y_ = r10 * x + r11 * y + r12 * z;
+            v[i].z_ = r20 * x + r21 * y + r22 * z;
+          }
+        }
+      );
+    }
+
+    // Same for the structure-of-arrays layout, where the loop runs one
+    // vector per SIMD lane.
+    void rotate(Vector3Array<T>& vecs) const
+    {
+      const Matrix<T, 3, 3> mat = ToMatrix();
+      const T* r = mat.data();
+      const T r00 = r[0], r01 = r[1], r02 = r[2];
+      const T r10 = r[3], r11 = r[4], r12 = r[5];
+      const T r20 = r[6], r21 = r[7], r22 = r[8];
+      T* vx = vecs.get_x().data();
+      T* vy = vecs.get_y().data();
+      T* vz = vecs.get_z().data();
+
+      utils::ParallelForIfLarge(
+        vecs.size(), detail::kRotateThreshold, detail::kRotateGrain,
+        [=](const std::size_t lo, const std::size_t hi) {
+          for (std::size_t i = lo; i < hi; ++i) {
+            const T x = vx[i];
+            const T y = vy[i];
+            const T z = vz[i];
+            vx[i] = r00 * x + r01 * y + r02 * z;
+            vy[i] = r10 * x + r11 * y + r12 * z;
+            vz[i] = r20 * x + r21 * y + r22 * z;
+          }
+        }
+      );
+    }
+
+
+    friend std::ostream& operator<<(std::ostream& os, const Quaternion& q)
+    {
+      return os << '(' << q.w_ << ", " << q.x_ << ", " << q.y_ << ", "
+        << q.z_ << ')';
+    }
+  };
+
+
+  // Spherical linear interpolation between the unit rotations a (t = 0)
+  // and b (t = 1), along the shorter arc.
+  template <std::floating_point T>
+  Quaternion<T> Slerp(
+    const Quaternion<T>& a, Quaternion<T> b, const T t
+  )
+  {
+    T c = a.dot(b);
+    if (c < T(0)) {
+      b = -b;
+      c = -c;
+    }
+
+    T wa = T(1) - t;
+    T wb = t;
+    // Nearly equal rotations: sin(theta) underflows, interpolate linearly.
+    if (c < T(1) - T(64) * std::numeric_limits<T>::epsilon()) {
+      const T theta = std::acos(c);
+      const T s = std::sin(theta);
+      wa = std::sin(wa * theta) / s;
+      wb = std::sin(wb * theta) / s;
+    }
+    return Quaternion<T>(
+      wa * a.w_ + wb * b.w_, wa * a.x_ + wb * b.x_,
+      wa * a.y_ + wb * b.y_, wa * a.z_ + wb * b.z_
+    ).normalize();
+  }
+}
+
+
+
+#endif // CXXQUATERNION_H
@@ -0,0 +1,372 @@
+#ifndef CXXSPARSEMATRIX_H
+#define CXXSPARSEMATRIX_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include "DynMatrix.h"
+#include "Matrix.h"
+#include "MatrixExpr.h"
+#include "ThreadPool.h"
+
+
+
+namespace csp::math
+{
+  // Entry of a sparse matrix under assembly.
+  template <MatrixElement Elem>
+  struct Triplet
+  {
+    std::size_t row_;
+    std::size_t col_;
+    Elem value_;
+  };
+
+
+  // Sparse matrix in compressed sparse row (CSR) form: the nonzeros of row
+  // i are values_[row_offsets_[i], row_offsets_[i + 1]), with their column
+  // indices sorted ascending in col_indices_.  CSC storage of A is the CSR
+  // storage of A^T, see `Transpose`.
+  template <MatrixElement Elem>
+  class SparseMatrix
+  {
+  public:
+    using ElemType = Elem;
+
+
+    // Products over at least this many nonzeros are split by rows over the
+    // global thread pool, with about kParallelGrain nonzeros per task.
+    static constexpr std::size_t kParallelThreshold = 1 << 15;
+
+    static constexpr std::size_t kParallelGrain = 1 << 13;
+
+
+  private:
+    std::size_t rows_;
+
+    std::size_t cols_;
+
+    std::vector<std::size_t> row_offsets_;
+
+    std::vector<std::size_t> col_indices_;
+
+    std::vector<Elem> values_;
+
+
+    // Calls `body(lo, hi)` over row ranges holding about kParallelGrain
+    // units of work each, `work_per_nonzero` units per nonzero.  The ranges
+    // are cut at row_offsets_, so a dense row gets a task of its own while
+    // runs of sparse rows are grouped.
+    template <typename F>
+    void ForRows(const std::size_t work_per_nonzero, const F& body) const
+    {
+      const std::size_t grain = std::max<std::size_t>(
+        1, kParallelGrain / work_per_nonzero
+      );
+      const std::size_t chunks = (nonzeros() + grain - 1) / grain;
+      // First row whose nonzeros start at or after chunk `c`.
+      const auto row_at = [&](const std::size_t c) {
+        const auto first = row_offsets_.begin();
+        return static_cast<std::size_t>(
+          std::lower_bound(first, first + rows_, c * grain) - first
+        );
+      };
+      // Parallel from kParallelThreshold units of work on.
+      constexpr std::size_t kMinChunks = kParallelThreshold / kParallelGrain;
+      utils::ParallelForIfLarge(chunks, kMinChunks, 1,
+        [&](const std::size_t lo, const std::size_t hi) {
+          const std::size_t begin = lo == 0 ? 0 : row_at(lo);
+          const std::size_t end = hi == chunks ? rows_ : row_at(hi);
+          if (begin < end) {
+            body(begin, end);
+          }
+        }
+      );
+    }
+
+
+  public:
+    SparseMatrix() noexcept
+    : rows_(0), cols_(0), row_offsets_(1, 0)
+    {
+    }
+
+    SparseMatrix(const std::size_t rows, const std::size_t cols)
+    : rows_(rows), cols_(cols), row_offsets_(rows + 1, 0)
+    {
+    }
+
+    // Assembles from unordered triplets.  Duplicate entries are summed.
+    SparseMatrix(
+      const std::size_t rows, const std::size_t cols,
+      std::span<const Triplet<Elem>> triplets
+    )
+    : SparseMatrix(rows, cols)
+    {
+      for (const Triplet<Elem>& t : triplets) {
+        if (t.row_ >= rows || t.col_ >= cols) {
+          throw std::out_of_range("SparseMatrix triplet out of range");
+        }
+        ++row_offsets_[t.row_ + 1];
+      }
+      for (std::size_t i = 0; i < rows; ++i) {
+        row_offsets_[i + 1] += row_offsets_[i];
+      }
+
+      std::vector<std::size_t> order(triplets.size());
+      std::vector<std::size_t> next(
+        row_offsets_.begin(), row_offsets_.end() - 1
+      );
+      for (std::size_t k = 0; k < triplets.size(); ++k) {
+        order[next[triplets[k].row_]++] = k;
+      }
+
+      col_indices_.reserve(triplets.size());
+      values_.reserve(triplets.size());
+      std::size_t begin = 0;
+      for (std::size_t i = 0; i < rows; ++i) {
+        const auto first = order.begin() + row_offsets_[i];
+        const auto last = order.begin() + row_offsets_[i + 1];
+        std::sort(first, last, [&](const std::size_t a, const std::size_t b) {
+          return triplets[a].col_ < triplets[b].col_;
+        });
+        for (auto it = first; it != last; ++it) {
+          const Triplet<Elem>& t = triplets[*it];
+          if (col_indices_.size() > begin && col_indices_.back() == t.col_) {
+            values_.back() += t.value_;
+          } else {
+            col_indices_.push_back(t.col_);
+            values_.push_back(t.value_);
+          }
+        }
+        row_offsets_[i] = begin;
+        begin = col_indices_.size();
+      }
+      row_offsets_[rows] = begin;
+    }
+
+    // Keeps the entries of a dense Matrix / DynMatrix whose magnitude
+    // exceeds `tolerance`.
+    template <MatrixExpression Mat>
+      requires Mat::kIsLeaf && std::is_same_v<typename Mat::ElemType, Elem>
+    explicit SparseMatrix(const Mat& mat, const double tolerance = 0)
+    : SparseMatrix(mat.rows(), mat.cols())
+    {
+      for (std::size_t i = 0; i < rows_; ++i) {
+        for (std::size_t j = 0; j < cols_; ++j) {
+          const Elem value = mat.cgetf(i, j);
+          if (std::abs(value) > tolerance) {
+            col_indices_.push_back(j);
+            values_.push_back(value);
+          }
+        }
+        row_offsets_[i + 1] = col_indices_.size();
+      }
+    }
+
+    ~SparseMatrix() = default;
+
+    SparseMatrix(const SparseMatrix& rh) = default;
+
+    SparseMatrix(SparseMatrix&& rh) = default;
+
+    SparseMatrix& operator=(const SparseMatrix& rh) = default;
+
+    SparseMatrix& operator=(SparseMatrix&& rh) = default;
+
+
+    std::size_t rows() const noexcept
+    {
+      return rows_;
+    }
+
+    std::size_t cols() const noexcept
+    {
+      return cols_;
+    }
+
+    std::size_t nonzeros() const noexcept
+    {
+      return values_.size();
+    }
+
+    std::span<const std::size_t> get_row_offsets() const noexcept
+    {
+      return row_offsets_;
+    }
+
+    std::span<const std::size_t> get_col_indices() const noexcept
+    {
+      return col_indices_;
+    }
+
+    std::span<const Elem> get_values() const noexcept
+    {
+      return values_;
+    }
+
+    std::span<Elem> get_values() noexcept
+    {
+      return values_;
+    }
+
+    // Bytes held by the CSR arrays.
+    std::size_t memory() const noexcept
+    {
+      return row_offsets_.size() * sizeof(std::size_t)
+        + col_indices_.size() * sizeof(std::size_t)
+        + values_.size() * sizeof(Elem);
+    }
+
+    // Entry (row, col), zero when it is not stored.
+    Elem cget(const std::size_t row, const std::size_t col) const
+    {
+      if (row >= rows_ || col >= cols_) {
+        throw std::out_of_range("SparseMatrix index out of range");
+      }
+      const auto first = col_indices_.begin() + row_offsets_[row];
+      const auto last = col_indices_.begin() + row_offsets_[row + 1];
+      const auto it = std::lower_bound(first, last, col);
+      if (it == last || *it != col) {
+        return Elem(0);
+      }
+      return values_[it - col_indices_.begin()];
+    }
+
+
+    void operator*=(const Elem rh) noexcept
+    {
+      for (Elem& value : values_) {
+        value *= rh;
+      }
+    }
+
+
+    // y = alpha A x + beta y (SpMV)
+    void Multiply(
+      std::span<const Elem> x, std::span<Elem> y,
+      const Elem alpha = 1, const Elem beta = 0
+    ) const
+    {
+      expr::CheckShape(x.size() == cols_ && y.size() == rows_);
+      const std::size_t* offsets = row_offsets_.data();
+      const std::size_t* indices = col_indices_.data();
+      const Elem* values = values_.data();
+      const Elem* in = x.data();
+      Elem* out = y.data();
+
+      ForRows(1, [=](const std::size_t lo, const std::size_t hi) {
+        for (std::size_t i = lo; i < hi; ++i) {
+          Elem sum = 0;
+          for (std::size_t k = offsets[i]; k < offsets[i + 1]; ++k) {
+            sum += values[k] * in[indices[k]];
+          }
+          out[i] = beta == Elem(0) ? alpha * sum : alpha * sum + beta * out[i];
+        }
+      });
+    }
+
+    // C = A B for row-major B (cols() x n) and C (rows() x n) (SpMM).  Every
+    // nonzero adds a scaled row of B to a row of C, a contiguous axpy.
+    void Multiply(const Elem* b, const std::size_t n, Elem* c) const
+    {
+      const std::size_t* offsets = row_offsets_.data();
+      const std::size_t* indices = col_indices_.data();
+      const Elem* values = values_.data();
+
+      ForRows(n, [=](const std::size_t lo, const std::size_t hi) {
+        for (std::size_t i = lo; i < hi; ++i) {
+          Elem* c_row = c + i * n;
+          std::fill_n(c_row, n, Elem(0));
+          for (std::size_t k = offsets[i]; k < offsets[i + 1]; ++k) {
+            const Elem a = values[k];
+            const Elem* b_row = b + indices[k] * n;
+            for (std::size_t j = 0; j < n; ++j) {
+              c_row[j] += a * b_row[j];
+            }
+          }
+        }
+      });
+    }
+
+    std::vector<Elem> operator*(const std::vector<Elem>& x) const
+    {
+      std::vector<Elem> y(rows_);
+      Multiply(x, y);
+      return y;
+    }
+
+    // A B for a dense Matrix / DynMatrix B.  Fixed-size results must have
+    // the shape of B.
+    template <MatrixExpression Mat>
+      requires Mat::kIsLeaf && std::is_same_v<typename Mat::ElemType, Elem>
+    Mat operator*(const Mat& b) const
+    {
+      expr::CheckShape(b.rows() == cols_);
+      Mat c = expr::MakePlain<Mat>(rows_, b.cols());
+      expr::CheckShape(c.rows() == rows_);
+      Multiply(b.data(), b.cols(), c.data());
+      return c;
+    }
+
+
+    // A^T, equivalently the CSC storage of A.
+    SparseMatrix Transpose() const
+    {
+      SparseMatrix result(cols_, rows_);
+      result.col_indices_.resize(nonzeros());
+      result.values_.resize(nonzeros());
+      for (const std::size_t col : col_indices_) {
+        ++result.row_offsets_[col + 1];
+      }
+      for (std::size_t j = 0; j < cols_; ++j) {
+        result.row_offsets_[j + 1] += result.row_offsets_[j];
+      }
+      std::vector<std::size_t> next(
+        result.row_offsets_.begin(), result.row_offsets_.end() - 1
+      );
+      for (std::size_t i = 0; i < rows_; ++i) {
+        for (std::size_t k = row_offsets_[i]; k < row_offsets_[i + 1]; ++k) {
+          const std::size_t dst = next[col_indices_[k]]++;
+          result.col_indices_[dst] = i;
+          result.values_[dst] = values_[k];
+        }
+      }
+      return result;
+    }
+
+
+    DynMatrix<Elem> ToDynMatrix() const
+    {
+      DynMatrix<Elem> mat(rows_, cols_);
+      for (std::size_t i = 0; i < rows_; ++i) {
+        for (std::size_t k = row_offsets_[i]; k < row_offsets_[i + 1]; ++k) {
+          mat.getf(i, col_indices_[k]) = values_[k];
+        }
+      }
+      return mat;
+    }
+
+    template <std::size_t kRow, std::size_t kCol>
+    Matrix<Elem, kRow, kCol> ToMatrix() const
+    {
+      expr::CheckShape(rows_ == kRow && cols_ == kCol);
+      Matrix<Elem, kRow, kCol> mat;
+      for (std::size_t i = 0; i < rows_; ++i) {
+        for (std::size_t k = row_offsets_[i]; k < row_offsets_[i + 1]; ++k) {
+          mat.getf(i, col_indices_[k]) = values_[k];
+        }
+      }
+      return mat;
+    }
+  };
+}
+
+
+
+#endif // CXXSPARSEMATRIX_H
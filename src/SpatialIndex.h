@@ -0,0 +1,669 @@
+#ifndef CXXSPATIALINDEX_H
+#define CXXSPATIALINDEX_H
+
+#include <algorithm>
+#include <cmath>
+#include <concepts>
+#include <cstddef>
+#include <numeric>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+#include "ThreadPool.h"
+#include "Vector3.h"
+
+
+
+namespace csp::math
+{
+  // Point found by a spatial query.
+  template <std::floating_point T>
+  struct Neighbor
+  {
+    std::size_t index_;
+    T distance2_;
+  };
+
+
+  // Neighbors of a batch of query points in CSR form: the neighbors of
+  // query q are indices_[offsets_[q], offsets_[q + 1]).
+  struct NeighborList
+  {
+    std::vector<std::size_t> offsets_;
+    std::vector<std::size_t> indices_;
+  };
+
+
+  namespace detail
+  {
+    inline void CheckIndexSize(const bool is_valid)
+    {
+      if (!is_valid) {
+        throw std::invalid_argument("spatial index size mismatch");
+      }
+    }
+
+    // Queries per parallel batch and chunk.
+    inline constexpr std::size_t kQueryThreshold = 1 << 10;
+
+    inline constexpr std::size_t kQueryGrain = 1 << 7;
+
+    template <std::floating_point T>
+    constexpr T Coordinate(const Vector3<T>& vec, const std::size_t axis)
+      noexcept
+    {
+      return axis == 0 ? vec.x_ : axis == 1 ? vec.y_ : vec.z_;
+    }
+  }
+
+
+  // Uniform grid of cells at least `radius` wide over the box [lower,
+  // upper), for fixed-radius neighbor queries.  A query only visits the 27
+  // cells around its own.
+  //
+  // Points of a cell occupy consecutive slots, so a query streams through
+  // memory.  Every cell is built with kSlack spare slots, which lets
+  // `Update` move a point to another cell in O(1) when the points drift
+  // between timesteps.
+  //
+  // With periodic boundaries distances follow the minimum image
+  // convention, and each side of the box must be at least 2 radius.
+  // Without them, points outside the box are kept in the border cells.
+  template <std::floating_point T>
+  class CellList
+  {
+  public:
+    static constexpr std::size_t kSlack = 2;
+
+
+  private:
+    Vector3<T> lower_;
+
+    Vector3<T> extent_;
+
+    // Cells per unit length along each axis.
+    Vector3<T> density_;
+
+    std::size_t dims_[3];
+
+    T radius_;
+
+    bool periodic_;
+
+    // First slot of every cell, plus the end of the last one.
+    std::vector<std::size_t> start_;
+
+    std::vector<std::size_t> count_;
+
+    std::vector<Vector3<T>> positions_;
+
+    // Point index held by every slot.
+    std::vector<std::size_t> ids_;
+
+    // Slot and cell of every point.
+    std::vector<std::size_t> slot_;
+
+    std::vector<std::size_t> cell_;
+
+
+    std::size_t CellCoordinate(
+      const T value, const std::size_t axis
+    ) const noexcept
+    {
+      const std::size_t dim = dims_[axis];
+      const T t = std::floor(
+        (value - detail::Coordinate(lower_, axis))
+        * detail::Coordinate(density_, axis)
+      );
+      if (periodic_) {
+        const T wrapped = t - T(dim) * std::floor(t / T(dim));
+        return std::min(static_cast<std::size_t>(wrapped), dim - 1);
+      }
+      return static_cast<std::size_t>(std::clamp(t, T(0), T(dim - 1)));
+    }
+
+    std::size_t CellOf(const Vector3<T>& point) const noexcept
+    {
+      return (
+        CellCoordinate(point.x_, 0) * dims_[1] + CellCoordinate(point.y_, 1)
+      ) * dims_[2] + CellCoordinate(point.z_, 2);
+    }
+
+    // Distinct cell coordinates within one cell of `c` along `axis`.
+    std::size_t Stencil(
+      const std::size_t c, const std::size_t axis, std::size_t (&out)[3]
+    ) const noexcept
+    {
+      const std::size_t dim = dims_[axis];
+      std::size_t n = 0;
+      if (periodic_ && dim < 3) {
+        for (; n < dim; ++n) {
+          out[n] = n;
+        }
+      } else if (periodic_) {
+        out[n++] = (c + dim - 1) % dim;
+        out[n++] = c;
+        out[n++] = (c + 1) % dim;
+      } else {
+        if (c > 0) {
+          out[n++] = c - 1;
+        }
+        out[n++] = c;
+        if (c + 1 < dim) {
+          out[n++] = c + 1;
+        }
+      }
+      return n;
+    }
+
+    Vector3<T> Displacement(
+      const Vector3<T>& from, const Vector3<T>& to
+    ) const noexcept
+    {
+      Vector3<T> d = to - from;
+      if (periodic_) {
+        d.x_ -= extent_.x_ * std::nearbyint(d.x_ / extent_.x_);
+        d.y_ -= extent_.y_ * std::nearbyint(d.y_ / extent_.y_);
+        d.z_ -= extent_.z_ * std::nearbyint(d.z_ / extent_.z_);
+      }
+      return d;
+    }
+
+    void Remove(const std::size_t index) noexcept
+    {
+      const std::size_t cell = cell_[index];
+      const std::size_t slot = slot_[index];
+      const std::size_t last = start_[cell] + --count_[cell];
+      if (slot != last) {
+        positions_[slot] = positions_[last];
+        ids_[slot] = ids_[last];
+        slot_[ids_[slot]] = slot;
+      }
+    }
+
+    void Insert(
+      const std::size_t index, const std::size_t cell, const Vector3<T>& point
+    ) noexcept
+    {
+      const std::size_t slot = start_[cell] + count_[cell]++;
+      positions_[slot] = point;
+      ids_[slot] = index;
+      slot_[index] = slot;
+      cell_[index] = cell;
+    }
+
+
+  public:
+    CellList(
+      const Vector3<T>& lower, const Vector3<T>& upper, const T radius,
+      const bool periodic
+    )
+    : lower_(lower), extent_(upper - lower), radius_(radius),
+      periodic_(periodic)
+    {
+      if (!(radius > T(0))) {
+        throw std::invalid_argument("CellList radius must be positive");
+      }
+      for (std::size_t axis = 0; axis < 3; ++axis) {
+        const T extent = detail::Coordinate(extent_, axis);
+        if (!(extent > T(0)) || (periodic && extent < T(2) * radius)) {
+          throw std::invalid_argument("CellList box too small");
+        }
+        dims_[axis] = std::max<std::size_t>(
+          1, static_cast<std::size_t>(extent / radius)
+        );
+      }
+      density_ = {
+        T(dims_[0]) / extent_.x_,
+        T(dims_[1]) / extent_.y_,
+        T(dims_[2]) / extent_.z_
+      };
+      count_.assign(dims_[0] * dims_[1] * dims_[2], 0);
+      start_.resize(count_.size() + 1);
+      for (std::size_t c = 0; c <= count_.size(); ++c) {
+        start_[c] = c * kSlack;
+      }
+    }
+
+    ~CellList() = default;
+
+    CellList(const CellList& rh) = default;
+
+    CellList(CellList&& rh) = default;
+
+    CellList& operator=(const CellList& rh) = default;
+
+    CellList& operator=(CellList&& rh) = default;
+
+
+    // Number of indexed points.
+    std::size_t size() const noexcept
+    {
+      return slot_.size();
+    }
+
+    std::size_t cells() const noexcept
+    {
+      return count_.size();
+    }
+
+    T get_radius() const noexcept
+    {
+      return radius_;
+    }
+
+
+    // Indexes `points`, replacing the previous contents.  Neighbors are
+    // reported by their index in `points`.
+    void Build(std::span<const Vector3<T>> points)
+    {
+      const std::size_t n = points.size();
+      cell_.resize(n);
+      slot_.resize(n);
+      std::fill(count_.begin(), count_.end(), 0);
+      for (std::size_t i = 0; i < n; ++i) {
+        cell_[i] = CellOf(points[i]);
+        ++count_[cell_[i]];
+      }
+      for (std::size_t c = 0; c < count_.size(); ++c) {
+        start_[c + 1] = start_[c] + count_[c] + kSlack;
+      }
+      positions_.resize(start_.back());
+      ids_.resize(start_.back());
+      std::fill(count_.begin(), count_.end(), 0);
+      for (std::size_t i = 0; i < n; ++i) {
+        Insert(i, cell_[i], points[i]);
+      }
+    }
+
+    // Moves the indexed points to `points`, given in the order of Build.
+    // Points that stay in their cell are overwritten in place and the
+    // others are moved between cells; only when a cell runs out of spare
+    // slots is the grid rebuilt.  Returns the number of points that
+    // changed cell.
+    std::size_t Update(std::span<const Vector3<T>> points)
+    {
+      detail::CheckIndexSize(points.size() == size());
+      std::size_t moved = 0;
+      bool is_full = false;
+      for (std::size_t i = 0; i < points.size(); ++i) {
+        const std::size_t cell = CellOf(points[i]);
+        if (cell == cell_[i]) {
+          positions_[slot_[i]] = points[i];
+          continue;
+        }
+        ++moved;
+        is_full = is_full || count_[cell] == start_[cell + 1] - start_[cell];
+        if (!is_full) {
+          Remove(i);
+          Insert(i, cell, points[i]);
+        }
+      }
+      if (is_full) {
+        Build(points);
+      }
+      return moved;
+    }
+
+
+    // Calls `f(index, distance2)` for every point within the radius of
+    // `point`, in no particular order.
+    template <typename F>
+    void ForEachNeighbor(const Vector3<T>& point, const F& f) const
+    {
+      std::size_t sx[3];
+      std::size_t sy[3];
+      std::size_t sz[3];
+      const std::size_t nx = Stencil(CellCoordinate(point.x_, 0), 0, sx);
+      const std::size_t ny = Stencil(CellCoordinate(point.y_, 1), 1, sy);
+      const std::size_t nz = Stencil(CellCoordinate(point.z_, 2), 2, sz);
+      const T radius2 = radius_ * radius_;
+      for (std::size_t a = 0; a < nx; ++a) {
+        for (std::size_t b = 0; b < ny; ++b) {
+          for (std::size_t c = 0; c < nz; ++c) {
+            const std::size_t cell = (sx[a] * dims_[1] + sy[b]) * dims_[2]
+              + sz[c];
+            const std::size_t end = start_[cell] + count_[cell];
+            for (std::size_t s = start_[cell]; s < end; ++s) {
+              const T d2 = Displacement(point, positions_[s]).norm2();
+              if (d2 <= radius2) {
+                f(ids_[s], d2);
+              }
+            }
+          }
+        }
+      }
+    }
+
+    std::vector<std::size_t> Neighbors(const Vector3<T>& point) const
+    {
+      std::vector<std::size_t> result;
+      ForEachNeighbor(point, [&](const std::size_t index, const T) {
+        result.push_back(index);
+      });
+      return result;
+    }
+
+    // Neighbors of every query point.  A counting pass sizes the result,
+    // then a second pass fills it; both are split over the global thread
+    // pool.
+    NeighborList Neighbors(std::span<const Vector3<T>> queries) const
+    {
+      const std::size_t n = queries.size();
+      NeighborList list;
+      list.offsets_.assign(n + 1, 0);
+      utils::ParallelForIfLarge(
+        n, detail::kQueryThreshold, detail::kQueryGrain,
+        [&](const std::size_t lo, const std::size_t hi) {
+          for (std::size_t q = lo; q < hi; ++q) {
+            std::size_t count = 0;
+            ForEachNeighbor(queries[q], [&](const std::size_t, const T) {
+              ++count;
+            });
+            list.offsets_[q + 1] = count;
+          }
+        }
+      );
+      std::partial_sum(
+        list.offsets_.begin(), list.offsets_.end(), list.offsets_.begin()
+      );
+
+      list.indices_.resize(list.offsets_.back());
+      utils::ParallelForIfLarge(
+        n, detail::kQueryThreshold, detail::kQueryGrain,
+        [&](const std::size_t lo, const std::size_t hi) {
+          for (std::size_t q = lo; q < hi; ++q) {
+            std::size_t* out = list.indices_.data() + list.offsets_[q];
+            ForEachNeighbor(queries[q], [&](const std::size_t index, const T) {
+              *out++ = index;
+            });
+          }
+        }
+      );
+      return list;
+    }
+  };
+
+
+  // k-d tree over a point cloud for k-nearest-neighbor queries.  Nodes
+  // split their points at the median of the widest axis down to leaves of
+  // at most kLeafSize points, stored contiguously.
+  //
+  // Every node keeps the bounding box of its points, so `Update` can move
+  // the points and refit the boxes in O(N) without changing the tree.
+  // Queries stay exact, but slow down as the points drift from the layout
+  // the tree was built for; call Build again after large motions.
+  template <std::floating_point T>
+  class KdTree
+  {
+  public:
+    static constexpr std::size_t kLeafSize = 16;
+
+
+  private:
+    struct Node
+    {
+      Vector3<T> lower_;
+      Vector3<T> upper_;
+      std::size_t begin_;
+      std::size_t end_;
+      // Children are left_ and left_ + 1; 0 for a leaf.
+      std::size_t left_;
+    };
+
+
+    // Bound on the traversal stack: balanced splits give a depth of about
+    // log2(N / kLeafSize).
+    static constexpr std::size_t kMaxDepth = 128;
+
+
+    std::vector<Node> nodes_;
+
+    std::vector<Vector3<T>> positions_;
+
+    // Point index held by every slot.
+    std::vector<std::size_t> ids_;
+
+
+    static T BoxDistance2(const Node& node, const Vector3<T>& point) noexcept
+    {
+      T result = 0;
+      for (std::size_t axis = 0; axis < 3; ++axis) {
+        const T p = detail::Coordinate(point, axis);
+        const T d = std::max({
+          T(0),
+          detail::Coordinate(node.lower_, axis) - p,
+          p - detail::Coordinate(node.upper_, axis)
+        });
+        result += d * d;
+      }
+      return result;
+    }
+
+    void FitLeaf(Node& node) const noexcept
+    {
+      node.lower_ = positions_[node.begin_];
+      node.upper_ = positions_[node.begin_];
+      for (std::size_t s = node.begin_ + 1; s < node.end_; ++s) {
+        const Vector3<T>& p = positions_[s];
+        node.lower_ = {
+          std::min(node.lower_.x_, p.x_),
+          std::min(node.lower_.y_, p.y_),
+          std::min(node.lower_.z_, p.z_)
+        };
+        node.upper_ = {
+          std::max(node.upper_.x_, p.x_),
+          std::max(node.upper_.y_, p.y_),
+          std::max(node.upper_.z_, p.z_)
+        };
+      }
+    }
+
+    // Refits every box, children before parents.
+    void Refit() noexcept
+    {
+      for (std::size_t n = nodes_.size(); n-- > 0;) {
+        Node& node = nodes_[n];
+        if (node.left_ == 0) {
+          FitLeaf(node);
+          continue;
+        }
+        const Node& l = nodes_[node.left_];
+        const Node& r = nodes_[node.left_ + 1];
+        node.lower_ = {
+          std::min(l.lower_.x_, r.lower_.x_),
+          std::min(l.lower_.y_, r.lower_.y_),
+          std::min(l.lower_.z_, r.lower_.z_)
+        };
+        node.upper_ = {
+          std::max(l.upper_.x_, r.upper_.x_),
+          std::max(l.upper_.y_, r.upper_.y_),
+          std::max(l.upper_.z_, r.upper_.z_)
+        };
+      }
+    }
+
+
+  public:
+    KdTree() = default;
+
+    explicit KdTree(std::span<const Vector3<T>> points)
+    {
+      Build(points);
+    }
+
+    ~KdTree() = default;
+
+    KdTree(const KdTree& rh) = default;
+
+    KdTree(KdTree&& rh) = default;
+
+    KdTree& operator=(const KdTree& rh) = default;
+
+    KdTree& operator=(KdTree&& rh) = default;
+
+
+    std::size_t size() const noexcept
+    {
+      return ids_.size();
+    }
+
+
+    // Indexes `points`, replacing the previous contents.  Neighbors are
+    // reported by their index in `points`.
+    void Build(std::span<const Vector3<T>> points)
+    {
+      const std::size_t n = points.size();
+      ids_.resize(n);
+      std::iota(ids_.begin(), ids_.end(), std::size_t(0));
+      positions_.assign(points.begin(), points.end());
+      nodes_.clear();
+      if (n == 0) {
+        return;
+      }
+      nodes_.reserve(2 * (n / kLeafSize + 1));
+      nodes_.push_back({{}, {}, 0, n, 0});
+
+      // Nodes are split in creation order, so children always follow
+      // their parent.
+      for (std::size_t k = 0; k < nodes_.size(); ++k) {
+        FitLeaf(nodes_[k]);
+        const Node node = nodes_[k];
+        if (node.end_ - node.begin_ <= kLeafSize) {
+          continue;
+        }
+        const Vector3<T> extent = node.upper_ - node.lower_;
+        const std::size_t axis = extent.x_ >= extent.y_
+          ? (extent.x_ >= extent.z_ ? 0 : 2)
+          : (extent.y_ >= extent.z_ ? 1 : 2);
+        const std::size_t mid = node.begin_ + (node.end_ - node.begin_) / 2;
+        std::nth_element(
+          ids_.begin() + node.begin_, ids_.begin() + mid,
+          ids_.begin() + node.end_,
+          [&](const std::size_t a, const std::size_t b) {
+            return detail::Coordinate(points[a], axis)
+              < detail::Coordinate(points[b], axis);
+          }
+        );
+        for (std::size_t s = node.begin_; s < node.end_; ++s) {
+          positions_[s] = points[ids_[s]];
+        }
+        nodes_[k].left_ = nodes_.size();
+        nodes_.push_back({{}, {}, node.begin_, mid, 0});
+        nodes_.push_back({{}, {}, mid, node.end_, 0});
+      }
+    }
+
+    // Moves the indexed points to `points`, given in the order of Build,
+    // and refits the node boxes.
+    void Update(std::span<const Vector3<T>> points)
+    {
+      detail::CheckIndexSize(points.size() == size());
+      for (std::size_t s = 0; s < ids_.size(); ++s) {
+        positions_[s] = points[ids_[s]];
+      }
+      Refit();
+    }
+
+
+    // The min(k, size()) points nearest to `point` in `out`, closest first.
+    // `out` is reused, so repeated queries do not allocate.
+    void Knn(
+      const Vector3<T>& point, const std::size_t k,
+      std::vector<Neighbor<T>>& out
+    ) const
+    {
+      out.clear();
+      if (k == 0 || nodes_.empty()) {
+        return;
+      }
+      const auto closer = [](const Neighbor<T>& a, const Neighbor<T>& b) {
+        return a.distance2_ < b.distance2_;
+      };
+      const auto is_pruned = [&](const T d2) {
+        return out.size() == k && d2 >= out.front().distance2_;
+      };
+
+      struct Entry
+      {
+        std::size_t node_;
+        T distance2_;
+      };
+      Entry stack[kMaxDepth];
+      std::size_t top = 0;
+      stack[top++] = {0, BoxDistance2(nodes_[0], point)};
+      while (top > 0) {
+        const Entry entry = stack[--top];
+        if (is_pruned(entry.distance2_)) {
+          continue;
+        }
+        const Node& node = nodes_[entry.node_];
+        if (node.left_ == 0) {
+          for (std::size_t s = node.begin_; s < node.end_; ++s) {
+            const T d2 = (positions_[s] - point).norm2();
+            if (out.size() < k) {
+              out.push_back({ids_[s], d2});
+              std::push_heap(out.begin(), out.end(), closer);
+            } else if (d2 < out.front().distance2_) {
+              std::pop_heap(out.begin(), out.end(), closer);
+              out.back() = {ids_[s], d2};
+              std::push_heap(out.begin(), out.end(), closer);
+            }
+          }
+          continue;
+        }
+        Entry closest = {node.left_, BoxDistance2(nodes_[node.left_], point)};
+        Entry farthest = {
+          node.left_ + 1, BoxDistance2(nodes_[node.left_ + 1], point)
+        };
+        if (farthest.distance2_ < closest.distance2_) {
+          std::swap(closest, farthest);
+        }
+        if (!is_pruned(farthest.distance2_)) {
+          stack[top++] = farthest;
+        }
+        stack[top++] = closest;
+      }
+      std::sort_heap(out.begin(), out.end(), closer);
+    }
+
+    std::vector<Neighbor<T>> Knn(
+      const Vector3<T>& point, const std::size_t k
+    ) const
+    {
+      std::vector<Neighbor<T>> result;
+      result.reserve(k);
+      Knn(point, k, result);
+      return result;
+    }
+
+    // Indices of the k nearest points to every query, closest first:
+    // out[q * k + j] is the j-th neighbor of queries[q].  Requires
+    // k <= size().  Queries are split over the global thread pool.
+    void Knn(
+      std::span<const Vector3<T>> queries, const std::size_t k,
+      std::span<std::size_t> out
+    ) const
+    {
+      detail::CheckIndexSize(k <= size() && out.size() >= queries.size() * k);
+      utils::ParallelForIfLarge(
+        queries.size(), detail::kQueryThreshold, detail::kQueryGrain,
+        [&](const std::size_t lo, const std::size_t hi) {
+          std::vector<Neighbor<T>> neighbors;
+          neighbors.reserve(k);
+          for (std::size_t q = lo; q < hi; ++q) {
+            Knn(queries[q], k, neighbors);
+            for (std::size_t j = 0; j < k; ++j) {
+              out[q * k + j] = neighbors[j].index_;
+            }
+          }
+        }
+      );
+    }
+  };
+}
+
+
+
+#endif // CXXSPATIALINDEX_H
@@ -9,6 +9,7 @@
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 
 
 
@@ -45,7 +46,7 @@ namespace csp
 
     inline void Write(
       const std::filesystem::path& filepath,
-      const std::string content,
+      const std::string_view content,
       const bool append = false
     )
     {
@@ -0,0 +1,302 @@
+#ifndef CXXTHREADPOOL_H
+#define CXXTHREADPOOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+
+
+namespace csp::utils
+{
+  // Work-stealing pool for fork-join loops.
+  // Every worker owns a deque: it pops its own tasks from the back and
+  // steals from the front of the others.  The thread calling ParallelFor
+  // runs tasks too, so nested ParallelFor calls cannot deadlock, and a
+  // pool of `threads` workers computes on threads + 1 threads.
+  class ThreadPool
+  {
+    struct Batch
+    {
+      void (*invoke)(const void*, std::size_t, std::size_t);
+      const void* body;
+      std::atomic<std::size_t> remaining;
+      std::atomic<bool> is_failed;
+      std::exception_ptr error;
+    };
+
+    struct Task
+    {
+      Batch* batch;
+      std::size_t begin;
+      std::size_t end;
+    };
+
+    struct Queue
+    {
+      std::mutex mutex;
+      std::deque<Task> tasks;
+    };
+
+
+  private:
+    static inline thread_local const ThreadPool* current_pool_ = nullptr;
+
+    static inline thread_local std::size_t current_index_ = 0;
+
+
+    std::vector<std::unique_ptr<Queue>> queues_;
+
+    std::vector<std::thread> workers_;
+
+    std::atomic<std::size_t> queued_;
+
+    std::atomic<bool> is_stopped_;
+
+    std::mutex sleep_mutex_;
+
+    std::condition_variable sleep_cv_;
+
+    std::atomic<std::size_t> next_queue_;
+
+
+    std::size_t SelfIndex() const noexcept
+    {
+      return current_pool_ == this ? current_index_ : queues_.size();
+    }
+
+    bool TryPop(const std::size_t self, Task& task) noexcept
+    {
+      if (queued_.load(std::memory_order_acquire) == 0) {
+        return false;
+      }
+
+      if (self < queues_.size()) {
+        Queue& own = *queues_[self];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+          task = own.tasks.back();
+          own.tasks.pop_back();
+          queued_.fetch_sub(1, std::memory_order_relaxed);
+          return true;
+        }
+      }
+
+      const std::size_t count = queues_.size();
+      const std::size_t start = self < count ? self + 1 : 0;
+      for (std::size_t offset = 0; offset < count; ++offset) {
+        Queue& victim = *queues_[(start + offset) % count];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+          task = victim.tasks.front();
+          victim.tasks.pop_front();
+          queued_.fetch_sub(1, std::memory_order_relaxed);
+          return true;
+        }
+      }
+      return false;
+    }
+
+    static void Run(const Task& task) noexcept
+    {
+      Batch& batch = *task.batch;
+      try {
+        batch.invoke(batch.body, task.begin, task.end);
+      } catch (...) {
+        if (!batch.is_failed.exchange(true)) {
+          batch.error = std::current_exception();
+        }
+      }
+      batch.remaining.fetch_sub(1, std::memory_order_acq_rel);
+    }
+
+    void WorkerLoop(const std::size_t index) noexcept
+    {
+      current_pool_ = this;
+      current_index_ = index;
+
+      Task task;
+      while (true) {
+        if (TryPop(index, task)) {
+          Run(task);
+          continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleep_mutex_);
+        sleep_cv_.wait(lock, [this] {
+          return is_stopped_.load() || queued_.load() > 0;
+        });
+        if (is_stopped_.load() && queued_.load() == 0) {
+          return;
+        }
+      }
+    }
+
+
+  public:
+    explicit ThreadPool(
+      const std::size_t threads =
+        std::max(std::thread::hardware_concurrency(), 2u) - 1
+    )
+    : queued_(0), is_stopped_(false), next_queue_(0)
+    {
+      const std::size_t count = std::max<std::size_t>(threads, 1);
+      queues_.reserve(count);
+      for (std::size_t i = 0; i < count; ++i) {
+        queues_.push_back(std::make_unique<Queue>());
+      }
+      workers_.reserve(count);
+      for (std::size_t i = 0; i < count; ++i) {
+        workers_.emplace_back(&ThreadPool::WorkerLoop, this, i);
+      }
+    }
+
+    ~ThreadPool()
+    {
+      {
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        is_stopped_ = true;
+      }
+      sleep_cv_.notify_all();
+      for (std::thread& worker : workers_) {
+        worker.join();
+      }
+    }
+
+    ThreadPool(const ThreadPool& rh) = delete;
+
+    ThreadPool(ThreadPool&& rh) = delete;
+
+    ThreadPool& operator=(const ThreadPool& rh) = delete;
+
+    ThreadPool& operator=(ThreadPool&& rh) = delete;
+
+
+    // Workers, not counting the thread calling ParallelFor.
+    std::size_t size() const noexcept
+    {
+      return workers_.size();
+    }
+
+
+    // Calls `body(lo, hi)` on disjoint chunks of [begin, end) of at most
+    // `grain` indices, and returns once every chunk has finished.
+    // The first exception thrown by `body` is rethrown here.
+    template <typename F>
+    void ParallelFor(
+      const std::size_t begin, const std::size_t end,
+      const std::size_t grain, const F& body
+    )
+    {
+      if (end <= begin) {
+        return;
+      }
+      const std::size_t step = std::max<std::size_t>(grain, 1);
+      const std::size_t chunks = (end - begin + step - 1) / step;
+      if (chunks == 1) {
+        body(begin, end);
+        return;
+      }
+
+      Batch batch{
+        [](const void* ptr, const std::size_t lo, const std::size_t hi) {
+          (*static_cast<const F*>(ptr))(lo, hi);
+        },
+        &body,
+        chunks,
+        false,
+        nullptr
+      };
+
+      // Counted before the tasks are visible, so a thief's decrement can
+      // never run ahead of the increment.
+      queued_.fetch_add(chunks, std::memory_order_release);
+      const std::size_t count = queues_.size();
+      const std::size_t first = next_queue_.fetch_add(1) % count;
+      for (std::size_t c = 0; c < chunks; ++c) {
+        const std::size_t lo = begin + c * step;
+        const Task task{&batch, lo, std::min(end, lo + step)};
+        Queue& queue = *queues_[(first + c) % count];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(task);
+      }
+      {
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+      }
+      sleep_cv_.notify_all();
+
+      const std::size_t self = SelfIndex();
+      Task task;
+      while (batch.remaining.load(std::memory_order_acquire) > 0) {
+        if (TryPop(self, task)) {
+          Run(task);
+        } else {
+          std::this_thread::yield();
+        }
+      }
+
+      if (batch.error) {
+        std::rethrow_exception(batch.error);
+      }
+    }
+  };
+
+
+  namespace detail
+  {
+    inline std::unique_ptr<ThreadPool>& GlobalThreadPoolStorage() noexcept
+    {
+      static std::unique_ptr<ThreadPool> pool;
+      return pool;
+    }
+  }
+
+
+  // Pool used by the math kernels, or nullptr when they run serially.
+  inline ThreadPool* GlobalThreadPool() noexcept
+  {
+    return detail::GlobalThreadPoolStorage().get();
+  }
+
+  // body(lo, hi) over [0, size): split into chunks of `grain` on the
+  // global pool once `size` reaches `threshold`, and called once on this
+  // thread otherwise or when no pool is set.
+  template <typename F>
+  void ParallelForIfLarge(
+    const std::size_t size, const std::size_t threshold,
+    const std::size_t grain, const F& body
+  )
+  {
+    ThreadPool* const pool = GlobalThreadPool();
+    if (pool == nullptr || size < threshold) {
+      body(std::size_t(0), size);
+      return;
+    }
+    pool->ParallelFor(0, size, grain, body);
+  }
+
+  // Opts the math kernels into parallel execution on `threads` threads:
+  // threads - 1 pool workers and the thread calling the kernel.
+  // `threads <= 1` goes back to serial execution.  Not to be called while
+  // a kernel is running.
+  inline void SetGlobalThreads(const std::size_t threads)
+  {
+    auto& pool = detail::GlobalThreadPoolStorage();
+    pool.reset();
+    if (threads > 1) {
+      pool = std::make_unique<ThreadPool>(threads - 1);
+    }
+  }
+}
+
+
+
+#endif // CXXTHREADPOOL_H
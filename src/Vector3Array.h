@@ -0,0 +1,464 @@
+#ifndef CXXVECTOR3ARRAY_H
+#define CXXVECTOR3ARRAY_H
+
+#include <cmath>
+#include <concepts>
+#include <cstddef>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+#include "AlignedAllocator.h"
+#include "Vector3.h"
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+
+
+namespace csp::math
+{
+  // Vector3 values in structure-of-arrays layout: all x, all y and all z
+  // components live in three 64-byte aligned arrays, so the bulk kernels
+  // below process one vector per SIMD lane.  Element access goes through
+  // the `Reference` proxy, which reads and writes like a Vector3.
+  template <std::floating_point T>
+  class Vector3Array
+  {
+    using Storage = std::vector<T, AlignedAllocator<T>>;
+
+
+  public:
+    // Proxy for element i.  Its members alias the three arrays, so
+    // `arr[i].x_ = 1` and `arr[i] += v` write through.
+    class Reference
+    {
+    public:
+      T& x_;
+      T& y_;
+      T& z_;
+
+
+      constexpr Reference(T& x, T& y, T& z) noexcept
+      : x_(x), y_(y), z_(z)
+      {
+      }
+
+      ~Reference() = default;
+
+      Reference(const Reference& rh) = default;
+
+      // Assignment writes the value, never rebinds.
+      constexpr Reference& operator=(const Reference& rh) noexcept
+      {
+        return *this = Vector3<T>(rh);
+      }
+
+      constexpr Reference& operator=(const Vector3<T>& rh) noexcept
+      {
+        x_ = rh.x_;
+        y_ = rh.y_;
+        z_ = rh.z_;
+        return *this;
+      }
+
+      constexpr operator Vector3<T>() const noexcept
+      {
+        return {x_, y_, z_};
+      }
+
+
+      constexpr Reference& operator+=(const Vector3<T>& rh) noexcept
+      {
+        return *this = Vector3<T>(*this) + rh;
+      }
+
+      constexpr Reference& operator-=(const Vector3<T>& rh) noexcept
+      {
+        return *this = Vector3<T>(*this) - rh;
+      }
+
+      constexpr Reference& operator*=(const T scalar) noexcept
+      {
+        return *this = Vector3<T>(*this) * scalar;
+      }
+
+      constexpr Reference& operator/=(const T scalar) noexcept
+      {
+        return *this = Vector3<T>(*this) / scalar;
+      }
+
+
+      constexpr T dot(const Vector3<T>& rh) const
+      {
+        return Vector3<T>(*this).dot(rh);
+      }
+
+      constexpr Vector3<T> cross(const Vector3<T>& rh) const
+      {
+        return Vector3<T>(*this).cross(rh);
+      }
+
+      T norm() const
+      {
+        return Vector3<T>(*this).norm();
+      }
+
+      constexpr T norm2() const
+      {
+        return Vector3<T>(*this).norm2();
+      }
+
+      Vector3<T> normalize() const
+      {
+        return Vector3<T>(*this).normalize();
+      }
+    };
+
+
+  private:
+    Storage x_;
+
+    Storage y_;
+
+    Storage z_;
+
+
+  public:
+    Vector3Array() = default;
+
+    explicit Vector3Array(const std::size_t size)
+    : x_(size, T(0)), y_(size, T(0)), z_(size, T(0))
+    {
+    }
+
+    explicit Vector3Array(std::span<const Vector3<T>> vecs)
+    : x_(vecs.size()), y_(vecs.size()), z_(vecs.size())
+    {
+      for (std::size_t i = 0; i < vecs.size(); ++i) {
+        x_[i] = vecs[i].x_;
+        y_[i] = vecs[i].y_;
+        z_[i] = vecs[i].z_;
+      }
+    }
+
+    ~Vector3Array() = default;
+
+    Vector3Array(const Vector3Array& rh) = default;
+
+    Vector3Array(Vector3Array&& rh) = default;
+
+    Vector3Array& operator=(const Vector3Array& rh) = default;
+
+    Vector3Array& operator=(Vector3Array&& rh) = default;
+
+
+    std::size_t size() const noexcept
+    {
+      return x_.size();
+    }
+
+    // New elements are zero.
+    void resize(const std::size_t size)
+    {
+      x_.resize(size, T(0));
+      y_.resize(size, T(0));
+      z_.resize(size, T(0));
+    }
+
+    void push_back(const Vector3<T>& vec)
+    {
+      x_.push_back(vec.x_);
+      y_.push_back(vec.y_);
+      z_.push_back(vec.z_);
+    }
+
+    Reference operator[](const std::size_t i) noexcept
+    {
+      return {x_[i], y_[i], z_[i]};
+    }
+
+    Vector3<T> operator[](const std::size_t i) const noexcept
+    {
+      return {x_[i], y_[i], z_[i]};
+    }
+
+    std::span<T> get_x() noexcept
+    {
+      return x_;
+    }
+
+    std::span<const T> get_x() const noexcept
+    {
+      return x_;
+    }
+
+    std::span<T> get_y() noexcept
+    {
+      return y_;
+    }
+
+    std::span<const T> get_y() const noexcept
+    {
+      return y_;
+    }
+
+    std::span<T> get_z() noexcept
+    {
+      return z_;
+    }
+
+    std::span<const T> get_z() const noexcept
+    {
+      return z_;
+    }
+
+    // Copies element i into vecs[i], for i < vecs.size().
+    void Gather(std::span<Vector3<T>> vecs) const
+    {
+      if (vecs.size() > size()) {
+        throw std::invalid_argument("Vector3Array size mismatch");
+      }
+      for (std::size_t i = 0; i < vecs.size(); ++i) {
+        vecs[i] = {x_[i], y_[i], z_[i]};
+      }
+    }
+  };
+
+
+  namespace detail
+  {
+    inline void CheckArraySize(const bool is_valid)
+    {
+      if (!is_valid) {
+        throw std::invalid_argument("Vector3Array size mismatch");
+      }
+    }
+
+
+    // v[i] /= |v[i]| for i in [0, n), leaving zero vectors unchanged.
+    template <std::floating_point T>
+    void NormalizeScalar(
+      T* x, T* y, T* z, const std::size_t begin, const std::size_t end
+    ) noexcept
+    {
+      for (std::size_t i = begin; i < end; ++i) {
+        const T n = std::sqrt(x[i] * x[i] + y[i] * y[i] + z[i] * z[i]);
+        if (n != T(0)) {
+          x[i] /= n;
+          y[i] /= n;
+          z[i] /= n;
+        }
+      }
+    }
+
+    // std::sqrt may set errno, which keeps the compiler from vectorizing
+    // the loop above, so the common types get explicit kernels.
+    template <std::floating_point T>
+    void Normalize(T* x, T* y, T* z, const std::size_t n) noexcept
+    {
+      NormalizeScalar(x, y, z, 0, n);
+    }
+
+#if defined(__AVX512F__)
+    inline void Normalize(
+      double* x, double* y, double* z, const std::size_t n
+    ) noexcept
+    {
+      const __m512d one = _mm512_set1_pd(1.);
+      std::size_t i = 0;
+      for (; i + 8 <= n; i += 8) {
+        const __m512d vx = _mm512_load_pd(x + i);
+        const __m512d vy = _mm512_load_pd(y + i);
+        const __m512d vz = _mm512_load_pd(z + i);
+        __m512d n2 = _mm512_mul_pd(vx, vx);
+        n2 = _mm512_fmadd_pd(vy, vy, n2);
+        n2 = _mm512_fmadd_pd(vz, vz, n2);
+        const __mmask8 nonzero = _mm512_cmpneq_pd_mask(
+          n2, _mm512_setzero_pd()
+        );
+        const __m512d norm = _mm512_mask_sqrt_pd(one, nonzero, n2);
+        _mm512_store_pd(x + i, _mm512_div_pd(vx, norm));
+        _mm512_store_pd(y + i, _mm512_div_pd(vy, norm));
+        _mm512_store_pd(z + i, _mm512_div_pd(vz, norm));
+      }
+      NormalizeScalar(x, y, z, i, n);
+    }
+
+    inline void Normalize(
+      float* x, float* y, float* z, const std::size_t n
+    ) noexcept
+    {
+      const __m512 one = _mm512_set1_ps(1.f);
+      std::size_t i = 0;
+      for (; i + 16 <= n; i += 16) {
+        const __m512 vx = _mm512_load_ps(x + i);
+        const __m512 vy = _mm512_load_ps(y + i);
+        const __m512 vz = _mm512_load_ps(z + i);
+        __m512 n2 = _mm512_mul_ps(vx, vx);
+        n2 = _mm512_fmadd_ps(vy, vy, n2);
+        n2 = _mm512_fmadd_ps(vz, vz, n2);
+        const __mmask16 nonzero = _mm512_cmpneq_ps_mask(
+          n2, _mm512_setzero_ps()
+        );
+        const __m512 norm = _mm512_mask_sqrt_ps(one, nonzero, n2);
+        _mm512_store_ps(x + i, _mm512_div_ps(vx, norm));
+        _mm512_store_ps(y + i, _mm512_div_ps(vy, norm));
+        _mm512_store_ps(z + i, _mm512_div_ps(vz, norm));
+      }
+      NormalizeScalar(x, y, z, i, n);
+    }
+#elif defined(__AVX2__)
+    inline void Normalize(
+      double* x, double* y, double* z, const std::size_t n
+    ) noexcept
+    {
+      const __m256d one = _mm256_set1_pd(1.);
+      const __m256d zero = _mm256_setzero_pd();
+      std::size_t i = 0;
+      for (; i + 4 <= n; i += 4) {
+        const __m256d vx = _mm256_load_pd(x + i);
+        const __m256d vy = _mm256_load_pd(y + i);
+        const __m256d vz = _mm256_load_pd(z + i);
+        __m256d n2 = _mm256_mul_pd(vx, vx);
+        n2 = _mm256_add_pd(n2, _mm256_mul_pd(vy, vy));
+        n2 = _mm256_add_pd(n2, _mm256_mul_pd(vz, vz));
+        const __m256d norm = _mm256_blendv_pd(
+          _mm256_sqrt_pd(n2), one, _mm256_cmp_pd(n2, zero, _CMP_EQ_OQ)
+        );
+        _mm256_store_pd(x + i, _mm256_div_pd(vx, norm));
+        _mm256_store_pd(y + i, _mm256_div_pd(vy, norm));
+        _mm256_store_pd(z + i, _mm256_div_pd(vz, norm));
+      }
+      NormalizeScalar(x, y, z, i, n);
+    }
+
+    inline void Normalize(
+      float* x, float* y, float* z, const std::size_t n
+    ) noexcept
+    {
+      const __m256 one = _mm256_set1_ps(1.f);
+      const __m256 zero = _mm256_setzero_ps();
+      std::size_t i = 0;
+      for (; i + 8 <= n; i += 8) {
+        const __m256 vx = _mm256_load_ps(x + i);
+        const __m256 vy = _mm256_load_ps(y + i);
+        const __m256 vz = _mm256_load_ps(z + i);
+        __m256 n2 = _mm256_mul_ps(vx, vx);
+        n2 = _mm256_add_ps(n2, _mm256_mul_ps(vy, vy));
+        n2 = _mm256_add_ps(n2, _mm256_mul_ps(vz, vz));
+        const __m256 norm = _mm256_blendv_ps(
+          _mm256_sqrt_ps(n2), one, _mm256_cmp_ps(n2, zero, _CMP_EQ_OQ)
+        );
+        _mm256_store_ps(x + i, _mm256_div_ps(vx, norm));
+        _mm256_store_ps(y + i, _mm256_div_ps(vy, norm));
+        _mm256_store_ps(z + i, _mm256_div_ps(vz, norm));
+      }
+      NormalizeScalar(x, y, z, i, n);
+    }
+#endif
+  }
+
+
+  // The element-wise kernels below are plain loops over the aligned
+  // component arrays, which the compiler vectorizes to the target width.
+
+  // out[i] = a[i] . b[i]
+  template <std::floating_point T>
+  void Dot(
+    const Vector3Array<T>& a, const Vector3Array<T>& b, std::span<T> out
+  )
+  {
+    const std::size_t n = a.size();
+    detail::CheckArraySize(b.size() == n && out.size() >= n);
+    const T* ax = a.get_x().data();
+    const T* ay = a.get_y().data();
+    const T* az = a.get_z().data();
+    const T* bx = b.get_x().data();
+    const T* by = b.get_y().data();
+    const T* bz = b.get_z().data();
+    T* dst = out.data();
+    for (std::size_t i = 0; i < n; ++i) {
+      dst[i] = ax[i] * bx[i] + ay[i] * by[i] + az[i] * bz[i];
+    }
+  }
+
+  // out[i] = a[i] x b[i].  `out` may be `a` or `b`.
+  template <std::floating_point T>
+  void Cross(
+    const Vector3Array<T>& a, const Vector3Array<T>& b, Vector3Array<T>& out
+  )
+  {
+    const std::size_t n = a.size();
+    detail::CheckArraySize(b.size() == n);
+    if (out.size() != n) {
+      out.resize(n);
+    }
+    const T* ax = a.get_x().data();
+    const T* ay = a.get_y().data();
+    const T* az = a.get_z().data();
+    const T* bx = b.get_x().data();
+    const T* by = b.get_y().data();
+    const T* bz = b.get_z().data();
+    T* ox = out.get_x().data();
+    T* oy = out.get_y().data();
+    T* oz = out.get_z().data();
+    for (std::size_t i = 0; i < n; ++i) {
+      const T x = ay[i] * bz[i] - az[i] * by[i];
+      const T y = az[i] * bx[i] - ax[i] * bz[i];
+      const T z = ax[i] * by[i] - ay[i] * bx[i];
+      ox[i] = x;
+      oy[i] = y;
+      oz[i] = z;
+    }
+  }
+
+  // out[i] = |a[i]|^2
+  template <std::floating_point T>
+  void Norm2(const Vector3Array<T>& a, std::span<T> out)
+  {
+    Dot(a, a, out);
+  }
+
+  // a[i] = a[i] / |a[i]|, leaving zero vectors unchanged.
+  template <std::floating_point T>
+  void Normalize(Vector3Array<T>& a) noexcept
+  {
+    detail::Normalize(
+      a.get_x().data(), a.get_y().data(), a.get_z().data(), a.size()
+    );
+  }
+
+  // y[i] += alpha x[i]
+  template <std::floating_point T>
+  void Axpy(const T alpha, const Vector3Array<T>& x, Vector3Array<T>& y)
+  {
+    const std::size_t n = x.size();
+    detail::CheckArraySize(y.size() == n);
+    const T* src[3] = {x.get_x().data(), x.get_y().data(), x.get_z().data()};
+    T* dst[3] = {y.get_x().data(), y.get_y().data(), y.get_z().data()};
+    for (std::size_t c = 0; c < 3; ++c) {
+      const T* s = src[c];
+      T* d = dst[c];
+      for (std::size_t i = 0; i < n; ++i) {
+        d[i] += alpha * s[i];
+      }
+    }
+  }
+
+  // a[i] *= alpha
+  template <std::floating_point T>
+  void Scale(const T alpha, Vector3Array<T>& a) noexcept
+  {
+    for (const std::span<T> component : {a.get_x(), a.get_y(), a.get_z()}) {
+      for (T& value : component) {
+        value *= alpha;
+      }
+    }
+  }
+}
+
+
+
+#endif // CXXVECTOR3ARRAY_H
@@ -64,6 +64,7 @@ namespace u
   inline constexpr double e = 1.602176634e-19 * C; // Planck constant
   inline constexpr double k_B = 1.380649e-23 * J / K; // Boltzmann constant
   inline constexpr double N_A = 6.02214076e+23 / mol; // Avogadro constant
+  inline constexpr double G = 6.67430e-11 * m * m * m / kg / s / s; // Newtonian constant of gravitation
 
   inline constexpr double eV  = e * V;
   inline constexpr double meV = 1e-3 * eV;
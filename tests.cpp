@@ -1,10 +1,44 @@
+#include <algorithm>
+#include <bit>
 #include <cassert>
+#include <chrono>
 #include <cmath>
+#include <complex>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
 #include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
 #include <tuple>
+#include <vector>
 
 #include <Color.h>
+#include <ColorConvert.h>
+#include <Colormap.h>
+#include <Decomposition.h>
+#include <DynMatrix.h>
+#include <HermitianEigen.h>
+#include <Image.h>
+#include <Kron.h>
+#include <Matrix.h>
+#include <MatrixBatch.h>
+#include <MatrixExp.h>
+#include <NBody.h>
+#include <Ode.h>
+#include <Palette.h>
+#include <PlanarMatrix.h>
+#include <ProgressBar.h>
+#include <ProgressGroup.h>
+#include <Quaternion.h>
+#include <SparseMatrix.h>
+#include <SpatialIndex.h>
+#include <Support.h>
+#include <ThreadPool.h>
 #include <Vector3.h>
+#include <Vector3Array.h>
 
 
 
@@ -49,6 +83,570 @@ void TestVector3()
 }
 
 
+void TestVector3Array()
+{
+  using csp::math::Vector3;
+  using csp::math::Vector3Array;
+  using V = Vector3<double>;
+
+  const std::size_t n = 37;
+  std::vector<V> as(n);
+  std::vector<V> bs(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    as[i] = {std::sin(0.3 * i), std::cos(0.5 * i), 0.1 * i};
+    bs[i] = {1. - 0.2 * i, std::sin(1.1 * i), std::cos(0.7 * i)};
+  }
+  as[5] = {0., 0., 0.};
+
+  Vector3Array<double> a(as);
+  const Vector3Array<double> b(bs);
+  assert(a.size() == n && a[3] == as[3]);
+
+  std::vector<double> dots(n);
+  std::vector<double> norms(n);
+  csp::math::Dot(a, b, std::span<double>(dots));
+  csp::math::Norm2(a, std::span<double>(norms));
+  Vector3Array<double> crosses;
+  csp::math::Cross(a, b, crosses);
+  for (std::size_t i = 0; i < n; ++i) {
+    assert(std::abs(dots[i] - as[i].dot(bs[i])) < 1e-14);
+    assert(std::abs(norms[i] - as[i].norm2()) < 1e-14);
+    assert((V(crosses[i]) - as[i].cross(bs[i])).norm() < 1e-14);
+  }
+
+  Vector3Array<double> normalized = a;
+  csp::math::Normalize(normalized);
+  csp::math::Axpy(2., b, a);
+  csp::math::Scale(0.5, a);
+  for (std::size_t i = 0; i < n; ++i) {
+    assert((V(normalized[i]) - as[i].normalize()).norm() < 1e-15);
+    assert((V(a[i]) - (as[i] + bs[i] * 2.) * 0.5).norm() < 1e-14);
+  }
+  assert(normalized[5] == V(0., 0., 0.));
+
+  Vector3Array<float> f(20);
+  f[19] = Vector3<float>(3.f, 0.f, 4.f);
+  f[19] += Vector3<float>(0.f, 0.f, 0.f);
+  f[18].x_ = 2.f;
+  f[17] = f[19];
+  f[17] *= 2.f;
+  assert(f[17].norm() == 10.f && f[19].dot({1.f, 1.f, 1.f}) == 7.f);
+  csp::math::Normalize(f);
+  assert(f[18] == Vector3<float>(1.f, 0.f, 0.f));
+  assert(std::abs(f[19].x_ - 0.6f) < 1e-7f && f[0].norm2() == 0.f);
+
+  std::vector<Vector3<float>> out(20);
+  f.Gather(out);
+  assert(out[18] == Vector3<float>(1.f, 0.f, 0.f));
+}
+
+
+void TestQuaternion()
+{
+  using csp::math::Matrix;
+  using csp::math::Quaternion;
+  using csp::math::Vector3;
+  using Q = Quaternion<double>;
+  using V = Vector3<double>;
+
+  constexpr double pi = 3.14159265358979323846;
+  const auto near = [](const V& a, const V& b) {
+    return (a - b).norm() < 1e-12;
+  };
+
+  const Q quarter_z = Q::FromAxisAngle({0., 0., 2.}, pi / 2.);
+  assert(near(quarter_z.rotate({1., 0., 0.}), {0., 1., 0.}));
+  assert(std::abs(quarter_z.get_angle() - pi / 2.) < 1e-12);
+  assert(near(quarter_z.get_axis(), {0., 0., 1.}));
+  static_assert(Q().rotate(V(1., 2., 3.)) == V(1., 2., 3.));
+
+  // q p rotates by p first.
+  const Q quarter_x = Q::FromAxisAngle({1., 0., 0.}, pi / 2.);
+  const V e_y = {0., 1., 0.};
+  assert(near((quarter_x * quarter_z).rotate({1., 0., 0.}), {0., 0., 1.}));
+  assert(near(
+    (quarter_z * quarter_x).rotate(e_y), quarter_z.rotate(quarter_x.rotate(e_y))
+  ));
+  Q composed = quarter_z;
+  composed *= quarter_z.inverse();
+  assert(std::abs(composed.w_ - 1.) < 1e-15);
+
+  const Q q = Q::FromAxisAngle({1., -2., 0.5}, 2.3);
+  const Matrix<double, 3, 3> rot = q.ToMatrix();
+  Matrix<double, 3, 1> col;
+  col.getf(0) = 0.3;
+  col.getf(1) = -1.2;
+  col.getf(2) = 2.;
+  const Matrix<double, 3, 1> rotated = rot * col;
+  assert(near(
+    {rotated.cgetf(0), rotated.cgetf(1), rotated.cgetf(2)},
+    q.rotate({0.3, -1.2, 2.})
+  ));
+  for (const Q& p : {q, -q, quarter_z, Q::FromAxisAngle({0., 1., 0.}, 3.1)}) {
+    const Q back = Q::FromMatrix(p.ToMatrix());
+    assert(std::abs(std::abs(back.dot(p)) - 1.) < 1e-12);
+  }
+
+  const V from = {1., 2., -1.};
+  const V to = {-3., 0.5, 2.};
+  assert(near(Q::FromTwoVectors(from, to).rotate(from.normalize()),
+    to.normalize()));
+  assert(near(Q::FromTwoVectors(from, -from).rotate(from), -from));
+
+  const Q half = csp::math::Slerp(Q(), quarter_z, 0.5);
+  assert(near(half.rotate({1., 0., 0.}), {std::sqrt(.5), std::sqrt(.5), 0.}));
+  assert(csp::math::Slerp(q, -q, 0.3).dot(q) > 1. - 1e-12);
+  assert(std::abs(csp::math::Slerp(quarter_x, q, 1.).dot(q) - 1.) < 1e-12);
+
+  std::vector<V> vecs(20000);
+  for (std::size_t i = 0; i < vecs.size(); ++i) {
+    vecs[i] = {std::sin(0.1 * i), std::cos(0.3 * i), 0.001 * i};
+  }
+  csp::math::Vector3Array<double> soa(vecs);
+  const std::vector<V> original = vecs;
+  std::vector<V> expected = vecs;
+  for (V& v : expected) {
+    v = q.rotate(v);
+  }
+  q.rotate(std::span<V>(vecs));
+  q.rotate(soa);
+  for (std::size_t i = 0; i < vecs.size(); i += 97) {
+    assert(near(vecs[i], expected[i]) && near(soa[i], expected[i]));
+  }
+
+  csp::utils::SetGlobalThreads(4);
+  q.inverse().rotate(std::span<V>(vecs));
+  csp::utils::SetGlobalThreads(0);
+  for (std::size_t i = 0; i < vecs.size(); i += 97) {
+    assert(near(vecs[i], original[i]));
+  }
+}
+
+
+void TestSpatialIndex()
+{
+  using csp::math::CellList;
+  using csp::math::KdTree;
+  using V = csp::math::Vector3<double>;
+
+  const auto uniform = [](const std::size_t i) {
+    const double t = std::sin(12.9898 * double(i) + 0.5) * 43758.5453;
+    return t - std::floor(t);
+  };
+  const auto cloud = [&](const std::size_t n, const double side) {
+    std::vector<V> points(n);
+    for (std::size_t i = 0; i < n; ++i) {
+      points[i] = {
+        side * uniform(3 * i), side * uniform(3 * i + 1),
+        side * uniform(3 * i + 2)
+      };
+    }
+    return points;
+  };
+  const auto image = [](const double d, const double side) {
+    return d - side * std::nearbyint(d / side);
+  };
+
+  // Brute-force neighbor sets, periodic or not.
+  const auto brute = [&](
+    const std::vector<V>& points, const V& p, const double radius,
+    const double side
+  ) {
+    std::vector<std::size_t> result;
+    for (std::size_t j = 0; j < points.size(); ++j) {
+      V d = points[j] - p;
+      if (side > 0.) {
+        d = {image(d.x_, side), image(d.y_, side), image(d.z_, side)};
+      }
+      if (d.norm2() <= radius * radius) {
+        result.push_back(j);
+      }
+    }
+    return result;
+  };
+  const auto sorted = [](std::vector<std::size_t> indices) {
+    std::sort(indices.begin(), indices.end());
+    return indices;
+  };
+
+  {
+    const double side = 10.;
+    std::vector<V> points = cloud(3000, side);
+    CellList<double> cells({0., 0., 0.}, {side, side, side}, 1.2, true);
+    cells.Build(points);
+    assert(cells.size() == 3000 && cells.cells() == 8 * 8 * 8);
+    for (std::size_t i = 0; i < points.size(); i += 37) {
+      assert(
+        sorted(cells.Neighbors(points[i]))
+          == brute(points, points[i], 1.2, side)
+      );
+    }
+
+    // Small steps: most points stay in their cell.
+    for (std::size_t i = 0; i < points.size(); ++i) {
+      points[i] += V(0.05, -0.03, 0.02) * uniform(i + 7);
+    }
+    const std::size_t moved = cells.Update(points);
+    assert(moved > 0 && moved < points.size() / 4);
+    for (std::size_t i = 0; i < points.size(); i += 37) {
+      assert(
+        sorted(cells.Neighbors(points[i]))
+          == brute(points, points[i], 1.2, side)
+      );
+    }
+
+    // Everything into one cell overflows the spare slots.
+    std::vector<V> packed(points.size(), V(5.5, 5.5, 5.5));
+    for (std::size_t i = 0; i < 10; ++i) {
+      packed[i] = points[i];
+    }
+    cells.Update(packed);
+    assert(cells.Neighbors(V(5.5, 5.5, 5.5)).size() >= points.size() - 10);
+    cells.Update(points);
+
+    csp::utils::SetGlobalThreads(4);
+    const csp::math::NeighborList list = cells.Neighbors(
+      std::span<const V>(points)
+    );
+    csp::utils::SetGlobalThreads(0);
+    assert(list.offsets_.size() == points.size() + 1);
+    for (std::size_t i = 0; i < points.size(); i += 53) {
+      const std::vector<std::size_t> found(
+        list.indices_.begin() + list.offsets_[i],
+        list.indices_.begin() + list.offsets_[i + 1]
+      );
+      assert(sorted(found) == brute(points, points[i], 1.2, side));
+    }
+  }
+
+  {
+    // Two cells per axis, and points outside an open box.
+    const std::vector<V> points = cloud(500, 2.5);
+    CellList<double> periodic({0., 0., 0.}, {2.5, 2.5, 2.5}, 1.2, true);
+    periodic.Build(points);
+    CellList<double> open({0.5, 0.5, 0.5}, {2., 2., 2.}, 0.4, false);
+    open.Build(points);
+    for (std::size_t i = 0; i < points.size(); i += 11) {
+      assert(
+        sorted(periodic.Neighbors(points[i]))
+          == brute(points, points[i], 1.2, 2.5)
+      );
+      assert(
+        sorted(open.Neighbors(points[i])) == brute(points, points[i], 0.4, 0.)
+      );
+    }
+    bool is_thrown = false;
+    try {
+      CellList<double>({0., 0., 0.}, {2., 2., 2.}, 1.2, true);
+    } catch (const std::invalid_argument&) {
+      is_thrown = true;
+    }
+    assert(is_thrown);
+  }
+
+  {
+    std::vector<V> points = cloud(5000, 1.);
+    KdTree<double> tree(points);
+    const auto check = [&](const V& p, const std::size_t k) {
+      const std::vector<csp::math::Neighbor<double>> found = tree.Knn(p, k);
+      std::vector<double> d2(points.size());
+      for (std::size_t j = 0; j < points.size(); ++j) {
+        d2[j] = (points[j] - p).norm2();
+      }
+      std::sort(d2.begin(), d2.end());
+      assert(found.size() == std::min(k, points.size()));
+      for (std::size_t j = 0; j < found.size(); ++j) {
+        assert(found[j].distance2_ == d2[j]);
+        assert((points[found[j].index_] - p).norm2() == d2[j]);
+      }
+    };
+    for (std::size_t i = 0; i < 40; ++i) {
+      check(V(uniform(i), uniform(i + 100), uniform(i + 200)) * 1.2, 8);
+    }
+    check(V(3., -1., 0.5), 1);
+    check(points[17], 40);
+
+    for (std::size_t i = 0; i < points.size(); ++i) {
+      points[i] += V(0.01, 0.02, -0.01) * uniform(i + 3);
+    }
+    tree.Update(points);
+    for (std::size_t i = 0; i < 20; ++i) {
+      check(points[i * 101], 5);
+    }
+
+    const std::size_t k = 4;
+    std::vector<std::size_t> batch(points.size() * k);
+    csp::utils::SetGlobalThreads(4);
+    tree.Knn(std::span<const V>(points), k, batch);
+    csp::utils::SetGlobalThreads(0);
+    for (std::size_t i = 0; i < points.size(); i += 97) {
+      const std::vector<csp::math::Neighbor<double>> found = tree.Knn(
+        points[i], k
+      );
+      assert(batch[i * k] == i);
+      for (std::size_t j = 0; j < k; ++j) {
+        assert(batch[i * k + j] == found[j].index_);
+      }
+    }
+
+    KdTree<double> empty;
+    assert(empty.Knn(V(0., 0., 0.), 3).empty());
+  }
+}
+
+
+void TestNBody()
+{
+  using csp::math::BarnesHut;
+  using V = csp::math::Vector3<double>;
+
+  const auto uniform = [](const std::size_t i) {
+    const double t = std::sin(78.233 * double(i) + 0.25) * 43758.5453;
+    return t - std::floor(t);
+  };
+  // Relative RMS error of `approx` against `exact`.
+  const auto error = [](const std::vector<V>& approx,
+    const std::vector<V>& exact) {
+    double diff = 0.;
+    double norm = 0.;
+    for (std::size_t i = 0; i < exact.size(); ++i) {
+      diff += (approx[i] - exact[i]).norm2();
+      norm += exact[i].norm2();
+    }
+    return std::sqrt(diff / norm);
+  };
+
+  // Ions of both signs in a 10 nm box, with a dense clump in one corner.
+  const std::size_t n = 5000;
+  std::vector<V> positions(n);
+  std::vector<double> charges(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    const double side = i % 5 == 0 ? 1. * u::nm : 10. * u::nm;
+    positions[i] = V(uniform(3 * i), uniform(3 * i + 1), uniform(3 * i + 2))
+      * side;
+    charges[i] = (i % 2 == 0 ? 1. : -2.) * u::e;
+  }
+
+  std::vector<V> exact(n);
+  csp::math::DirectForces<double>(
+    positions, charges, csp::math::kCoulomb, 0., exact
+  );
+
+  BarnesHut<double> tree(0.5, csp::math::kCoulomb);
+  tree.Build(positions, charges);
+  assert(tree.size() == n && tree.nodes() > n / BarnesHut<double>::kLeafSize);
+  std::vector<V> forces(n);
+  tree.Forces(forces);
+  const double error_half = error(forces, exact);
+  assert(error_half < 1e-2);
+
+  tree.SetOpeningAngle(0.);
+  tree.Forces(forces);
+  assert(error(forces, exact) < 1e-12);
+
+  tree.SetOpeningAngle(0.3);
+  tree.Forces(forces);
+  assert(error(forces, exact) < error_half);
+
+  // Parallel build and traversal give the serial result.
+  csp::utils::SetGlobalThreads(4);
+  BarnesHut<double> parallel(0.3, csp::math::kCoulomb);
+  parallel.Build(positions, charges);
+  std::vector<V> parallel_forces(n);
+  parallel.Forces(parallel_forces);
+  csp::utils::SetGlobalThreads(0);
+  assert(parallel.nodes() == tree.nodes());
+  assert(error(parallel_forces, forces) < 1e-14);
+
+  // Gravity of a softened cluster: attractive towards the center.
+  std::vector<double> masses(2000, 1e3 * u::kg);
+  std::vector<V> stars(2000);
+  for (std::size_t i = 0; i < stars.size(); ++i) {
+    stars[i] = V(uniform(i), uniform(i + 9000), uniform(i + 18000)) * 2.
+      - V(1., 1., 1.);
+  }
+  std::vector<V> pull(stars.size());
+  std::vector<V> reference(stars.size());
+  BarnesHut<double> gravity(0.7, csp::math::kGravity, 0.01);
+  gravity.Build(stars, masses);
+  gravity.Forces(pull);
+  csp::math::DirectForces<double>(
+    stars, masses, csp::math::kGravity, 0.01, reference
+  );
+  assert(error(pull, reference) < 1e-2);
+  assert(reference[0].dot(stars[0]) < 0.);
+  const V far = gravity.Field({100., 0., 0.}) * csp::math::kGravity;
+  assert(std::abs(far.x_ / (-u::G * 2e6 / 1e4) - 1.) < 1e-2);
+
+  bool is_thrown = false;
+  try {
+    tree.SetOpeningAngle(1.5);
+  } catch (const std::invalid_argument&) {
+    is_thrown = true;
+  }
+  assert(is_thrown);
+}
+
+
+void TestOde()
+{
+  using csp::math::DynMatrix;
+  using csp::math::Matrix;
+  using C = std::complex<double>;
+  using State = Matrix<double, 2, 1>;
+
+  // x'' = -x from (1, 0): x = cos t.
+  const auto oscillator = [](const double, const State& y, State& dydt) {
+    dydt.getf(0) = y.cgetf(1);
+    dydt.getf(1) = -y.cgetf(0);
+  };
+  const auto rk4_error = [&](const std::size_t steps) {
+    State y;
+    y.getf(0) = 1.;
+    csp::math::Rk4<State> rk4(y);
+    double t = 0.;
+    rk4.Integrate(oscillator, t, y, 2. * u::pi / double(steps), steps);
+    assert(std::abs(t - 2. * u::pi) < 1e-12);
+    return std::abs(y.cgetf(0) - 1.) + std::abs(y.cgetf(1));
+  };
+  const double coarse = rk4_error(50);
+  const double fine = rk4_error(100);
+  assert(fine < 1e-6 && coarse / fine > 12. && coarse / fine < 20.);
+
+  // Rotation about z keeps the norm of a Vector3.
+  {
+    using V = csp::math::Vector3<double>;
+    V r = {1., 2., 0.5};
+    csp::math::Rk4<V> rk4(r);
+    double t = 0.;
+    rk4.Integrate(
+      [](const double, const V& x, V& dxdt) {
+        dxdt = V(0., 0., 1.).cross(x);
+      },
+      t, r, 0.01, 100
+    );
+    assert(std::abs(r.norm2() - 5.25) < 1e-10);
+    assert(std::abs(r.x_ - (std::cos(1.) - 2. * std::sin(1.))) < 1e-9);
+  }
+
+  // Schrodinger equation for a move-only DynMatrix: U' = -i H U.
+  {
+    const std::size_t n = 6;
+    DynMatrix<C> h(n, n);
+    DynMatrix<C> u(n, n);
+    for (std::size_t row = 0; row < n; ++row) {
+      for (std::size_t col = 0; col <= row; ++col) {
+        const double x = std::sin(0.7 * (row * row + 3 * col));
+        const double y = row == col ? 0. : std::cos(1.3 * (row + col));
+        h.getf(row, col) = {x, y};
+        h.getf(col, row) = {x, -y};
+      }
+      u.getf(row, row) = 1.;
+    }
+    csp::math::DormandPrince<DynMatrix<C>> dopri(u, 1e-12, 1e-10);
+    double t = 0.;
+    double step = 0.1;
+    const std::size_t steps = dopri.Integrate(
+      [&](const double, const DynMatrix<C>& y, DynMatrix<C>& dydt) {
+        std::fill_n(dydt.data(), n * n, C(0.));
+        csp::math::gemm::Multiply(
+          n, n, n, C(0., -1.), h.data(), n, y.data(), n, dydt.data(), n
+        );
+      },
+      t, u, 3., step
+    );
+    assert(t == 3. && steps > 10 && steps < 2000);
+    const DynMatrix<C> exact = csp::math::Expm<DynMatrix<C>>(h * C(0., -3.));
+    for (std::size_t i = 0; i < n * n; ++i) {
+      assert(std::abs(u.cgetf(i) - exact.cgetf(i)) < 1e-8);
+    }
+  }
+
+  // Lockstep batch: 1000 oscillators of different frequencies share the
+  // steps, which the stiffest one sets.
+  {
+    using Batch = csp::math::MatrixBatch<double, 2, 1>;
+    const std::size_t m = 1000;
+    std::vector<double> omega2(m);
+    Batch y(m);
+    for (std::size_t k = 0; k < m; ++k) {
+      omega2[k] = 1. + 0.01 * double(k);
+      y.data(0, 0)[k] = 1.;
+    }
+    const auto rhs = [&](const double, const Batch& state, Batch& d) {
+      const double* x = state.data(0, 0);
+      const double* v = state.data(1, 0);
+      double* dx = d.data(0, 0);
+      double* dv = d.data(1, 0);
+      for (std::size_t k = 0; k < m; ++k) {
+        dx[k] = v[k];
+        dv[k] = -omega2[k] * x[k];
+      }
+    };
+    csp::math::DormandPrince<Batch> dopri(y, 1e-10, 1e-10);
+    double t = 0.;
+    double step = 1e-3;
+    dopri.Integrate(rhs, t, y, 2., step);
+    for (std::size_t k = 0; k < m; k += 37) {
+      const double exact = std::cos(std::sqrt(omega2[k]) * 2.);
+      assert(std::abs(y.data(0, 0)[k] - exact) < 1e-7);
+    }
+
+    // Single steps with a far too large h are rejected, then shrink.
+    t = 0.;
+    step = 50.;
+    Batch z(m);
+    std::fill_n(z.data(0, 0), m, 1.);
+    std::size_t rejected = 0;
+    while (!dopri.Step(rhs, t, z, step)) {
+      ++rejected;
+    }
+    assert(rejected > 0 && t > 0. && t < 50.);
+  }
+
+  // Particles in a harmonic trap: velocity Verlet keeps the energy.
+  {
+    using csp::math::Vector3Array;
+    const std::size_t m = 500;
+    Vector3Array<double> x(m);
+    Vector3Array<double> v(m);
+    for (std::size_t k = 0; k < m; ++k) {
+      x[k] = {std::sin(0.1 * k), std::cos(0.2 * k), 0.01 * k};
+      v[k] = {0., 0.5, -std::sin(0.3 * k)};
+    }
+    const auto energy = [&]() {
+      std::vector<double> x2(m);
+      std::vector<double> v2(m);
+      csp::math::Norm2(x, std::span<double>(x2));
+      csp::math::Norm2(v, std::span<double>(v2));
+      double result = 0.;
+      for (std::size_t k = 0; k < m; ++k) {
+        result += 0.5 * (x2[k] + v2[k]);
+      }
+      return result;
+    };
+    const Vector3Array<double> start = x;
+    const double energy0 = energy();
+
+    csp::math::VelocityVerlet<Vector3Array<double>> verlet(x);
+    double t = 0.;
+    const std::size_t steps = 1000;
+    verlet.Integrate(
+      [](const double, const Vector3Array<double>& pos,
+        Vector3Array<double>& accel) {
+        accel = pos;
+        csp::math::Scale(-1., accel);
+      },
+      t, x, v, 2. * u::pi / double(steps), 10 * steps
+    );
+    assert(std::abs(energy() / energy0 - 1.) < 1e-4);
+    for (std::size_t k = 0; k < m; k += 23) {
+      assert((csp::math::Vector3<double>(x[k]) - start[k]).norm() < 1e-3);
+    }
+  }
+}
+
+
 void TestColor()
 {
   using csp::utils::Color;
@@ -104,13 +702,1423 @@ void TestColor()
 
 
 
+void TestColorConvert()
+{
+  using csp::utils::Color;
+  using csp::utils::Hsv;
+
+  const auto same_hsv = [](
+    const Hsv& a, const std::tuple<float, float, float>& b
+  ) {
+    return std::bit_cast<std::uint32_t>(a.h_)
+        == std::bit_cast<std::uint32_t>(std::get<0>(b))
+      && std::bit_cast<std::uint32_t>(a.s_)
+        == std::bit_cast<std::uint32_t>(std::get<1>(b))
+      && std::bit_cast<std::uint32_t>(a.v_)
+        == std::bit_cast<std::uint32_t>(std::get<2>(b));
+  };
+
+  // Every 31st 24-bit color, plus the greys and primaries.
+  std::vector<Color> colors;
+  for (std::uint32_t hex = 0; hex < (1u << 24); hex += 31) {
+    colors.emplace_back(hex);
+  }
+  for (std::uint32_t k = 0; k < 256; ++k) {
+    colors.emplace_back(k * 0x010101u);
+    colors.emplace_back(k << 16);
+    colors.emplace_back(k << 8 | 0xFF0000u);
+  }
+
+  csp::utils::SetGlobalThreads(4);
+  std::vector<Hsv> hsv(colors.size());
+  csp::utils::ToHsv(colors, hsv);
+  std::vector<Color> back(colors.size());
+  csp::utils::ToRgb(hsv, back);
+  csp::utils::SetGlobalThreads(0);
+  for (std::size_t i = 0; i < colors.size(); ++i) {
+    const auto scalar = colors[i].to_hsv();
+    assert(same_hsv(hsv[i], scalar));
+    assert(back[i] == Color(scalar));
+  }
+
+  // Arbitrary HSV input, including the sector edges.
+  std::vector<Hsv> samples;
+  for (std::size_t i = 0; i < 5000; ++i) {
+    const float h = i < 8 ? 60.f * float(i % 7) : float(i % 3600) * 0.1f;
+    samples.push_back({h, float(i % 101) / 100.f, float(i % 97) / 96.f});
+  }
+  // Hues past a turn go through the same fmod, down to where floats are
+  // integral; negative ones too, with s small enough to stay in range.
+  for (const float h : {360.f, 725.5f, 1e6f + 0.25f, 1.6777e7f, 3e9f, 1e30f}) {
+    samples.push_back({h, 0.7f, 0.9f});
+    samples.push_back({-h, 0.3f, 0.9f});
+  }
+  std::vector<Color> rgb(samples.size());
+  csp::utils::ToRgb(samples, rgb);
+  for (std::size_t i = 0; i < samples.size(); ++i) {
+    assert(rgb[i] == Color(samples[i].h_, samples[i].s_, samples[i].v_));
+  }
+
+  bool is_thrown = false;
+  try {
+    csp::utils::ToHsv(colors, std::span<Hsv>(hsv.data(), 3));
+  } catch (const std::invalid_argument&) {
+    is_thrown = true;
+  }
+  assert(is_thrown);
+}
+
+
+void TestColormap()
+{
+  using csp::utils::Color;
+  using csp::utils::Colormap;
+
+  const Colormap viridis = Colormap::Viridis();
+  const auto table = viridis.get_table();
+  assert(table.front() == Color(0x440154u));
+  assert(table.back() == Color(0xFDE725u));
+  assert(viridis.Map(-1.f) == table.front());
+  assert(viridis.Map(0.5f) == table[512]);
+  assert(viridis.Map(2.f) == table.back());
+  assert(viridis.Map(std::nanf("")) == table.front());
+  assert(Colormap::Magma().get_table().back() == Color(0xFCFDBFu));
+
+  // Uneven user stops: black up to a quarter, then a ramp to white.
+  const std::vector<float> positions = {0.f, 0.25f, 1.f};
+  const std::vector<Color> stops = {
+    Color(0x000000u), Color(0x000000u), Color(0xFFFFFFu)
+  };
+  Colormap grey(positions, stops);
+  assert(grey.Map(0.2f) == Color(0x000000u));
+  assert(grey.get_table()[1023] == Color(0xFFFFFFu));
+  const auto [r, g, b] = grey.Map(0.625f).to_rgb();
+  assert(r == g && g == b && std::abs(r - 128) <= 1);
+
+  grey.SetRange(-10.f, 10.f);
+  assert(grey.get_lower() == -10.f && grey.get_upper() == 10.f);
+  assert(grey.Map(-6.f) == Color(0x000000u));
+  assert(grey.Map(-2.5f) != Color(0x000000u));
+  assert(grey.Map(10.f) == Color(0xFFFFFFu));
+
+  // Bulk, matrix and strided paths agree with the scalar lookup.
+  csp::utils::SetGlobalThreads(4);
+  const std::size_t rows = 300;
+  const std::size_t cols = 250;
+  const std::size_t stride = 256;
+  std::vector<float> field(rows * stride);
+  for (std::size_t i = 0; i < field.size(); ++i) {
+    field[i] = std::sin(0.001f * static_cast<float>(i)) * 12.f;
+  }
+  std::vector<Color> pixels(field.size());
+  grey.Map(field, pixels);
+  for (std::size_t i = 0; i < field.size(); ++i) {
+    assert(pixels[i] == grey.Map(field[i]));
+  }
+  std::vector<Color> image(rows * cols);
+  grey.Map(field, rows, cols, stride, image);
+  for (std::size_t row = 0; row < rows; ++row) {
+    for (std::size_t col = 0; col < cols; ++col) {
+      assert(image[row * cols + col] == pixels[row * stride + col]);
+    }
+  }
+  csp::utils::SetGlobalThreads(0);
+
+  csp::math::Matrix<double, 2, 3> mat;
+  for (std::size_t k = 0; k < 6; ++k) {
+    mat.data()[k] = 4.0 * static_cast<double>(k) - 10.0;
+  }
+  std::vector<Color> small(6);
+  grey.Map(mat, small);
+  for (std::size_t k = 0; k < 6; ++k) {
+    assert(small[k] == grey.Map(static_cast<float>(mat.data()[k])));
+  }
+
+  bool is_thrown = false;
+  try {
+    Colormap bad(std::vector<Color>{Color(0x000000u)});
+  } catch (const std::invalid_argument&) {
+    is_thrown = true;
+  }
+  assert(is_thrown);
+  is_thrown = false;
+  try {
+    grey.SetRange(1.f, 1.f);
+  } catch (const std::invalid_argument&) {
+    is_thrown = true;
+  }
+  assert(is_thrown);
+}
+
+
+void TestImage()
+{
+  using csp::utils::Color;
+  using csp::utils::Image;
+  using Vec3F = csp::math::Vector3<float>;
+
+  const std::filesystem::path dir = std::filesystem::temp_directory_path();
+
+  Image<Color> rgb(2, 3, Color(0x102030u));
+  rgb.get(1, 2) = Color(0xFF8000u);
+  assert(rgb.rows() == 2 && rgb.cols() == 3 && rgb.size() == 6);
+  assert(rgb.row(1)[2] == Color(0xFF8000u));
+  assert(rgb.cget(0, 0) == Color(0x102030u));
+  const std::filesystem::path ppm = dir / "csp_test_image.ppm";
+  csp::file::WriteImage(ppm, rgb);
+  const std::string ppm_bytes = csp::file::Open(ppm);
+  assert(ppm_bytes.substr(0, 11) == "P6\n3 2\n255\n");
+  assert(ppm_bytes.size() == 11 + 18);
+  assert(ppm_bytes.substr(11, 3) == "\x10\x20\x30");
+  assert(ppm_bytes.substr(26, 3) == std::string("\xFF\x80\x00", 3));
+
+  // Streamed rows, as a renderer would hand them over.
+  const std::filesystem::path pgm = dir / "csp_test_image.pgm";
+  {
+    csp::file::PnmWriter<unsigned char> writer(pgm, 2, 2);
+    const unsigned char top[] = {1, 2};
+    const unsigned char bottom[] = {3, 4};
+    writer.WriteRow(top);
+    writer.WriteRow(bottom);
+    assert(writer.rows_written() == 2);
+    writer.Close();
+  }
+  assert(csp::file::Open(pgm) == std::string("P5\n2 2\n255\n\x01\x02\x03\x04"));
+
+  // PFM rows are stored bottom-up.
+  Image<Vec3F> hdr(2, 1);
+  hdr.getf(0, 0) = Vec3F(1.f, 2.f, 3.f);
+  hdr.getf(1, 0) = Vec3F(4.f, 5.f, 6.f);
+  const std::filesystem::path pfm = dir / "csp_test_image.pfm";
+  csp::file::WriteImage(pfm, hdr);
+  const std::string pfm_bytes = csp::file::Open(pfm);
+  const std::size_t header = pfm_bytes.size() - 6 * sizeof(float);
+  assert(pfm_bytes.substr(0, 7) == "PF\n1 2\n");
+  float samples[6];
+  std::memcpy(samples, pfm_bytes.data() + header, sizeof(samples));
+  assert(samples[0] == 4.f && samples[2] == 6.f);
+  assert(samples[3] == 1.f && samples[5] == 3.f);
+
+  Image<float> grey(1, 2, 0.5f);
+  csp::file::WriteImage(pfm, grey);
+  assert(csp::file::Open(pfm).substr(0, 7) == "Pf\n2 1\n");
+
+  bool is_thrown = false;
+  try {
+    csp::file::PnmWriter<Color> writer(ppm, 1, 3);
+    writer.WriteRow(rgb.row(0).first(2));
+  } catch (const std::invalid_argument&) {
+    is_thrown = true;
+  }
+  assert(is_thrown);
+  is_thrown = false;
+  try {
+    csp::file::PnmWriter<Color> writer(ppm, 2, 3);
+    writer.WriteRow(rgb.row(0));
+    writer.Close();
+  } catch (const std::runtime_error&) {
+    is_thrown = true;
+  }
+  assert(is_thrown);
+
+  std::filesystem::remove(ppm);
+  std::filesystem::remove(pgm);
+  std::filesystem::remove(pfm);
+}
+
+
+void TestPalette()
+{
+  using csp::utils::Color;
+
+  for (const std::uint32_t hex : {0xF06400u, 0x3366CCu, 0x20A040u, 0x808080u}) {
+    const Color base(hex);
+    const csp::utils::Palette palette(base);
+    assert(palette.get_base() == base);
+    for (int k = -40; k < 40; ++k) {
+      assert(palette.get(k) == base.GenerateColor(k));
+    }
+
+    // Spans longer than a block, with an offset start.
+    std::vector<Color> colors(150);
+    palette.Generate(colors, -7);
+    for (std::size_t i = 0; i < colors.size(); ++i) {
+      assert(colors[i] == base.GenerateColor(static_cast<int>(i) - 7));
+    }
+    assert(palette.Generate(std::size_t(5)).size() == 5);
+  }
+
+  csp::utils::PaletteCache cache;
+  const Color base(0xF06400u);
+  const auto first = cache.get(base, 12);
+  assert(first->size() == 12);
+  assert((*first)[3] == base.GenerateColor(3));
+  assert(cache.get(base, 12) == first);
+  assert(cache.get(base, 13) != first);
+  assert(cache.get(Color(0x3366CCu), 12) != first);
+  assert(cache.size() == 3);
+  cache.Clear();
+  assert(cache.size() == 0);
+  assert(*cache.get(base, 12) == *first);
+}
+
+
+template <typename Elem, std::size_t kRow, std::size_t kCol, std::size_t kCol2>
+bool CheckProduct(
+  const csp::math::Matrix<Elem, kRow, kCol>& a,
+  const csp::math::Matrix<Elem, kCol, kCol2>& b,
+  const double eps
+)
+{
+  const csp::math::Matrix<Elem, kRow, kCol2> c = a * b;
+  for (std::size_t row = 0; row < kRow; ++row) {
+    for (std::size_t col = 0; col < kCol2; ++col) {
+      Elem val = 0;
+      for (std::size_t tmp = 0; tmp < kCol; ++tmp) {
+        val += a.cgetf(row, tmp) * b.cgetf(tmp, col);
+      }
+      if (std::abs(c.cgetf(row, col) - val) > eps) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+
+void TestMatrix()
+{
+  using csp::math::Matrix;
+
+  {
+    Matrix<double, 37, 53> a;
+    Matrix<double, 53, 29> b;
+    for (std::size_t i = 0; i < 37 * 53; ++i) {
+      a.getf(i) = std::sin(0.1 * i);
+    }
+    for (std::size_t i = 0; i < 53 * 29; ++i) {
+      b.getf(i) = std::cos(0.3 * i);
+    }
+    assert(CheckProduct(a, b, 1e-10));
+  }
+
+  {
+    Matrix<float, 70, 70> a;
+    for (std::size_t i = 0; i < 70 * 70; ++i) {
+      a.getf(i) = static_cast<float>(i % 7) - 3.f;
+    }
+    assert(CheckProduct(a, a, 1e-3));
+  }
+
+  {
+    using C = std::complex<double>;
+    Matrix<C, 20, 20> a;
+    Matrix<C, 20, 20> b;
+    for (std::size_t i = 0; i < 20 * 20; ++i) {
+      a.getf(i) = {std::sin(0.2 * i), std::cos(0.7 * i)};
+      b.getf(i) = {0.01 * i, -0.5};
+    }
+    assert(CheckProduct(a, b, 1e-10));
+    assert(std::abs(a.commute(a).trace()) < 1e-10);
+  }
+
+  {
+    Matrix<int, 2, 2> a;
+    a.get(0, 1) = 1;
+    a.get(1, 0) = 1;
+    const Matrix<int, 2, 2> b = a * a;
+    assert(b.cget(0, 0) == 1 && b.cget(0, 1) == 0);
+  }
+
+  {
+    Matrix<double, 3, 3> a;
+    Matrix<double, 3, 3> b;
+    for (std::size_t i = 0; i < 9; ++i) {
+      a.getf(i) = static_cast<double>(i);
+      b.getf(i) = static_cast<double>(i * i) - 4.;
+    }
+
+    const Matrix<double, 3, 3> c = a + b * 2. - 1. - a;
+    for (std::size_t i = 0; i < 9; ++i) {
+      const double diag = (i % 4 == 0) ? 1. : 0.;
+      assert(std::abs(c.cgetf(i) - (2. * b.cgetf(i) - diag)) < 1e-12);
+    }
+
+    const Matrix<double, 3, 3> ab = a * b;
+    const Matrix<double, 3, 3> ba = b * a;
+    const Matrix<double, 3, 3> comm = a.commute(b);
+    const Matrix<double, 3, 3> d = 2. * (a * b) + a * b - ba;
+    for (std::size_t i = 0; i < 9; ++i) {
+      assert(std::abs(comm.cgetf(i) - (ab.cgetf(i) - ba.cgetf(i))) < 1e-12);
+      assert(std::abs(d.cgetf(i) - (3. * ab.cgetf(i) - ba.cgetf(i))) < 1e-12);
+    }
+
+    Matrix<double, 3, 3> e = a;
+    e = e * b;
+    e -= e * a;
+    const Matrix<double, 3, 3> f = ab - ab * a;
+    for (std::size_t i = 0; i < 9; ++i) {
+      assert(std::abs(e.cgetf(i) - f.cgetf(i)) < 1e-9);
+    }
+  }
+}
+
+
+namespace
+{
+  using Pauli = csp::math::Matrix<std::complex<double>, 2, 2>;
+
+  constexpr Pauli MakePauli(const int axis)
+  {
+    using C = std::complex<double>;
+
+    Pauli s;
+    if (axis == 0) {
+      s.get(0, 1) = C(1., 0.);
+      s.get(1, 0) = C(1., 0.);
+    } else if (axis == 1) {
+      s.get(0, 1) = C(0., -1.);
+      s.get(1, 0) = C(0., 1.);
+    } else {
+      s.get(0, 0) = C(1., 0.);
+      s.get(1, 1) = C(-1., 0.);
+    }
+    return s;
+  }
+
+  constexpr Pauli kSigmaX = MakePauli(0);
+  constexpr Pauli kSigmaY = MakePauli(1);
+  constexpr Pauli kSigmaZ = MakePauli(2);
+
+
+  template <typename Mat>
+  constexpr bool Equal(const Mat& a, const Mat& b)
+  {
+    for (std::size_t i = 0; i < a.rows() * a.cols(); ++i) {
+      if (a.cgetf(i) != b.cgetf(i)) {
+        return false;
+      }
+    }
+    return true;
+  }
+}
+
+
+void TestConstexprMatrix()
+{
+  using csp::math::Matrix;
+  using C = std::complex<double>;
+
+  // [s_x, s_y] = 2i s_z, s_x^2 = 1, tr s_z = 0
+  static_assert(Equal(kSigmaX.commute(kSigmaY), Pauli(kSigmaZ * C(0., 2.))));
+  static_assert(Equal(Pauli(kSigmaX * kSigmaX), Pauli(Pauli() + C(1., 0.))));
+  static_assert(kSigmaZ.trace() == C(0., 0.));
+  static_assert(Pauli(kSigmaX * kSigmaY + kSigmaY * kSigmaX).trace() == 0.);
+
+  // A quarter turn about z has order 4.
+  constexpr Matrix<double, 3, 3> kTurn = [] {
+    Matrix<double, 3, 3> r;
+    r.get(0, 1) = -1.;
+    r.get(1, 0) = 1.;
+    r.get(2, 2) = 1.;
+    return r;
+  }();
+  constexpr Matrix<double, 3, 3> kHalfTurn = kTurn * kTurn;
+  constexpr Matrix<double, 3, 3> kFullTurn = kHalfTurn * kHalfTurn;
+  static_assert(kHalfTurn.cget(0, 0) == -1. && kHalfTurn.trace() == -1.);
+  static_assert(kFullTurn.trace() == 3. && kFullTurn.cget(0, 1) == 0.);
+
+  constexpr Matrix<int, 2, 3> kA = [] {
+    Matrix<int, 2, 3> a;
+    for (std::size_t i = 0; i < 6; ++i) {
+      a.getf(i) = static_cast<int>(i) + 1;
+    }
+    return a;
+  }();
+  constexpr Matrix<int, 3, 2> kB = [] {
+    Matrix<int, 3, 2> b(1);
+    b *= 2;
+    b.get(2, 1) = -1;
+    return b;
+  }();
+  constexpr Matrix<int, 2, 2> kAB = kA * kB - 1;
+  static_assert(kAB.cget(0, 0) == 11 && kAB.cget(0, 1) == 3);
+  static_assert(kAB.cget(1, 0) == 30 && kAB.cget(1, 1) == 11);
+
+  // Constant and runtime evaluation agree.
+  Pauli x = kSigmaX;
+  const Pauli runtime = x.commute(kSigmaY);
+  assert(Equal(runtime, kSigmaX.commute(kSigmaY)));
+}
+
+
+void TestDynMatrix()
+{
+  using csp::math::DynMatrix;
+  using csp::math::Matrix;
+  using C = std::complex<double>;
+
+  {
+    const std::size_t n = 67;
+    DynMatrix<C> a(n, n);
+    DynMatrix<C> b(n, n);
+    for (std::size_t i = 0; i < n * n; ++i) {
+      a.getf(i) = {std::sin(0.1 * i), 0.01 * i};
+      b.getf(i) = {std::cos(0.3 * i), -0.2};
+    }
+    assert(reinterpret_cast<std::uintptr_t>(a.data()) % 64 == 0);
+
+    const DynMatrix<C> ab = a * b;
+    for (std::size_t row = 0; row < n; row += 11) {
+      for (std::size_t col = 0; col < n; col += 7) {
+        C val = 0;
+        for (std::size_t tmp = 0; tmp < n; ++tmp) {
+          val += a.cgetf(row, tmp) * b.cgetf(tmp, col);
+        }
+        assert(std::abs(ab.cgetf(row, col) - val) < 1e-10);
+      }
+    }
+
+    const DynMatrix<C> comm = a.commute(b);
+    const DynMatrix<C> ba = b * a;
+    const DynMatrix<C> c = comm - ab + ba + C(2.);
+    assert(std::abs(c.trace() - C(2. * n)) < 1e-9);
+
+    DynMatrix<C> moved = std::move(a);
+    assert(moved.rows() == n && a.rows() == 0 && a.data() == nullptr);
+  }
+
+  {
+    Matrix<double, 2, 3> fixed;
+    fixed.get(1, 2) = 5.;
+    const DynMatrix<double> dyn(fixed);
+    assert(dyn.rows() == 2 && dyn.cols() == 3 && dyn.cget(1, 2) == 5.);
+
+    const DynMatrix<double> twice = dyn * 2.;
+    const Matrix<double, 2, 3> back = twice.ToMatrix<2, 3>();
+    assert(back.cget(1, 2) == 10.);
+
+    bool is_thrown = false;
+    try {
+      const DynMatrix<double> bad = dyn + DynMatrix<double>(3, 2);
+    } catch (const std::invalid_argument&) {
+      is_thrown = true;
+    }
+    assert(is_thrown);
+  }
+}
+
+
+void TestParallel()
+{
+  using csp::math::DynMatrix;
+  using C = std::complex<double>;
+
+  {
+    csp::utils::ThreadPool pool(3);
+    std::vector<int> hits(1000, 0);
+    pool.ParallelFor(0, hits.size(), 7,
+      [&](const std::size_t lo, const std::size_t hi) {
+        for (std::size_t i = lo; i < hi; ++i) {
+          ++hits[i];
+        }
+      }
+    );
+    assert(std::ranges::all_of(hits, [](const int hit) { return hit == 1; }));
+  }
+
+  const std::size_t n = 300;
+  DynMatrix<C> a(n, n);
+  DynMatrix<C> b(n, n);
+  for (std::size_t i = 0; i < n * n; ++i) {
+    a.getf(i) = {std::sin(0.1 * i), 0.01 * (i % 17)};
+    b.getf(i) = {std::cos(0.3 * i), -0.2};
+  }
+  const DynMatrix<C> serial = a.commute(b) + a * C(2.);
+
+  csp::utils::SetGlobalThreads(4);
+  // The calling thread is the fourth.
+  assert(csp::utils::GlobalThreadPool()->size() == 3);
+  const DynMatrix<C> parallel = a.commute(b) + a * C(2.);
+  csp::utils::SetGlobalThreads(0);
+
+  for (std::size_t i = 0; i < n * n; ++i) {
+    assert(std::abs(serial.cgetf(i) - parallel.cgetf(i)) < 1e-9);
+  }
+}
+
+
+void TestDecomposition()
+{
+  using csp::math::DynMatrix;
+  using csp::math::Matrix;
+  using C = std::complex<double>;
+
+  {
+    Matrix<double, 3, 3> a;
+    const double vals[9] = {2., 1., 1., 4., -6., 0., -2., 7., 2.};
+    for (std::size_t i = 0; i < 9; ++i) {
+      a.getf(i) = vals[i];
+    }
+    assert(std::abs(csp::math::Determinant(a) - (-16.)) < 1e-12);
+    assert(std::abs(csp::math::Lu(a).determinant() - (-16.)) < 1e-12);
+
+    const Matrix<double, 3, 3> id = a * csp::math::Inverse(a);
+    const Matrix<double, 3, 3> diff = id - 1.;
+    for (std::size_t i = 0; i < 9; ++i) {
+      assert(std::abs(diff.cgetf(i)) < 1e-12);
+    }
+  }
+
+  {
+    Matrix<double, 4, 4> a;
+    for (std::size_t i = 0; i < 16; ++i) {
+      a.getf(i) = std::sin(1. + i * i);
+    }
+    const Matrix<double, 4, 4> lu_inv = csp::math::Lu(a).inverse();
+    const Matrix<double, 4, 4> small_inv = csp::math::Inverse(a);
+    for (std::size_t i = 0; i < 16; ++i) {
+      assert(std::abs(lu_inv.cgetf(i) - small_inv.cgetf(i)) < 1e-9);
+    }
+  }
+
+  const std::size_t n = 150;
+  DynMatrix<C> a(n, n);
+  DynMatrix<C> x(n, 2);
+  for (std::size_t i = 0; i < n * n; ++i) {
+    a.getf(i) = {std::sin(0.37 * i * i), std::cos(0.53 * i * i + 1.)};
+  }
+  for (std::size_t i = 0; i < 2 * n; ++i) {
+    x.getf(i) = {0.1 * i, 1.};
+  }
+  const DynMatrix<C> b = a * x;
+
+  {
+    const DynMatrix<C> sol = csp::math::Solve(a, b);
+    for (std::size_t i = 0; i < 2 * n; ++i) {
+      assert(std::abs(sol.cgetf(i) - x.cgetf(i)) < 1e-8);
+    }
+  }
+
+  {
+    const DynMatrix<C> sol = csp::math::Qr(a).solve(b);
+    for (std::size_t i = 0; i < 2 * n; ++i) {
+      assert(std::abs(sol.cgetf(i) - x.cgetf(i)) < 1e-8);
+    }
+  }
+
+  {
+    // A^H A + n is Hermitian positive definite.
+    DynMatrix<C> ah(n, n);
+    for (std::size_t row = 0; row < n; ++row) {
+      for (std::size_t col = 0; col < n; ++col) {
+        ah.getf(row, col) = std::conj(a.cgetf(col, row));
+      }
+    }
+    const DynMatrix<C> hpd = ah * a + C(double(n));
+    const DynMatrix<C> rhs = hpd * x;
+    const DynMatrix<C> sol = csp::math::Cholesky(hpd).solve(rhs);
+    for (std::size_t i = 0; i < 2 * n; ++i) {
+      assert(std::abs(sol.cgetf(i) - x.cgetf(i)) < 1e-8);
+    }
+  }
+
+  {
+    Matrix<double, 6, 6> spd(1.);
+    for (std::size_t i = 0; i < 6; ++i) {
+      spd.get(i, i) = 2. + i;
+    }
+    const double det_lu = csp::math::Lu(spd).determinant();
+    const double det_chol = csp::math::Cholesky(spd).determinant();
+    assert(std::abs(det_lu / det_chol - 1.) < 1e-12);
+  }
+
+  {
+    bool is_thrown = false;
+    try {
+      csp::math::Inverse(Matrix<double, 2, 2>());
+    } catch (const std::domain_error&) {
+      is_thrown = true;
+    }
+    assert(is_thrown);
+  }
+}
+
+
+void TestHermitianEigen()
+{
+  using csp::math::DynMatrix;
+  using C = std::complex<double>;
+
+  const std::size_t n = 40;
+  DynMatrix<C> h(n, n);
+  for (std::size_t row = 0; row < n; ++row) {
+    for (std::size_t col = 0; col <= row; ++col) {
+      const double x = std::sin(0.7 * (row * row + 3 * col));
+      const double y = row == col ? 0. : std::cos(1.3 * (row + col * col));
+      h.getf(row, col) = {x, y};
+      h.getf(col, row) = {x, -y};
+    }
+  }
+
+  csp::math::HermitianEigenSolver<C> solver(n);
+  solver.Compute(h);
+  const auto values = solver.get_values();
+  const auto vectors = solver.get_vectors();
+
+  C trace = 0;
+  double sum = 0;
+  for (std::size_t i = 0; i < n; ++i) {
+    trace += h.cgetf(i, i);
+    sum += values[i];
+    assert(i == 0 || values[i - 1] <= values[i]);
+  }
+  assert(std::abs(trace.real() - sum) < 1e-10);
+
+  for (std::size_t j = 0; j < n; ++j) {
+    double norm = 0;
+    for (std::size_t row = 0; row < n; ++row) {
+      C hv = 0;
+      for (std::size_t k = 0; k < n; ++k) {
+        hv += h.cgetf(row, k) * vectors[k * n + j];
+      }
+      assert(std::abs(hv - values[j] * vectors[row * n + j]) < 1e-10);
+      norm += std::norm(vectors[row * n + j]);
+    }
+    assert(std::abs(norm - 1.) < 1e-10);
+  }
+
+  {
+    const std::vector<double> single(values.begin(), values.end());
+    std::vector<DynMatrix<C>> mats;
+    for (int i = 0; i < 5; ++i) {
+      DynMatrix<C> mat = h.Clone();
+      mat += C(i);
+      mats.push_back(std::move(mat));
+    }
+    std::vector<double> batch(5 * n);
+    solver.ComputeBatch<DynMatrix<C>>(mats, batch);
+    for (std::size_t i = 0; i < 5; ++i) {
+      for (std::size_t j = 0; j < n; ++j) {
+        assert(std::abs(batch[i * n + j] - (single[j] + i)) < 1e-10);
+      }
+    }
+
+    // Parallel batches reuse the solver's workspaces between calls.
+    std::vector<C> vectors(5 * n * n);
+    solver.ComputeBatch<DynMatrix<C>>(mats, batch, vectors);
+    std::vector<C> parallel_vectors(5 * n * n);
+    csp::utils::SetGlobalThreads(3);
+    for (int round = 0; round < 2; ++round) {
+      std::vector<double> parallel(5 * n);
+      solver.ComputeBatch<DynMatrix<C>>(mats, parallel, parallel_vectors);
+      assert(parallel == batch && parallel_vectors == vectors);
+    }
+    csp::utils::SetGlobalThreads(0);
+  }
+}
+
+
+void TestMatrixExp()
+{
+  using csp::math::DynMatrix;
+  using csp::math::Matrix;
+  using C = std::complex<double>;
+
+  for (const double theta : {1e-3, 0.2, 0.9, 2., 10.}) {
+    Matrix<C, 2, 2> sigma_x;
+    sigma_x.get(0, 1) = 1.;
+    sigma_x.get(1, 0) = 1.;
+    const Matrix<C, 2, 2> u = csp::math::Expm<Matrix<C, 2, 2>>(
+      sigma_x * C(0., -theta)
+    );
+    assert(std::abs(u.cget(0, 0) - std::cos(theta)) < 1e-12);
+    assert(std::abs(u.cget(0, 1) - C(0., -std::sin(theta))) < 1e-12);
+  }
+
+  const std::size_t n = 30;
+  DynMatrix<C> h(n, n);
+  DynMatrix<C> psi(n, 1);
+  for (std::size_t row = 0; row < n; ++row) {
+    for (std::size_t col = 0; col <= row; ++col) {
+      const double x = std::sin(0.7 * (row * row + 3 * col));
+      const double y = row == col ? 0. : std::cos(1.3 * (row + col * col));
+      h.getf(row, col) = {x, y};
+      h.getf(col, row) = {x, -y};
+    }
+    psi.getf(row) = {std::cos(0.3 * row), 0.};
+  }
+
+  csp::math::Propagator<DynMatrix<C>> propagator;
+  const DynMatrix<C>& u = propagator.get(h, 2.);
+  assert(&propagator.get(h, 2.) == &u);
+
+  const DynMatrix<C> dense = u * psi;
+  const DynMatrix<C> action = csp::math::ExpmMultiply(h, psi, C(0., -2.));
+  double norm_in = 0;
+  double norm_out = 0;
+  for (std::size_t i = 0; i < n; ++i) {
+    assert(std::abs(dense.cgetf(i) - action.cgetf(i)) < 1e-10);
+    norm_in += std::norm(psi.cgetf(i));
+    norm_out += std::norm(dense.cgetf(i));
+  }
+  assert(std::abs(norm_in - norm_out) < 1e-10);
+}
+
+
+void TestSparseMatrix()
+{
+  using csp::math::DynMatrix;
+  using csp::math::Matrix;
+  using csp::math::SparseMatrix;
+  using csp::math::Triplet;
+  using C = std::complex<double>;
+
+  {
+    const std::vector<Triplet<double>> triplets = {
+      {2, 1, 4.}, {0, 0, 1.}, {2, 1, 0.5}, {1, 2, -3.}, {0, 2, 2.}
+    };
+    const SparseMatrix<double> a(3, 3, triplets);
+    assert(a.nonzeros() == 4);
+    assert(a.cget(2, 1) == 4.5 && a.cget(1, 1) == 0.);
+
+    const Matrix<double, 3, 3> dense = a.ToMatrix<3, 3>();
+    const SparseMatrix<double> back(dense);
+    assert(back.nonzeros() == 4 && back.cget(0, 2) == 2.);
+
+    const SparseMatrix<double> at = a.Transpose();
+    assert(at.cget(1, 2) == 4.5 && at.cget(2, 0) == 2.);
+
+    Matrix<double, 3, 3> b;
+    for (std::size_t i = 0; i < 9; ++i) {
+      b.getf(i) = 0.5 * i - 1.;
+    }
+    const Matrix<double, 3, 3> expected = dense * b;
+    const Matrix<double, 3, 3> product = a * b;
+    for (std::size_t i = 0; i < 9; ++i) {
+      assert(std::abs(product.cgetf(i) - expected.cgetf(i)) < 1e-12);
+    }
+  }
+
+  // Tight-binding ring with a complex hopping and an on-site potential.
+  const std::size_t n = 12000;
+  std::vector<Triplet<C>> triplets;
+  for (std::size_t i = 0; i < n; ++i) {
+    const std::size_t j = (i + 1) % n;
+    triplets.push_back({i, i, C(std::cos(0.1 * i), 0.)});
+    triplets.push_back({i, j, C(-1., 0.2)});
+    triplets.push_back({j, i, C(-1., -0.2)});
+  }
+  const SparseMatrix<C> h(n, n, triplets);
+  assert(h.nonzeros() == 3 * n);
+  assert(h.memory() * 100 < n * n * sizeof(C));
+
+  std::vector<C> psi(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    psi[i] = {std::sin(0.01 * i), std::cos(0.02 * i)};
+  }
+  const std::vector<C> serial = h * psi;
+  for (std::size_t i = 0; i < n; ++i) {
+    const std::size_t next = (i + 1) % n;
+    const std::size_t prev = (i + n - 1) % n;
+    const C expected = h.cget(i, i) * psi[i] + C(-1., 0.2) * psi[next]
+      + C(-1., -0.2) * psi[prev];
+    assert(std::abs(serial[i] - expected) < 1e-12);
+  }
+
+  DynMatrix<C> block(n, 8);
+  for (std::size_t i = 0; i < n * 8; ++i) {
+    block.getf(i) = {0.001 * i, 1.};
+  }
+  const DynMatrix<C> sp_block = h * block;
+
+  csp::utils::SetGlobalThreads(4);
+  const std::vector<C> parallel = h * psi;
+  const DynMatrix<C> parallel_block = h * block;
+  csp::utils::SetGlobalThreads(0);
+
+  for (std::size_t i = 0; i < n; ++i) {
+    assert(std::abs(serial[i] - parallel[i]) < 1e-12);
+  }
+  for (std::size_t i = 0; i < n * 8; ++i) {
+    assert(std::abs(sp_block.cgetf(i) - parallel_block.cgetf(i)) < 1e-12);
+  }
+  for (std::size_t j = 0; j < 8; ++j) {
+    std::vector<C> column(n);
+    for (std::size_t i = 0; i < n; ++i) {
+      column[i] = block.cgetf(i, j);
+    }
+    const std::vector<C> expected = h * column;
+    for (std::size_t i = 0; i < n; ++i) {
+      assert(std::abs(sp_block.cgetf(i, j) - expected[i]) < 1e-12);
+    }
+  }
+
+  // One full row among diagonal ones, and trailing empty rows.
+  {
+    const std::size_t m = 50000;
+    std::vector<Triplet<double>> skewed;
+    for (std::size_t j = 0; j < m; ++j) {
+      skewed.push_back({3, j, 1e-3 * j});
+    }
+    for (std::size_t i = 0; i + 100 < m; ++i) {
+      skewed.push_back({i, i, 2.});
+    }
+    const SparseMatrix<double> s(m, m, skewed);
+    std::vector<double> x(m);
+    for (std::size_t i = 0; i < m; ++i) {
+      x[i] = std::sin(0.5 * i);
+    }
+    std::vector<double> parallel_y(m, 7.);
+    csp::utils::SetGlobalThreads(4);
+    s.Multiply(x, parallel_y, 1., 0.5);
+    csp::utils::SetGlobalThreads(0);
+    std::vector<double> serial_y(m, 7.);
+    s.Multiply(x, serial_y, 1., 0.5);
+    for (std::size_t i = 0; i < m; ++i) {
+      assert(parallel_y[i] == serial_y[i]);
+    }
+    assert(serial_y[m - 1] == 3.5 && serial_y[0] == 2. * x[0] + 3.5);
+
+    std::vector<double> empty_y(4, 1.);
+    SparseMatrix<double>(4, 4).Multiply(std::vector<double>(4), empty_y);
+    assert(empty_y == std::vector<double>(4, 0.));
+  }
+}
+
+
+void TestKron()
+{
+  using csp::math::DynMatrix;
+  using csp::math::Kron;
+  using csp::math::KronIdentity;
+  using csp::math::KronProduct;
+  using csp::math::KronSum;
+  using csp::math::Matrix;
+  using C = std::complex<double>;
+
+  {
+    Matrix<double, 2, 2> a;
+    a.get(0, 0) = 1.;
+    a.get(0, 1) = 2.;
+    a.get(1, 0) = -1.;
+    a.get(1, 1) = 0.5;
+    DynMatrix<double> b(3, 3);
+    for (std::size_t i = 0; i < 9; ++i) {
+      b.getf(i) = 0.25 * i - 1.;
+    }
+    const KronProduct<double> ab = Kron(a, b) * 2.;
+    const DynMatrix<double> dense = ab.ToDynMatrix();
+    for (std::size_t i = 0; i < 6; ++i) {
+      for (std::size_t j = 0; j < 6; ++j) {
+        const double expected = (
+          2. * a.cget(i / 3, j / 3) * b.cget(i % 3, j % 3)
+        );
+        assert(std::abs(dense.cget(i, j) - expected) < 1e-12);
+      }
+    }
+
+    // Empty factors would leave a zero-dimensional product.
+    KronProduct<double> p;
+    p.Append(DynMatrix<double>(2, 2));
+    for (int kind = 0; kind < 2; ++kind) {
+      bool is_thrown = false;
+      try {
+        if (kind == 0) {
+          p.Append(DynMatrix<double>(0, 0));
+        } else {
+          p.Append(KronIdentity{0});
+        }
+      } catch (const std::invalid_argument&) {
+        is_thrown = true;
+      }
+      assert(is_thrown && p.size() == 2 && p.factors() == 1);
+    }
+  }
+
+  // Transverse-field Ising chain, H = -sum z_i z_{i+1} - g sum x_i.
+  Matrix<C, 2, 2> sx;
+  sx.get(0, 1) = 1.;
+  sx.get(1, 0) = 1.;
+  Matrix<C, 2, 2> sz;
+  sz.get(0, 0) = 1.;
+  sz.get(1, 1) = -1.;
+
+  const auto chain = [&](const std::size_t sites) {
+    KronSum<C> h;
+    for (std::size_t i = 0; i < sites; ++i) {
+      KronProduct<C> bond;
+      KronProduct<C> field;
+      for (std::size_t j = 0; j < sites; ++j) {
+        if (j == i || (i + 1 < sites && j == i + 1)) {
+          bond.Append(sz);
+        } else {
+          bond.Append(KronIdentity{2});
+        }
+        if (j == i) {
+          field.Append(sx);
+        } else {
+          field.Append(KronIdentity{2});
+        }
+      }
+      if (i + 1 < sites) {
+        h += bond * C(-1.);
+      }
+      h += field * C(-0.7);
+    }
+    return h;
+  };
+
+  const KronSum<C> h = chain(6);
+  assert(h.size() == 64 && h.get_terms().size() == 11);
+  const DynMatrix<C> dense = h.ToDynMatrix();
+  std::vector<C> psi(64);
+  for (std::size_t i = 0; i < psi.size(); ++i) {
+    psi[i] = {std::sin(0.3 * i), std::cos(0.7 * i)};
+  }
+  const std::vector<C> lazy = h * psi;
+  for (std::size_t i = 0; i < psi.size(); ++i) {
+    C expected = 0;
+    for (std::size_t j = 0; j < psi.size(); ++j) {
+      expected += dense.cget(i, j) * psi[j];
+    }
+    assert(std::abs(lazy[i] - expected) < 1e-12);
+  }
+
+  // Factors of a 16-site chain take kilobytes, its dense matrix 64 GiB.
+  const KronSum<C> large = chain(16);
+  const std::size_t dense_bytes = large.size() * large.size() * sizeof(C);
+  assert(large.memory() * 1000000 < dense_bytes);
+}
+
+
+void TestPlanarMatrix()
+{
+  using csp::math::DynMatrix;
+  using csp::math::Matrix;
+  using csp::math::PlanarMatrix;
+  using C = std::complex<double>;
+
+  DynMatrix<C> a(70, 50);
+  DynMatrix<C> b(50, 40);
+  for (std::size_t i = 0; i < a.size(); ++i) {
+    a.getf(i) = {std::sin(0.1 * i), std::cos(0.3 * i)};
+  }
+  for (std::size_t i = 0; i < b.size(); ++i) {
+    b.getf(i) = {std::cos(0.7 * i), 0.2 * std::sin(1.1 * i)};
+  }
+  const DynMatrix<C> expected = a * b;
+
+  const PlanarMatrix<double> pa(a);
+  const PlanarMatrix<double> pb(b);
+  assert(pa.cget(3, 7) == a.cget(3, 7));
+
+  const DynMatrix<C> product_4m = (pa * pb).ToDynMatrix();
+  PlanarMatrix<double> pc;
+  csp::math::Multiply3M(pa, pb, pc);
+  const DynMatrix<C> product_3m = pc.ToDynMatrix();
+  for (std::size_t i = 0; i < expected.size(); ++i) {
+    assert(std::abs(product_4m.cgetf(i) - expected.cgetf(i)) < 1e-11);
+    assert(std::abs(product_3m.cgetf(i) - expected.cgetf(i)) < 1e-11);
+  }
+
+  Matrix<C, 2, 2> m;
+  m.get(0, 0) = {1., 2.};
+  m.get(0, 1) = {0., -1.};
+  m.get(1, 0) = {3., 0.5};
+  m.get(1, 1) = {-2., 1.};
+  PlanarMatrix<double> pm(m);
+  csp::math::Multiply4M(pm, pm, pm);
+  pm *= C(0., 1.);
+  const Matrix<C, 2, 2> squared = m * m * C(0., 1.);
+  const Matrix<C, 2, 2> back = pm.ToMatrix<2, 2>();
+  for (std::size_t i = 0; i < 4; ++i) {
+    assert(std::abs(back.cgetf(i) - squared.cgetf(i)) < 1e-12);
+  }
+}
+
+
+void TestMatrixBatch()
+{
+  using csp::math::Matrix;
+  using csp::math::MatrixBatch;
+  using M3 = Matrix<double, 3, 3>;
+  using M34 = Matrix<double, 3, 4>;
+  using M4 = Matrix<double, 4, 4>;
+
+  const std::size_t n = 1000;
+  std::vector<M3> as(n);
+  std::vector<M3> bs(n);
+  std::vector<M34> cs(n);
+  for (std::size_t m = 0; m < n; ++m) {
+    for (std::size_t i = 0; i < 9; ++i) {
+      as[m].getf(i) = std::sin(0.1 * m + i);
+      bs[m].getf(i) = std::cos(0.2 * m - i);
+    }
+    for (std::size_t i = 0; i < 12; ++i) {
+      cs[m].getf(i) = 0.01 * m - 0.5 * i;
+    }
+  }
+
+  const MatrixBatch<double, 3, 3> a(as);
+  const MatrixBatch<double, 3, 3> b(bs);
+  const MatrixBatch<double, 3, 4> c(cs);
+  assert(a.size() == n);
+
+  const MatrixBatch<double, 3, 3> sum = a + b;
+  const MatrixBatch<double, 3, 4> product = a * c;
+  const MatrixBatch<double, 3, 3> commutator = a.commute(b);
+  std::vector<double> traces(n);
+  a.trace(traces);
+
+  std::vector<M34> products(n);
+  product.Gather(products);
+  for (std::size_t m = 0; m < n; ++m) {
+    const M3 expected_sum = as[m] + bs[m];
+    const M34 expected_product = as[m] * cs[m];
+    const M3 expected_commutator = as[m].commute(bs[m]);
+    const M3 got_sum = sum.Gather(m);
+    const M3 got_commutator = commutator.Gather(m);
+    for (std::size_t i = 0; i < 9; ++i) {
+      assert(std::abs(got_sum.cgetf(i) - expected_sum.cgetf(i)) < 1e-14);
+      assert(
+        std::abs(got_commutator.cgetf(i) - expected_commutator.cgetf(i))
+        < 1e-13
+      );
+    }
+    for (std::size_t i = 0; i < 12; ++i) {
+      assert(
+        std::abs(products[m].cgetf(i) - expected_product.cgetf(i)) < 1e-13
+      );
+    }
+    assert(std::abs(traces[m] - as[m].trace()) < 1e-14);
+  }
+
+  // In-place and non-square sums.
+  Matrix<double, 2, 2> p;
+  Matrix<double, 2, 2> q;
+  for (std::size_t i = 0; i < 4; ++i) {
+    p.getf(i) = 1. + i;
+    q.getf(i) = 5. + i;
+  }
+  MatrixBatch<double, 2, 2> lhs(std::span<const Matrix<double, 2, 2>>(&p, 1));
+  const MatrixBatch<double, 2, 2> rhs(
+    std::span<const Matrix<double, 2, 2>>(&q, 1)
+  );
+  csp::math::Add(lhs, rhs, lhs);
+  const Matrix<double, 2, 2> in_place = lhs.Gather(0);
+  assert(in_place.cgetf(0) == 6. && in_place.cgetf(1) == 8.);
+  assert(in_place.cgetf(2) == 10. && in_place.cgetf(3) == 12.);
+
+  MatrixBatch<double, 3, 4> wide(c.size());
+  csp::math::Add(c, c, wide);
+  csp::math::Add(wide, c, wide);
+  for (std::size_t m = 0; m < n; m += 97) {
+    const M34 got = wide.Gather(m);
+    for (std::size_t i = 0; i < 12; ++i) {
+      assert(std::abs(got.cgetf(i) - 3. * cs[m].cgetf(i)) < 1e-13);
+    }
+  }
+
+  // Float traces and products keep the single-matrix precision.
+  Matrix<float, 3, 3> f;
+  f.get(0, 0) = 1e8f;
+  f.get(1, 1) = 1.f;
+  f.get(2, 2) = -1e8f;
+  const MatrixBatch<float, 3, 3> fs(
+    std::span<const Matrix<float, 3, 3>>(&f, 1)
+  );
+  float f_trace = 0.f;
+  fs.trace(std::span<float>(&f_trace, 1));
+  assert(f_trace == f.trace() && f_trace == 1.f);
+
+  Matrix<float, 3, 3> u;
+  u.get(0, 0) = 1e8f;
+  u.get(0, 1) = 1.f;
+  u.get(0, 2) = -1e8f;
+  Matrix<float, 3, 3> ones;
+  for (std::size_t i = 0; i < 9; ++i) {
+    ones.getf(i) = 1.f;
+  }
+  const MatrixBatch<float, 3, 3> us(
+    std::span<const Matrix<float, 3, 3>>(&u, 1)
+  );
+  const MatrixBatch<float, 3, 3> ones_batch(
+    std::span<const Matrix<float, 3, 3>>(&ones, 1)
+  );
+  const Matrix<float, 3, 3> f_product = (us * ones_batch).Gather(0);
+  const Matrix<float, 3, 3> expected_f_product = u * ones;
+  for (std::size_t i = 0; i < 9; ++i) {
+    assert(f_product.cgetf(i) == expected_f_product.cgetf(i));
+  }
+  assert(f_product.cget(0, 2) == 1.f);
+
+  MatrixBatch<double, 4, 4> rotations(200000);
+  M4 r;
+  r.get(0, 1) = 1.;
+  r.get(1, 0) = -1.;
+  r.get(2, 2) = 1.;
+  r.get(3, 3) = 1.;
+  rotations.Scatter(7, r);
+  csp::math::Multiply(rotations, rotations, rotations);
+  csp::utils::SetGlobalThreads(4);
+  const MatrixBatch<double, 4, 4> parallel = rotations * rotations;
+  csp::utils::SetGlobalThreads(0);
+  const M4 turn = parallel.Gather(7);
+  assert(turn.cget(0, 0) == 1. && turn.cget(1, 1) == 1.);
+  assert(parallel.Gather(8).trace() == 0.);
+}
+
+
+void TestMixedPrecision()
+{
+  using csp::math::DynMatrix;
+  using csp::math::Matrix;
+  using CF = std::complex<float>;
+  using CD = std::complex<double>;
+
+  {
+    Matrix<CD, 20, 20> a;
+    Matrix<CD, 20, 20> b;
+    for (std::size_t i = 0; i < 20 * 20; ++i) {
+      a.getf(i) = {std::sin(0.2 * i), std::cos(0.7 * i)};
+      b.getf(i) = {0.3 * std::cos(0.1 * i), -std::sin(0.4 * i)};
+    }
+    const Matrix<CD, 20, 20> expected = a * b;
+    const Matrix<CF, 20, 20> af(a);
+    const Matrix<CF, 20, 20> bf(b);
+    const Matrix<CF, 20, 20> product = af * bf;
+    const Matrix<CD, 20, 20> widened(product);
+    for (std::size_t i = 0; i < 20 * 20; ++i) {
+      assert(std::abs(widened.cgetf(i) - expected.cgetf(i)) < 1e-5);
+    }
+    assert(std::abs(CD(product.trace()) - expected.trace()) < 1e-4);
+  }
+
+  // 1e8 + 1 - 1e8 cancels to 0 in float, but is 1 in double.
+  {
+    Matrix<float, 1, 3> row;
+    row.get(0) = 1e8f;
+    row.get(1) = 1.f;
+    row.get(2) = -1e8f;
+    const Matrix<float, 1, 1> dot = row * Matrix<float, 3, 1>(1.f);
+    assert(dot.cget(0) == 1.f);
+
+    Matrix<float, 3, 3> diag;
+    for (std::size_t i = 0; i < 3; ++i) {
+      diag.get(i, i) = row.cget(i);
+    }
+    assert(diag.trace() == 1.f);
+
+    const std::size_t k = 3000;
+    DynMatrix<float> a(1, k);
+    for (std::size_t i = 0; i < k; ++i) {
+      a.getf(i) = row.cget(i % 3);
+    }
+    const DynMatrix<float> b(k, 2, 1.f);
+    const DynMatrix<float> c = a * b;
+    assert(c.cget(0, 0) == 1000.f && c.cget(0, 1) == 1000.f);
+  }
+
+  {
+    DynMatrix<CD> a(30, 30);
+    for (std::size_t i = 0; i < a.size(); ++i) {
+      a.getf(i) = {std::sin(1.3 * i), 0.5};
+    }
+    const DynMatrix<CF> narrow(a);
+    const DynMatrix<CD> wide(narrow);
+    for (std::size_t i = 0; i < a.size(); ++i) {
+      assert(narrow.cgetf(i) == CF(a.cgetf(i)));
+      assert(std::abs(wide.cgetf(i) - a.cgetf(i)) < 1e-7);
+    }
+    const DynMatrix<CF> square = narrow * narrow;
+    const DynMatrix<CD> expected = a * a;
+    for (std::size_t i = 0; i < a.size(); ++i) {
+      assert(std::abs(CD(square.cgetf(i)) - expected.cgetf(i)) < 1e-4);
+    }
+  }
+}
+
+
+void TestProgressBar()
+{
+  std::ostringstream out;
+  {
+    csp::time::ProgressBar<long> bar(
+      40000, 20, std::chrono::milliseconds(1), out
+    );
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+      threads.emplace_back([&bar] {
+        auto local = bar.MakeLocal();
+        for (int i = 0; i < 5000; ++i) {
+          ++local;
+          ++bar;
+          local.AddBytes(64);
+        }
+      });
+    }
+    for (std::thread& thread : threads) {
+      thread.join();
+    }
+    assert(bar.get_total() == 40000);
+    assert(bar.get_progress() == 40000);
+    assert(bar.get_bytes() == 4 * 5000 * 64);
+  }
+  const std::string text = out.str();
+  const std::size_t last = text.rfind('[');
+  assert(text.compare(last, 22, "[####################]") == 0);
+  assert(text.find("100%", last) != std::string::npos);
+  assert(text.find(" it/s ", last) != std::string::npos);
+  assert(text.find("B/s", last) != std::string::npos);
+  assert(text.find("ETA", last) == std::string::npos);
+  assert(text.back() == '\n');
+
+  // The first sample sets the rate; later ones are weighted by elapsed
+  // time.
+  csp::time::detail::RateMeter meter;
+  meter.Update(10., 1.);
+  assert(meter.get_rate() == 10.);
+  meter.Update(30., 2.);
+  const double weight = 1. - std::exp(-1. / 2.);
+  assert(std::abs(meter.get_rate() - (10. + weight * 10.)) < 1e-12);
+  meter.Update(30., 2.);
+  assert(std::abs(meter.get_rate() - (10. + weight * 10.)) < 1e-12);
+
+  assert(csp::time::detail::SiPrint(999.) == "999");
+  assert(csp::time::detail::SiPrint(1234567.) == "1.23M");
+  assert(csp::time::detail::SiPrint(45600.) == "45.6k");
+  assert(csp::time::detail::SiPrint(999999.) == "1.00M");
+}
+
+
+void TestProgressGroup()
+{
+  std::ostringstream out;
+  {
+    csp::time::ProgressGroup<long> group(10, std::chrono::milliseconds(1), out);
+    auto& load = group.AddTask("load", 3000);
+    auto& compute = group.AddTask("compute", 2000);
+    auto& decode = load.AddSubtask("decode", 1000);
+    assert(group.size() == 3);
+    assert(decode.get_depth() == 1 && decode.get_name() == "decode");
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 2; ++t) {
+      threads.emplace_back([&] {
+        auto local = load.MakeLocal();
+        for (int i = 0; i < 1500; ++i) {
+          ++local;
+          local.AddBytes(8);
+        }
+        for (int i = 0; i < 500; ++i) {
+          ++decode;
+          compute += 2;
+        }
+      });
+    }
+    for (std::thread& thread : threads) {
+      thread.join();
+    }
+    assert(load.get_progress() == 3000 && load.get_bytes() == 24000);
+    assert(decode.get_progress() == 1000);
+    assert(compute.get_progress() == 2000);
+    // Let the render thread redraw the region at least once.
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  }
+
+  // The final frame moves back over the three lines drawn before it and
+  // lists the tasks in tree order, sub-tasks indented.
+  const std::string text = out.str();
+  const std::size_t frame = text.rfind("\r");
+  assert(frame != std::string::npos && text.rfind("\x1b[3A") + 4 == frame);
+  const std::size_t load_line = text.find("load     [##########]100%", frame);
+  const std::size_t decode_line = text.find("  decode [", frame);
+  const std::size_t compute_line = text.find("compute  [", frame);
+  assert(load_line != std::string::npos);
+  assert(load_line < decode_line && decode_line < compute_line);
+  assert(compute_line != std::string::npos);
+  assert(text.find("B/s", load_line) < decode_line);
+  assert(text.back() == '\n');
+}
+
+
 int main()
 {
   TestVector3();
   std::cout << "✅ All Vector3 tests passed." << std::endl;
 
+  TestVector3Array();
+  std::cout << "✅ All Vector3Array tests passed." << std::endl;
+
+  TestQuaternion();
+  std::cout << "✅ All Quaternion tests passed." << std::endl;
+
+  TestSpatialIndex();
+  std::cout << "✅ All SpatialIndex tests passed." << std::endl;
+
+  TestNBody();
+  std::cout << "✅ All NBody tests passed." << std::endl;
+
+  TestOde();
+  std::cout << "✅ All ODE integrator tests passed." << std::endl;
+
   TestColor();
   std::cout << "✅ All Color tests passed." << std::endl;
 
+  TestColorConvert();
+  std::cout << "✅ All color conversion tests passed." << std::endl;
+
+  TestColormap();
+  std::cout << "✅ All Colormap tests passed." << std::endl;
+
+  TestPalette();
+  std::cout << "✅ All Palette tests passed." << std::endl;
+
+  TestImage();
+  std::cout << "✅ All Image tests passed." << std::endl;
+
+  TestMatrix();
+  std::cout << "✅ All Matrix tests passed." << std::endl;
+
+  TestConstexprMatrix();
+  std::cout << "✅ All constexpr Matrix tests passed." << std::endl;
+
+  TestDynMatrix();
+  std::cout << "✅ All DynMatrix tests passed." << std::endl;
+
+  TestParallel();
+  std::cout << "✅ All parallel tests passed." << std::endl;
+
+  TestDecomposition();
+  std::cout << "✅ All decomposition tests passed." << std::endl;
+
+  TestHermitianEigen();
+  std::cout << "✅ All Hermitian eigen tests passed." << std::endl;
+
+  TestMatrixExp();
+  std::cout << "✅ All matrix exponential tests passed." << std::endl;
+
+  TestMixedPrecision();
+  std::cout << "✅ All mixed precision tests passed." << std::endl;
+
+  TestMatrixBatch();
+  std::cout << "✅ All matrix batch tests passed." << std::endl;
+
+  TestPlanarMatrix();
+  std::cout << "✅ All planar matrix tests passed." << std::endl;
+
+  TestKron();
+  std::cout << "✅ All Kron tests passed." << std::endl;
+
+  TestSparseMatrix();
+  std::cout << "✅ All sparse matrix tests passed." << std::endl;
+
+  TestProgressBar();
+  std::cout << "✅ All ProgressBar tests passed." << std::endl;
+
+  TestProgressGroup();
+  std::cout << "✅ All ProgressGroup tests passed." << std::endl;
+
   return 0;
 }